@@ -0,0 +1,302 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef ASYNCLOG_HPP
+#define ASYNCLOG_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+#include "FrameRing.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Bytes of arguments a LogRecord holds, so that a record fills 256 bytes, the arguments past it
+/// are dropped and the line ends with an ellipsis.
+const size_t LOG_PAYLOAD_SIZE{ 252 };
+
+enum class LogLevel : uint8_t
+{
+	Info,
+	Warning
+};
+
+//==================================================================================================
+// C L A S S E S
+
+/// One log call, its arguments kept in binary as a type tag followed by the raw value, or by a
+/// 16 bits length and the characters for a text.
+struct LogRecord
+{
+	enum class Type : uint8_t
+	{
+		Signed,
+		Unsigned,
+		Real,
+		Boolean,
+		Character,
+		Text
+	};
+
+	LogLevel level;
+	bool truncated;
+	uint16_t size;
+	uint8_t payload[LOG_PAYLOAD_SIZE];
+};
+
+/// Logging backend of the capture path, replacing cl::print_line and ht::log_warning where they
+/// are called for every pair.
+///
+/// A call only serializes its arguments into a LogRecord and pushes it into a FrameRing owned by
+/// the calling thread, without lock, allocation nor system call. The log thread drains the rings,
+/// formats the records and writes them to stdout or to the HTLogger files, so that a burst of
+/// lines never delays a frame. A thread whose ring is full loses its calls, the count of lost
+/// records is logged once the ring drains. The lines of a thread keep their order, the lines of
+/// different threads may be interleaved differently than they were logged.
+///
+/// The calls go to the last AsyncLog constructed and still alive, and are written synchronously
+/// when there is none or when it is not asynchronous. The threads logging through an instance must
+/// be stopped before it is destroyed.
+class AsyncLog
+{
+	using Clock = std::chrono::steady_clock;
+
+	/// Ring of one logging thread, the counters are written by a single side each.
+	struct Producer
+	{
+		explicit Producer( const size_t capacity )
+			: thread{ std::this_thread::get_id() }
+			, ring{ capacity }
+			, pushed{ }
+			, dropped{ }
+			, popped{ }
+			, reported{ }
+		{ }
+
+		const std::thread::id thread;
+		FrameRing<LogRecord> ring;
+
+		std::atomic<uint64_t> pushed;
+		std::atomic<uint64_t> dropped;
+		std::atomic<uint64_t> popped;
+		uint64_t reported;
+	};
+
+	/// The producers are allocated aligned on a cache line, which operator new does not ensure.
+	struct ProducerDeleter
+	{
+		void operator()( Producer* producer ) const;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	AsyncLog( const LogParams& params, const ThreadRoleParams& placement );
+
+	~AsyncLog();
+
+	AsyncLog( const AsyncLog& ) = delete;
+
+	AsyncLog& operator=( const AsyncLog& ) = delete;
+
+	/// Waits until the log thread has written every record queued so far.
+	void flush();
+
+	/// Records lost because the ring of their thread was full.
+	uint64_t get_dropped() const;
+
+	template<typename... Args>
+	static void print_line( const Args&... args )
+	{
+		log( LogLevel::Info, args... );
+	}
+
+	template<typename... Args>
+	static void warning( const Args&... args )
+	{
+		log( LogLevel::Warning, args... );
+	}
+
+	/// Logs the elements of a container on one line, separated by spaces.
+	template<typename Container>
+	static void print_container( const Container& container )
+	{
+		LogRecord record;
+		begin( LogLevel::Info, record );
+		for( const auto& element : container )
+		{
+			append( record, element );
+			append( record, ' ' );
+		}
+		submit( record );
+	}
+
+private:
+	template<typename... Args>
+	static void log( const LogLevel level, const Args&... args )
+	{
+		LogRecord record;
+		begin( level, record );
+		append_all( record, args... );
+		submit( record );
+	}
+
+	static void begin( const LogLevel level, LogRecord& record )
+	{
+		record.level = level;
+		record.truncated = false;
+		record.size = 0;
+	}
+
+	static void append_all( LogRecord& record )
+	{
+		static_cast<void>( record );
+	}
+
+	template<typename T, typename... Args>
+	static void append_all( LogRecord& record, const T& value, const Args&... args )
+	{
+		append( record, value );
+		append_all( record, args... );
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+	append( LogRecord& record, const T value )
+	{
+		append_value( record, LogRecord::Type::Signed, static_cast<int64_t>( value ) );
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+	append( LogRecord& record, const T value )
+	{
+		append_value( record, LogRecord::Type::Unsigned, static_cast<uint64_t>( value ) );
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+	append( LogRecord& record, const T value )
+	{
+		append_value( record, LogRecord::Type::Real, static_cast<double>( value ) );
+	}
+
+	/// Any other streamable type is formatted on the calling thread, which allocates.
+	template<typename T>
+	static typename std::enable_if<!std::is_arithmetic<T>::value>::type
+	append( LogRecord& record, const T& value )
+	{
+		std::ostringstream stream;
+		stream << value;
+		append( record, stream.str() );
+	}
+
+	static void append( LogRecord& record, const bool value )
+	{
+		append_value( record, LogRecord::Type::Boolean, value );
+	}
+
+	static void append( LogRecord& record, const char value )
+	{
+		append_value( record, LogRecord::Type::Character, value );
+	}
+
+	static void append( LogRecord& record, const char* text )
+	{
+		append_text( record, text, std::strlen( text ) );
+	}
+
+	static void append( LogRecord& record, const std::string& text )
+	{
+		append_text( record, text.data(), text.size() );
+	}
+
+	template<typename T>
+	static void append_value( LogRecord& record, const LogRecord::Type type, const T value )
+	{
+		if( record.size + 1 + sizeof( value ) > LOG_PAYLOAD_SIZE )
+		{
+			record.truncated = true;
+			return;
+		}
+
+		record.payload[record.size] = static_cast<uint8_t>( type );
+		std::memcpy( record.payload + record.size + 1, &value, sizeof( value ) );
+		record.size = static_cast<uint16_t>( record.size + 1 + sizeof( value ) );
+	}
+
+	static void append_text( LogRecord& record, const char* text, const size_t length );
+
+	/// Hands a record to the current instance, or writes it if there is none.
+	static void submit( const LogRecord& record );
+
+	/// Formats a record and writes it to its sink.
+	static void write( const LogRecord& record );
+
+	/// Ring of the calling thread, created on its first call, null if it could not be allocated.
+	Producer* get_producer();
+
+	void process();
+
+	/// Writes every queued record, returns false if there was none.
+	bool drain();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const LogParams params_;
+	const ThreadRoleParams placement_;
+
+	/// Distinguishes the instances in the cache of the logging threads.
+	const uint64_t generation_;
+	AsyncLog* const previous_;
+
+	mutable std::mutex mutex_;
+	std::vector<std::unique_ptr<Producer, ProducerDeleter>> producers_;
+
+	/// Copy of producers_ used by the log thread, so that it only holds the mutex to refresh it.
+	std::vector<Producer*> draining_;
+
+	std::atomic<bool> running_;
+	std::thread thread_;
+
+	static std::atomic<AsyncLog*> current_;
+	static std::atomic<uint64_t> generations_;
+
+	static thread_local uint64_t cachedGeneration_;
+	static thread_local Producer* cachedProducer_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // ASYNCLOG_HPP
@@ -0,0 +1,165 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef BATCHREPROCESSOR_HPP
+#define BATCHREPROCESSOR_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+#include "SessionReplay.hpp"
+#include "StaticPipeline.hpp"
+#include "StereoRectifier.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+class WorkerPool;
+struct BatchPipeline;
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Files of the output folder of a reprocessed session.
+const char* const BATCH_EXPOSURE_FILE{ "exposure.csv" };
+const char* const BATCH_PROGRESS_FILE{ "progress" };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Reprocesses recorded sessions offline: demosaicing, rectification, exposure statistics and
+/// class map of every pair, through a StaticPipeline whose demosaicing and exposure statistics
+/// share a single sweep over the raw images.
+///
+/// The frames of all sessions are submitted as independent tasks to a work-stealing WorkerPool,
+/// a bounded number at a time, and the next session starts while the last frames of the previous
+/// one complete. Results are committed in frame order through a reorder buffer per session, and
+/// the number of committed frames is saved next to them, so that an interrupted run resumes after
+/// the last committed frame.
+class BatchReprocessor
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Session
+	{
+		Session( const std::string& folderPath, const uint32_t periodInUs )
+			: replay{ folderPath, periodInUs }
+			, outputPath{ }
+			, rectifier{ }
+			, rectified{ false }
+			, first{ }
+			, next{ }
+			, processed{ }
+			, failed{ }
+			, waiting{ }
+			, csv{ }
+			, mutex{ }
+			, start{ }
+			, end{ }
+		{ }
+
+		SessionReplay replay;
+		std::string outputPath;
+		StereoRectifier rectifier;
+		bool rectified;
+
+		/// First frame of this run, frames before it were committed by a previous run.
+		size_t first;
+
+		/// Next frame to commit, the rows of the frames after it wait in 'waiting'.
+		size_t next;
+		size_t processed;
+		size_t failed;
+		std::map<size_t, std::string> waiting;
+		std::ofstream csv;
+		std::mutex mutex;
+
+		Clock::time_point start;
+		Clock::time_point end;
+	};
+
+	/// Buffers of one worker, reused by every frame it processes.
+	struct Context
+	{
+		PipelineFrame frame;
+		std::unique_ptr<BatchPipeline> pipeline;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	BatchReprocessor( const BatchParams& params, const ClassMapParams& classMap,
+	                  WorkerPool& pool );
+
+	~BatchReprocessor();
+
+	/// Reprocesses the sessions until all are done or 'stopped' returns true, then waits for the
+	/// frames in flight. Returns false if a session could not be opened.
+	bool run( const std::function<bool()>& stopped );
+
+	/// Frames processed, skipped and failed per session, and the aggregate throughput.
+	void print_report() const;
+
+private:
+	/// Lists the frames of a session, loads its calibration and prepares its output folder.
+	bool open_session( Session& session );
+
+	/// Number of frames committed by a previous run, the exposure file is cut to match.
+	size_t resume_session( Session& session ) const;
+
+	void process( Session& session, const size_t position );
+
+	/// Queues the row of a frame and writes every row that is now in order.
+	void commit( Session& session, const size_t position, const bool success,
+	             const std::string& row );
+
+	/// Atomically replaces the progress file of a session.
+	void write_progress( Session& session ) const;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const BatchParams params_;
+	const ClassMapParams classMapParams_;
+
+	WorkerPool& pool_;
+
+	std::vector<std::unique_ptr<Session>> sessions_;
+	std::vector<std::unique_ptr<Context>> contexts_;
+
+	/// Frames submitted and not committed yet, bounded to keep the reorder buffers small.
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	size_t inFlight_;
+
+	Clock::duration elapsed_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // BATCHREPROCESSOR_HPP
@@ -0,0 +1,123 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef BENCHMARKSUITE_HPP
+#define BENCHMARKSUITE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Benchmarks run with the -b switch, on the replayed session of the configuration or on
+/// synthetic frames when none is set.
+class BenchmarkSuite
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	BenchmarkSuite( const CaptureConfig& config );
+
+	~BenchmarkSuite();
+
+	/// Runs the benchmarks listed in the configuration, returns false if one is unknown or failed.
+	bool run();
+
+private:
+	/// Loads the benchmark frames in memory so that disk accesses do not disturb the timings.
+	bool load_frames();
+
+	/// Frame-time jitter of the stage chain of the capture on the replayed pairs, unpinned then
+	/// placed as the 'processing' role.
+	bool run_jitter();
+
+	void measure_jitter( const bool placed );
+
+	/// Total throughput of free-running simulated rigs, one per cpu, sharing a pool of 1, 2, 4...
+	/// workers up to one per cpu.
+	bool run_rigs();
+
+	/// Sustained unpaced writes of every storage backend, MB/s per second and store latencies.
+	bool run_storage();
+
+	bool measure_storage( const std::string& backend );
+
+	/// Cost of the tone map of a demosaiced pair, on the calling thread alone then on pools of 1,
+	/// 2, 4... workers up to one per cpu.
+	bool run_tonemap();
+
+	/// Cost of the disparity of a raw pair, grey conversion and rectification included, on pools
+	/// of 1, 2, 4... workers up to one per cpu, compared with the frame period.
+	bool run_disparity();
+
+	/// Greedy recursive Kittler thresholds of ClassExtraction against the optimal thresholds of
+	/// MultiLevelThreshold on the left grey images, time per image and Kittler criterion reached
+	/// with as many classes.
+	bool run_thresholding();
+
+	/// Cost of the class map of a demosaiced left image, global or tiled as configured, on pools of
+	/// 1, 2, 4... workers up to one per cpu, compared with the frame period.
+	bool run_classmap();
+
+	/// Handoff of frame handles between two threads through a FrameRing and through a locked deque
+	/// as in the cm::BitmapCache, wake-up latency of a blocked consumer and unpaced throughput.
+	bool run_handoff();
+
+	/// Cost per pair of the demosaicing and exposure statistics through a chain of virtual stages
+	/// as in the co graph, through a StaticPipeline, then fused into a single sweep.
+	bool run_pipeline();
+
+	/// Localhost check of the live stream: processing thread cost of the submissions, pairs
+	/// received by a fast and by a slow client, and pairs the slow one skipped.
+	bool run_stream();
+
+	/// Cost on the calling thread of bursts of log lines, written synchronously then queued to the
+	/// log thread of an AsyncLog, and lines lost to a full queue.
+	bool run_logging();
+
+	/// Bit-packing of 10 and 12 bits raw images scaled from the benchmark frames: packed size, pack
+	/// and unpack times against a full width copy, and demosaicing from the 8 bits view of the
+	/// packed rows against unpacking first.
+	bool run_packing();
+
+	/// Region of interest of the roi section, cropped then cropped and binned: windowing time and
+	/// demosaicing time of the windowed pairs against the whole frames.
+	bool run_roi();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const CaptureConfig& config_;
+
+	std::vector<StereoFrame> frames_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // BENCHMARKSUITE_HPP
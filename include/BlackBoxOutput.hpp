@@ -0,0 +1,170 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef BLACKBOXOUTPUT_HPP
+#define BLACKBOXOUTPUT_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "EventTrigger.hpp"
+#include "FrameStore.hpp"
+#include "StereoFrame.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Pre-trigger recording: the last pairs are kept in a bounded ring in memory and nothing is
+/// written until an EventTrigger fires.
+///
+/// On a trigger the pairs of the pre-trigger window are moved from the ring to the write queue,
+/// followed by every pair of the post-trigger window. A writer thread stores each event in its own
+/// 'event_<n>' sub-folder of the session with the configured storage backend. The ring slots are
+/// allocated once, at the first pair, and reused afterwards. The writer hands the buffers of the
+/// written pairs back, they replace the ring slots moved to the queue and hold the next pairs of
+/// the event.
+class BlackBoxOutput
+	: public co::ProcessUnit
+	, public StereoSink
+{
+	struct Slot
+	{
+		uint64_t index;
+		uint64_t timestamp;
+
+		/// Copies of the images, or their png encoding when compression is enabled. 16 bits images
+		/// are kept bit-packed when the storage packs them, one packed row per matrix row.
+		cv::Mat left;
+		cv::Mat right;
+		std::vector<uint8_t> encodedLeft;
+		std::vector<uint8_t> encodedRight;
+
+		/// Depth and width of the packed images, 0 if the images are not packed.
+		uint32_t packedBits;
+		int32_t width;
+	};
+
+	struct Pending
+	{
+		uint32_t event;
+		Slot slot;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	BlackBoxOutput( const BlackBoxParams& params, const StorageParams& storage,
+	                const ThreadRoleParams& placement, const std::string& folderPath,
+	                const uint32_t periodInUs );
+
+	~BlackBoxOutput();
+
+	/// Starts watching the triggers and the writer thread.
+	void start();
+
+	/// Closes the current event and waits until every queued pair is written.
+	void stop();
+
+	/// Adds a pair to the ring, or to the write queue during an event.
+	bool record( const StereoFrame& frame );
+
+	/// Records a pair handed over by a RoiStage or a gate.
+	virtual bool submit( const StereoFrame& frame ) final;
+
+	/// Events, written pairs and pairs dropped because the write queue was full.
+	void print_report() const;
+
+	/// Pairs waiting in the write queue, and the number at which new pairs are dropped.
+	size_t get_queue_depth( size_t& limit ) const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+private:
+	/// Sizes the ring from the window, the period and the memory bound, for pairs like 'frame'.
+	void allocate( const StereoFrame& frame );
+
+	void copy_to( const StereoFrame& frame, Slot& slot ) const;
+
+	/// Moves the pairs of the pre-trigger window to the write queue.
+	void open_event( const uint64_t timestamp );
+
+	void enqueue( Slot&& slot );
+
+	/// Returns a slot whose buffers were handed back by the writer, or an empty one.
+	Slot take_spare();
+
+	bool restore( const Slot& slot, StereoFrame& frame ) const;
+
+	void write_loop();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const BlackBoxParams params_;
+	const StorageParams storage_;
+	const ThreadRoleParams placement_;
+	const std::string folderPath_;
+	const uint64_t periodInUs_;
+	const bool compressed_;
+
+	EventTrigger trigger_;
+
+	/// Ring of the last pairs, 'next_' is the slot the next pair is written to.
+	std::vector<Slot> ring_;
+	size_t next_;
+	size_t count_;
+
+	bool inEvent_;
+	uint64_t eventEnd_;
+	uint32_t events_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable condition_;
+	std::deque<Pending> queue_;
+	std::vector<Slot> spares_;
+	size_t queueLimit_;
+	bool running_;
+	std::thread thread_;
+
+	uint64_t written_;
+	uint64_t dropped_;
+	uint64_t failed_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // BLACKBOXOUTPUT_HPP
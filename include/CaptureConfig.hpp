@@ -0,0 +1,553 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef CAPTURECONFIG_HPP
+#define CAPTURECONFIG_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Deadlines applied once a SIGINT/SIGTERM has been received.
+struct ShutdownParams
+{
+	/// Time allowed to push the frames still queued in the cache through the pipeline.
+	uint32_t drainDeadlineInMs{ 2000 };
+
+	/// Time after which the process exits whatever the state of the pipeline.
+	uint32_t hardDeadlineInMs{ 5000 };
+};
+
+/// Frame-drop and timing-jitter monitoring of the camera stream.
+struct TelemetryParams
+{
+	bool enabled{ true };
+
+	/// Number of frames the rolling statistics are computed over.
+	uint32_t window{ 256 };
+
+	/// Period of the exports to the session csv file.
+	uint32_t exportPeriodInMs{ 1000 };
+
+	/// Also prints every export on the standard output.
+	bool print{ false };
+};
+
+/// Logging of the capture path, formatted and written by a thread of its own.
+struct LogParams
+{
+	/// Queues the AsyncLog calls to the log thread, otherwise they write synchronously.
+	bool async{ true };
+
+	/// Records queued per logging thread, the calls of a thread whose queue is full are dropped.
+	uint32_t queueRecords{ 1024 };
+
+	/// Sleep of the log thread when every queue is empty.
+	uint32_t pollPeriodInMs{ 5 };
+};
+
+/// Placement of one pipeline thread role.
+struct ThreadRoleParams
+{
+	/// CPUs the thread may run on, empty to keep the inherited affinity.
+	std::vector<uint32_t> cpus;
+
+	/// SCHED_FIFO priority, 0 keeps the default time-sharing policy.
+	int32_t priority{ };
+};
+
+/// Placement of the pipeline threads, every object of the 'threads' section names a role such as
+/// 'capture', 'processing', 'writer' or 'pool' for the threads of a WorkerPool.
+struct ThreadParams
+{
+	/// Locks current and future pages in RAM with mlockall.
+	bool lockMemory{ false };
+
+	/// Threads of the pool shared by the parallel stages of the capture, 0 for one per cpu.
+	uint32_t workers{ };
+
+	std::map<std::string, ThreadRoleParams> roles;
+
+	/// Returns the placement of a role, an unplaced default if it is not configured.
+	const ThreadRoleParams& role( const std::string& name ) const
+	{
+		static const ThreadRoleParams unplaced{ };
+		auto iter = roles.find( name );
+		return iter != roles.end() ? iter->second : unplaced;
+	}
+};
+
+/// Region of the sensor frames kept by the pipeline, and optional 2x2 binning of the same colour
+/// pixels, both applied at its head so that the following stages handle fewer pixels.
+struct RoiParams
+{
+	bool enabled{ false };
+
+	/// Top left corner, rounded down to even coordinates to keep the Bayer pattern.
+	uint32_t x{ 0 };
+	uint32_t y{ 0 };
+
+	/// Size of the region, 0 extends it to the edge of the frame.
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+
+	/// Averages every 2x2 block of same colour pixels, halving both dimensions of the raw pairs.
+	bool binning{ false };
+};
+
+/// Decimated live view of the demosaiced stereo pair, produced outside of the processing thread.
+struct PreviewParams
+{
+	bool enabled{ false };
+
+	/// Decimation factor of each dimension, 4 gives a 1/4 resolution preview.
+	uint32_t decimation{ 4 };
+
+	/// Minimum time between two previews.
+	uint32_t periodInMs{ 200 };
+
+	/// Shows the preview in a window.
+	bool display{ false };
+
+	/// Jpeg file of the session folder atomically replaced by every preview, empty to disable.
+	std::string file{ "preview.jpg" };
+
+	uint32_t jpegQuality{ 80 };
+
+	/// Period of the cpu cost report on the standard output, 0 to disable.
+	uint32_t reportPeriodInMs{ 10000 };
+};
+
+/// Live MJPEG over HTTP stream of the demosaiced stereo pair, encoded and served outside of the
+/// processing thread.
+struct StreamParams
+{
+	bool enabled{ false };
+
+	/// Address and TCP port listened to, port 0 lets the system choose one.
+	std::string address{ "0.0.0.0" };
+	uint32_t port{ 8090 };
+
+	/// "side_by_side" sends a single image per pair, "separate" the left then the right image.
+	std::string layout{ "side_by_side" };
+
+	/// Decimation factor of each dimension.
+	uint32_t decimation{ 2 };
+
+	/// Minimum time between two streamed pairs.
+	uint32_t periodInMs{ 100 };
+
+	uint32_t jpegQuality{ 70 };
+
+	/// Clients served at once, further connections are closed.
+	uint32_t maxClients{ 8 };
+
+	/// Kernel send buffer of every client, small enough that a slow client skips pairs rather than
+	/// receiving stale ones.
+	uint32_t sendBufferInKb{ 256 };
+
+	/// Period of the report on the standard output, 0 to disable.
+	uint32_t reportPeriodInMs{ 10000 };
+};
+
+/// Contrast-limited global tone mapping of the demosaiced HDR pairs, for stable contrast under
+/// harsh sunlight.
+struct ToneMapParams
+{
+	bool enabled{ false };
+
+	/// Largest histogram bin, in multiples of the mean bin, limits the contrast gain.
+	double clipLimit{ 2.5 };
+
+	/// Mix of the equalized curve with the identity, 0 leaves the pairs unchanged.
+	double strength{ 0.8 };
+
+	/// Weight of the previous curve in the temporal smoothing, avoids flicker between pairs.
+	double smoothing{ 0.9 };
+
+	/// Row and column step of the histogram sampling.
+	uint32_t sampleStep{ 2 };
+
+	/// Row bands of every image processed in parallel.
+	uint32_t bands{ 8 };
+
+	/// Prints the benchmark of every pair.
+	bool printBenchmark{ false };
+};
+
+/// Dense disparity of the rectified pairs, census cost aggregated over square windows.
+struct DisparityParams
+{
+	bool enabled{ false };
+
+	/// OpenCV yml file holding M1, D1, M2, D2, R and T, copied to every session folder as
+	/// stereo_calib.yml. The pairs are considered already rectified if it can not be read.
+	std::string calibration{ "resources/stereo_calib.yml" };
+
+	uint32_t minDisparity{ };
+
+	/// Size of the disparity range.
+	uint32_t numDisparities{ 64 };
+
+	/// Side of the aggregation window, odd and at most 35.
+	uint32_t windowSize{ 7 };
+
+	/// Margin in percent by which the best cost must beat every other disparity.
+	uint32_t uniquenessRatio{ 10 };
+
+	/// Largest difference between the left and right disparities, -1 disables the check.
+	int32_t lrTolerance{ 1 };
+
+	/// Row bands of the pair matched in parallel.
+	uint32_t bands{ 16 };
+
+	/// Writes every disparity map as a 16 bits tiff next to the pair, in 1/16 pixel.
+	bool write{ true };
+
+	/// Prints the benchmark of every pair.
+	bool printBenchmark{ false };
+};
+
+/// Joint class map of the demosaiced left images, from the thresholds of every channel of a colour
+/// space, e.g. to separate crop, soil and sky.
+struct ClassMapParams
+{
+	bool enabled{ false };
+
+	/// 'hsv', 'lab' or 'exg' for the normalized excess green 2g - r - b alone.
+	std::string colourSpace{ "hsv" };
+
+	/// Classes of every channel, from the optimal thresholding of MultiLevelThreshold, at most 6.
+	/// 0 keeps the greedy recursive Kittler split of ClassExtraction, about ten times slower.
+	uint32_t classes{ 3 };
+
+	/// 'kittler' or 'otsu', criterion of the optimal thresholding.
+	std::string criterion{ "kittler" };
+
+	/// Row and column step of the histogram sampling.
+	uint32_t sampleStep{ 2 };
+
+	/// Tiles of the adaptive thresholding in each dimension, every tile gets its own thresholds
+	/// interpolated between the tile centres. 0 thresholds the whole image at once.
+	uint32_t tileColumns{ };
+	uint32_t tileRows{ };
+
+	/// Row bands of the image processed in parallel.
+	uint32_t bands{ 8 };
+
+	/// Writes every class map as a png next to the pair.
+	bool write{ false };
+
+	/// Prints the benchmark of every pair.
+	bool printBenchmark{ false };
+};
+
+/// Share of the load governor of one pipeline stage, e.g. 'recording', 'exposure', 'class_map',
+/// 'disparity', 'preview' or 'stream'. The tone map is not governed, its consumers are.
+struct GovernedStageParams
+{
+	/// Stages are shed by increasing priority, the lowest first.
+	int32_t priority{ };
+
+	/// Mean cost per pair above which the stage is decimated whatever the load, 0 for none.
+	uint32_t budgetInUs{ };
+
+	/// Stages that are not sheddable always run, unknown stages are not.
+	bool sheddable{ false };
+
+	/// A shed stage runs every 2, 4... pairs up to this decimation, 0 skips it at once.
+	uint32_t maxDecimation{ };
+};
+
+/// Load shedding of the single-rig capture when the pipeline, or the writer of the black box,
+/// falls behind the camera.
+struct GovernorParams
+{
+	bool enabled{ false };
+
+	/// Processing time available per pair, 0 for the camera period.
+	uint32_t budgetInUs{ };
+
+	/// Smoothed pair cost, in ratio of the budget, above which a stage is shed, and below which
+	/// the last shed stage is restored.
+	double highRatio{ 0.9 };
+	double lowRatio{ 0.6 };
+
+	/// Weight of the previous cost in the smoothing of the measured costs.
+	double smoothing{ 0.9 };
+
+	/// Pairs between two shedding steps, a stage is only restored after four times as many pairs
+	/// without overload.
+	uint32_t holdFrames{ 8 };
+
+	/// Prints every change of the shedding level.
+	bool print{ false };
+
+	std::map<std::string, GovernedStageParams> stages;
+
+	/// Returns the settings of a stage, never shed if it is not configured.
+	const GovernedStageParams& stage( const std::string& name ) const
+	{
+		static const GovernedStageParams unshed{ };
+		auto iter = stages.find( name );
+		return iter != stages.end() ? iter->second : unshed;
+	}
+};
+
+/// Change-detection gating of the recording, idle scenes are only stored every maxIntervalInMs.
+struct GateParams
+{
+	bool enabled{ false };
+
+	/// Number of blocks of the frame signature in each dimension.
+	uint32_t gridWidth{ 32 };
+	uint32_t gridHeight{ 20 };
+
+	/// Pixel sampling step inside a block, kept even so that a raw frame is sampled on a single
+	/// Bayer colour.
+	uint32_t step{ 4 };
+
+	/// Mean absolute difference of the block averages above which the scene has changed.
+	double meanThreshold{ 3.0 };
+
+	/// Absolute difference of a single block above which the scene has changed locally.
+	double blockThreshold{ 24.0 };
+
+	/// Longest time without a stored frame.
+	uint32_t maxIntervalInMs{ 5000 };
+};
+
+/// Pre-trigger recording: the last pairs are only kept in memory, and written around events.
+struct BlackBoxParams
+{
+	bool enabled{ false };
+
+	/// Time kept in memory before a trigger.
+	uint32_t preTriggerInMs{ 5000 };
+
+	/// Time recorded after a trigger, a trigger received meanwhile extends it.
+	uint32_t postTriggerInMs{ 5000 };
+
+	/// Upper bound of the ring memory, the pre-trigger window is shortened to fit.
+	uint32_t maxMemoryInMb{ 512 };
+
+	/// 'raw' copies the pairs, 'png' compresses them losslessly on the processing thread.
+	std::string compression{ "raw" };
+
+	/// File whose creation triggers an event, removed once seen, empty to disable. A relative path
+	/// is taken from the session folder.
+	std::string triggerFile{ "trigger" };
+
+	/// Unix datagram socket on which any message triggers an event, empty to disable.
+	std::string socketPath{ "/tmp/camCapture.sock" };
+};
+
+/// Backend writing the recorded pairs.
+struct StorageParams
+{
+	/// 'tiff' for one tiff file per image, 'direct' for a container file written with O_DIRECT,
+	/// 'uring' for the same container written through io_uring, in builds WITH_IO_URING only.
+	std::string backend{ "tiff" };
+
+	/// Writes in flight for the container backends, twice as many aligned buffers are allocated.
+	uint32_t queueDepth{ 4 };
+
+	/// Size of every fallocate extension of the container file.
+	uint32_t preallocateInMb{ 1024 };
+
+	/// Significant bits of 16 bits raw pixels, 10 or 12 packs them densely in the container and in
+	/// the black box ring, any other value keeps them at full width. The camera delivers 8 bits
+	/// pairs, a warning tells at the first pair when nothing gets packed.
+	uint32_t packedBits{ 0 };
+};
+
+/// One stereo bench of a multi-rig capture.
+struct RigParams
+{
+	/// Name of the rig, also the name of its sub-folder in the session folder.
+	std::string name;
+
+	/// 'bluefox' for a camera pair, 'replay' for a recorded session, 'synthetic' for generated
+	/// frames.
+	std::string source{ "synthetic" };
+
+	/// Device opened by a 'bluefox' rig, empty for the first bench found.
+	std::string device;
+
+	/// Session played back by a 'replay' rig.
+	std::string session;
+
+	/// Frame period of a simulated rig, 0 produces frames as fast as they are consumed.
+	uint32_t periodInUs{ 45000 };
+
+	/// Grey level the exposure loop of a simulated rig converges to.
+	double targetGrey{ 70.0 };
+
+	/// Stores the pairs in the rig sub-folder.
+	bool record{ true };
+};
+
+/// Several stereo benches captured by one process with the -m switch.
+struct MultiRigParams
+{
+	/// Threads of the pool shared by every rig, 0 for one per cpu.
+	uint32_t workers{ };
+
+	std::vector<RigParams> rigs;
+};
+
+/// Stereo calibration of the bench with the -c switch, from views of a planar pattern.
+struct CalibrationParams
+{
+	/// Recorded session the pairs are taken from, the BlueFox bench is captured live if empty.
+	std::string session;
+
+	/// 'chessboard', 'circles' or 'asymmetric_circles'.
+	std::string pattern{ "chessboard" };
+
+	/// Inner corners of the chessboard, or circles of the grid, per row and per column.
+	uint32_t columns{ 9 };
+	uint32_t rows{ 6 };
+
+	/// Distance between two neighbouring corners or circles, the unit of the translation T.
+	double squareSize{ 0.025 };
+
+	/// Live capture: pairs collected, and minimum time between two of them so that the pattern
+	/// is seen from different poses.
+	uint32_t frames{ 60 };
+	uint32_t periodInMs{ 500 };
+
+	/// Session: only every 'step' pair is examined.
+	uint32_t step{ 1 };
+
+	/// Pairs with the pattern found in both views used by the solver at most, evenly spread over
+	/// the detections. The solver cost grows with the views long after the accuracy stops
+	/// improving.
+	uint32_t maxViews{ 40 };
+
+	/// Threads detecting the pattern, 0 for one per cpu.
+	uint32_t workers{ };
+
+	/// Calibration file written, as read by the disparity stage and the batch rectification.
+	std::string output{ "resources/stereo_calib.yml" };
+};
+
+/// Offline reprocessing of recorded sessions with the -r switch.
+struct BatchParams
+{
+	/// Session folders to reprocess, in order.
+	std::vector<std::string> sessions;
+
+	/// Sub-folder of every session receiving the results.
+	std::string output{ "reprocessed" };
+
+	/// Threads of the pool the frames of all sessions are distributed to, 0 for one per cpu.
+	uint32_t workers{ };
+
+	/// Frame period used to synthesize the timestamps of sessions recorded without manifest.
+	uint32_t periodInUs{ 45000 };
+
+	/// Rectifies the pairs with the stereo_calib.yml of the session, when it has one.
+	bool rectify{ true };
+
+	/// Writes the exposure statistics of every pair to exposure.csv, empty for the failed pairs.
+	bool exposure{ true };
+
+	/// Computes the class map of every left image with the settings of the class_map section.
+	bool classMap{ false };
+
+	/// Writes the demosaiced, possibly rectified, pairs and the class maps as png files.
+	bool writeImages{ false };
+
+	/// Skips the frames already committed by an interrupted run of a session.
+	bool resume{ true };
+};
+
+/// Benchmarks run with the -b switch.
+struct BenchmarkParams
+{
+	/// Names of the benchmarks to run, in order.
+	std::vector<std::string> run;
+
+	/// Recorded session replayed by the benchmarks, synthetic frames are used if empty.
+	std::string session;
+
+	/// Number of frames processed by every pass of a benchmark.
+	uint32_t frames{ 200 };
+
+	/// Frame period the replay is paced at.
+	uint32_t periodInUs{ 45000 };
+
+	/// Folder receiving the files of the storage benchmark, removed after every pass.
+	std::string storageFolder{ "." };
+
+	/// Duration of every pass of the storage benchmark.
+	uint32_t storageSeconds{ 60 };
+};
+
+/// Program settings read from resources/config.json, every missing key keeps its default value.
+class CaptureConfig
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	CaptureConfig();
+
+	~CaptureConfig();
+
+	/// Loads the settings from a json file, returns false if the file can not be parsed.
+	bool load( const std::string& filepath );
+
+//--Data members------------------------------------------------------------------------------------
+public:
+	ShutdownParams shutdown;
+	TelemetryParams telemetry;
+	LogParams logging;
+	ThreadParams threads;
+	RoiParams roi;
+	PreviewParams preview;
+	StreamParams stream;
+	ToneMapParams toneMap;
+	DisparityParams disparity;
+	ClassMapParams classMap;
+	GovernorParams governor;
+	GateParams gate;
+	BlackBoxParams blackBox;
+	StorageParams storage;
+	MultiRigParams multiRig;
+	CalibrationParams calibration;
+	BatchParams batch;
+	BenchmarkParams benchmark;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // CAPTURECONFIG_HPP
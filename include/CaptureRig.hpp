@@ -0,0 +1,220 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef CAPTURERIG_HPP
+#define CAPTURERIG_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+#include "Importer/IMImporter.hpp"
+
+#include "BaseFilters/BFDemosaicingFilter.hpp"
+#include "BaseFilters/BFExposureFilter.hpp"
+
+#include "CaptureConfig.hpp"
+#include "FileOutput.hpp"
+#include "FrameStore.hpp"
+#include "GracefulShutdown.hpp"
+#include "SessionReplay.hpp"
+#include "StaticPipeline.hpp"
+#include "StereoFrame.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+class WorkerPool;
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// One stereo bench of a multi-rig capture, with its own acquisition, session sub-folder and
+/// exposure loop.
+///
+/// The RigScheduler never runs process() of a rig on two workers at once, so the pipeline of a rig
+/// sees its pairs in order and its exposure feedback only depends on its own frames.
+class CaptureRig
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	CaptureRig( const RigParams& params, const std::string& folderPath );
+
+	virtual ~CaptureRig();
+
+	const RigParams& get_params() const;
+
+	const std::string& get_folder_path() const;
+
+	/// Frames handled by process(), only consistent once the scheduler is idle.
+	const CaptureCounters& get_counters() const;
+
+	virtual bool start() = 0;
+
+	/// Stops the acquisition, the pairs already acquired can still be taken by acquire().
+	virtual void stop() = 0;
+
+	/// Releases the acquisition once the pairs left after stop() have been drained.
+	virtual void close() = 0;
+
+	/// Takes the newest pair acquired since the last call without waiting, returns false if none
+	/// is ready. Called by the scheduler thread only.
+	virtual bool acquire() = 0;
+
+	/// Pushes the pair taken by acquire() through the rig pipeline and feeds its exposure loop.
+	virtual bool process() = 0;
+
+	/// Makes the stored pairs durable, called once the rig is stopped.
+	virtual bool flush() = 0;
+
+	/// Records a pair taken by acquire() and left unprocessed when the drain deadline expired.
+	void count_discarded();
+
+protected:
+	void count_frame( const uint64_t index, const bool success );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const RigParams params_;
+	const std::string folderPath_;
+
+	CaptureCounters counters_;
+};
+
+/// Rig acquired by a BlueFox stereo importer, processed by the demosaicing, exposure and file
+/// output units of the single-rig capture.
+class BlueFoxRig
+	: public CaptureRig
+	, private co::ProcessUnit
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	BlueFoxRig( const RigParams& params, const io::BlueFox::Params& blueFoxParams,
+	            const StorageParams& storage, const std::string& folderPath );
+
+	virtual ~BlueFoxRig();
+
+	virtual bool start() final;
+
+	virtual void stop() final;
+
+	virtual void close() final;
+
+	virtual bool acquire() final;
+
+	virtual bool process() final;
+
+	virtual bool flush() final;
+
+private:
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& result ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& om ) final;
+
+	virtual bool query_output_format( co::OutputFormat& of ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	im::BlueFoxStereoImporterUPtr importer_;
+	cm::BitmapCache bitmapCache_;
+	co::OutputMetrics om_;
+
+	FileOutput output_;
+	bf::DemosaicingFilter demosaicingFilter_;
+	bf::ExposureFilter exposureFilter_;
+
+	/// Pair taken by acquire(), released by process().
+	cm::BitmapPairEntrySPtr entry_;
+};
+
+/// Rig fed by a replayed session or by synthetic frames at the camera period, to exercise the
+/// multi-rig scheduling without cameras.
+///
+/// Like a camera, the rig only delivers the newest frame, periods missed by a late consumer are
+/// lost. Every pair goes through the demosaicing of the capture chain and the exposure loop, in
+/// row bands run on the shared WorkerPool as the parallel stages do, then to the frame store. A
+/// synthetic rig closes its exposure loop on the brightness of the frames it generates.
+class SimulatedRig
+	: public CaptureRig
+{
+	using Clock = std::chrono::steady_clock;
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	SimulatedRig( const RigParams& params, const StorageParams& storage, WorkerPool& pool,
+	              const std::string& folderPath );
+
+	virtual ~SimulatedRig();
+
+	virtual bool start() final;
+
+	virtual void stop() final;
+
+	virtual void close() final;
+
+	virtual bool acquire() final;
+
+	virtual bool process() final;
+
+	virtual bool flush() final;
+
+private:
+	/// Demosaics the rows of a band of the pair and sums the grey levels of its left image.
+	void process_band( const size_t band );
+
+	/// Updates the gain from the mean grey level of the demosaiced left image.
+	void update_exposure();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const StorageParams storage_;
+	WorkerPool& pool_;
+
+	SessionReplay replay_;
+	std::unique_ptr<FrameStore> store_;
+
+	Clock::time_point startTime_;
+	uint64_t nextIndex_;
+	bool running_;
+
+	/// Index taken by acquire(), produced and processed by process().
+	uint64_t pendingIndex_;
+
+	PipelineFrame frame_;
+
+	/// Demosaicing, grey band and grey level sum of every band.
+	std::vector<DemosaicPass> demosaicPasses_;
+	std::vector<cv::Mat> greys_;
+	std::vector<double> sums_;
+
+	/// Gain applied to the synthetic frames by the exposure loop.
+	double gain_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // CAPTURERIG_HPP
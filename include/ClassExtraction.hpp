@@ -21,9 +21,24 @@
 //==================================================================================================
 // I N C L U D E   F I L E S
 
+#include "AsyncLog.hpp"
+#include "MultiLevelThreshold.hpp"
+
 #include <HTBitmap.hpp>
 #include <CLArray.h>
 #include <CLDynArray.h>
+#include <CLPrint.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <vector>
 
 
 //==================================================================================================
@@ -87,7 +102,8 @@ public:
 
 	uint32_t maximum( const size_t begin, const size_t end ) const
 	{
-		auto it = std::max_element( histogram_.cbegin() + begin, histogram_.cbegin() + end );
+		auto it = std::max_element( histogram_.cbegin() + static_cast<std::ptrdiff_t>( begin ),
+		                            histogram_.cbegin() + static_cast<std::ptrdiff_t>( end ) );
 		return *it;
 	}
 
@@ -137,13 +153,10 @@ private:
 	std::vector<uint32_t> histogram_;
 };
 
-#include <opencv2/core/core.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/highgui/highgui.hpp>
-
 
-void showHistogramWithThresholds( const Histogram& histogram, const std::string& windowName,
-                                  const std::vector<uint32_t>& thresholds )
+inline void showHistogramWithThresholds( const Histogram& histogram,
+                                         const std::string& windowName,
+                                         const std::vector<uint32_t>& thresholds )
 {
 	int32_t bins{ 256 };    // number of bins
 	cv::Mat hist;      // array for storing the histograms
@@ -154,7 +167,7 @@ void showHistogramWithThresholds( const Histogram& histogram, const std::string&
 
 	for( size_t i = 0; i < histogram.size(); ++i )
 	{
-		hist.at<int32_t>( i ) = histogram[i];
+		hist.at<int32_t>( static_cast<int32_t>( i ) ) = static_cast<int32_t>( histogram[i] );
 	}
 
 	for( int32_t j = 0; j < bins - 1; ++j )
@@ -183,7 +196,7 @@ void showHistogramWithThresholds( const Histogram& histogram, const std::string&
 	cv::imshow( windowName, canvas );
 }
 
-void showHistogram( const Histogram& histogram, const std::string& windowName )
+inline void showHistogram( const Histogram& histogram, const std::string& windowName )
 {
 	int32_t bins{ 256 };    // number of bins
 	cv::Mat hist;      // array for storing the histograms
@@ -194,7 +207,7 @@ void showHistogram( const Histogram& histogram, const std::string& windowName )
 
 	for( size_t i = 0; i < histogram.size(); ++i )
 	{
-		hist.at<int32_t>( i ) = histogram[i];
+		hist.at<int32_t>( static_cast<int32_t>( i ) ) = static_cast<int32_t>( histogram[i] );
 	}
 
 	for( int32_t j = 0; j < bins - 1; ++j )
@@ -215,8 +228,8 @@ void showHistogram( const Histogram& histogram, const std::string& windowName )
 	cv::imshow( windowName, canvas );
 }
 
-void showHistogramRange( const std::string& windowName, const Histogram& histogram, size_t begin,
-                         size_t end )
+inline void showHistogramRange( const std::string& windowName, const Histogram& histogram,
+                                size_t begin, size_t end )
 {
 	int32_t bins{ 256 };    // number of bins
 	cv::Mat hist;           // array for storing the histograms
@@ -225,9 +238,9 @@ void showHistogramRange( const std::string& windowName, const Histogram& histogr
 
 	hist = cv::Mat::zeros( 1, bins, CV_32SC1);
 
-	for( size_t i = 0; i < histogram.size(); ++i )
+	for( size_t i = begin; i < std::min( end, histogram.size() ); ++i )
 	{
-		hist.at<int32_t>( i ) = histogram[i];
+		hist.at<int32_t>( static_cast<int32_t>( i ) ) = static_cast<int32_t>( histogram[i] );
 	}
 
 	for( int32_t j = 0; j < bins - 1; ++j )
@@ -253,7 +266,12 @@ class ClassExtraction
 {
 //--Methods-----------------------------------------------------------------------------------------
 public:
-	ClassExtraction()
+	/// 'classes' is the number of classes of the globally optimal thresholding, 0 keeps the greedy
+	/// recursive Kittler split reduced to 5 thresholds.
+	ClassExtraction( const size_t classes = 0,
+	                 const ThresholdCriterion criterion = ThresholdCriterion::Kittler )
+		: classes_{ classes }
+		, optimal_{ criterion }
 	{ }
 
 	~ClassExtraction()
@@ -311,29 +329,30 @@ public:
 
 		size_t NB2{ contourX.size() * 3 };
 		std::vector <int32_t> BBy( NB2, 0 );
+		const int32_t coef{ static_cast<int32_t>( acoef ) };
 
 		for( size_t i = 0; i < contourX.size(); ++i )
 		{
-			BBy[i * 3] = contourX[i];
+			BBy[i * 3] = static_cast<int32_t>( contourX[i] );
 		}
 
 		// Computes control points of the source (edges) excluding end points
-		for( int32_t j = 1; j < contourX.size() - 1; ++j )
+		for( size_t j = 1; j < contourX.size() - 1; ++j )
 		{
-			int32_t i = j * 3;
-			BBy[i - 1] = control_point( BBy[i], BBy[i - 3], BBy[i + 3], acoef );
-			BBy[i + 1] = control_point( BBy[i], BBy[i + 3], BBy[i - 3], acoef );
+			size_t i = j * 3;
+			BBy[i - 1] = control_point( BBy[i], BBy[i - 3], BBy[i + 3], coef );
+			BBy[i + 1] = control_point( BBy[i], BBy[i + 3], BBy[i - 3], coef );
 		}
 
 		// first element i=0
 		if( BBy[0] == BBy[NB2 - 3] ) // Closed curve
 		{
-			BBy[NB2 - 1] = control_point( BBy[0], BBy[NB2 - 3], BBy[3], acoef );
-			BBy[0 + 1] = control_point( BBy[0], BBy[3], BBy[NB2 - 3], acoef );
+			BBy[NB2 - 1] = control_point( BBy[0], BBy[NB2 - 3], BBy[3], coef );
+			BBy[0 + 1] = control_point( BBy[0], BBy[3], BBy[NB2 - 3], coef );
 
 			// last element  NB2-3
-			BBy[NB2 - 4] = control_point( BBy[NB2 - 3], BBy[NB2 - 6], BBy[0], acoef );
-			BBy[NB2 - 2] = control_point( BBy[NB2 - 3], BBy[0], BBy[NB2 - 6], acoef );
+			BBy[NB2 - 4] = control_point( BBy[NB2 - 3], BBy[NB2 - 6], BBy[0], coef );
+			BBy[NB2 - 2] = control_point( BBy[NB2 - 3], BBy[0], BBy[NB2 - 6], coef );
 		}
 		else // unclosed curve
 		{
@@ -342,7 +361,7 @@ public:
 			BBy[NB2 - 2] = BBy[NB2 - 1] = BBy[NB2 - 3];
 		}
 
-		for( int32_t i = 0, j = 0; i < NB2; i += 3, ++j )
+		for( size_t i = 0, j = 0; i < NB2; i += 3, ++j )
 		{
 			double v2 = (BBy[i] + BBy[i + 1] + BBy[i + 2]) / 3.0;
 			contourY[j] = static_cast<uint32_t>(std::round( v2 ));
@@ -355,7 +374,7 @@ public:
 		const uint32_t max = hist.maximum( begin, end );
 
 		// Round the coeficient to get a usable 'unsigned int' value
-		const uint coef = std::round( ratio * max );
+		const uint coef = static_cast<uint>( std::round( ratio * max ) );
 
 		// Get the lower bound and upper bound according to the coeficient
 		// note: we could also use  std::bind2nd( std::greater<int>(), coef )
@@ -363,20 +382,21 @@ public:
 		                           [ & ]( const uint& elem ) -> bool
 		                           { return elem >= coef; } );
 
-		auto upper = std::find_if( hist.crbegin() + (hist.size() - end),
-		                           hist.crbegin() + (hist.size() - begin),
+		const auto upperFirst = static_cast<std::ptrdiff_t>( hist.size() - end );
+		const auto upperLast = static_cast<std::ptrdiff_t>( hist.size() - begin );
+		auto upper = std::find_if( hist.crbegin() + upperFirst, hist.crbegin() + upperLast,
 		                           [ & ]( const uint& elem ) -> bool
 		                           { return elem >= coef; } );
 
 		// Get the number of elements between the boundaries
-		uint count = std::distance( lower, upper.base());
+		uint count = static_cast<uint>( std::distance( lower, upper.base()) );
 		assert( count > 0 and "There should be at least one element within the boundaries" );
 
 		assert( lower - hist.cbegin() >= begin );
 		assert( upper.base() - hist.cbegin() <= end );
 
-		begin = lower - hist.cbegin();
-		end = upper.base() - hist.cbegin();
+		begin = static_cast<uint>( lower - hist.cbegin() );
+		end = static_cast<uint>( upper.base() - hist.cbegin() );
 	}
 
 	/// Histogram normalization
@@ -429,14 +449,13 @@ public:
 	                uint32_t SeuilsSouhaites )
 	{
 		size_t No{ thresholds.size() };
-		uint32_t min{ 255 };
 
 		// Prob. entre Intervals
-		std::vector<uint32_t> prob( 255 );
+		std::vector<uint32_t> prob( hist.size() );
 
-		for( uint32_t i = 0, j = 0; i < min; ++i )
+		for( uint32_t i = 0, j = 0; i < hist.size(); ++i )
 		{
-			if( thresholds[j] < i && j < No )
+			if( j < No && thresholds[j] < i )
 			{
 				++j;
 			}
@@ -505,22 +524,22 @@ public:
 		double sig1{ }, sig2{ }, control{ cl::math::max_limit<double>() };
 
 		// Probability array
-		std::vector<double> prob( 255, 0 );
+		std::vector<double> prob( histogram.size(), 0 );
 
 #ifdef DEBUG_MAZOUT
-		cl::print_line();
-		cl::print_line( "before ", begin, " ", end );
+		AsyncLog::print_line();
+		AsyncLog::print_line( "before ", begin, " ", end );
 #endif
 
 		// Shrink the histogram and keep the interesting values
 		//GetRangeOfInterest( histogram, begin, end, 0.08 );
 
-		//cl::print_line( "after GetRangeOfInterest ", begin, " ", end );
+		//AsyncLog::print_line( "after GetRangeOfInterest ", begin, " ", end );
 
 		// Normalized histogram
 		VectorProba( histogram, prob, begin, end );
 
-		//cl::print_container( prob );
+		//AsyncLog::print_container( prob );
 
 		double muT = Mean( prob, begin, end );
 		double sigT = Momentum( prob, muT, 2, begin, end );
@@ -535,7 +554,7 @@ public:
 		}
 
 #ifdef DEBUG_MAZOUT
-		cl::print_line( "after zeros begin: ", begin, " end: ", end );
+		AsyncLog::print_line( "after zeros begin: ", begin, " end: ", end );
 		#endif
 
 		for( uint32_t i = begin; i < end; ++i )
@@ -553,7 +572,7 @@ public:
 
 				if((sig1 <= 0.0) || (sig2 <= 0.0))
 				{
-					//cl::print_line( " STOP " );
+					//AsyncLog::print_line( " STOP " );
 					continue;
 				}
 
@@ -562,15 +581,16 @@ public:
 				//j = CriteryPal( proba1, proba2, mu1, mu2, muT);
 
 #ifdef DEBUG_MAZOUT
-				cl::print_line( "i: ", i, " -  ", j, " ", proba1, " ", proba2, " ", sig1, " ", sig2 );
+				AsyncLog::print_line( "i: ", i, " -  ", j, " ", proba1, " ", proba2, " ", sig1, " ",
+				                      sig2 );
 #endif
 
 				if( j < control ) // Trouver les valeur minimun
 				{
 #ifdef DEBUG_MAZOUT
-					cl::print_line( " new minimum ", j, " at ", i );
+					AsyncLog::print_line( " new minimum ", j, " at ", i );
 					#endif
-					seuil = i; // On choisis le minimum1
+					seuil = static_cast<int32_t>( i ); // On choisis le minimum1
 					control = j;
 					p1 = proba1;
 					p2 = proba2;
@@ -580,7 +600,7 @@ public:
 			}
 		}
 
-		//cl::print_line( seuil );
+		//AsyncLog::print_line( seuil );
 		//exit(0);
 
 		// Definitions de variances inter/extra-classe
@@ -590,21 +610,21 @@ public:
 		{
 
 #ifdef DEBUG_MAZOUT
-			cl::print_line( muT, " ", sigT );
-			cl::print_line( 1.075 * sig1, " ", 1.075 * sig2 );
+			AsyncLog::print_line( muT, " ", sigT );
+			AsyncLog::print_line( 1.075 * sig1, " ", 1.075 * sig2 );
 #endif
 
 			if((1.075 * sig1 < sigT) && (1.075 * sig2 < sigT))
 			{
 #ifdef DEBUG_MAZOUT
-				cl::print_line( " -- we have a treshold at: ", seuil );
+				AsyncLog::print_line( " -- we have a treshold at: ", seuil );
 				#endif
 				tresholds.push_back( static_cast<uint32_t>(seuil));
 			}
 			else
 			{
 #ifdef DEBUG_MAZOUT
-				cl::print_line( " -- we don't have any treshold" );
+				AsyncLog::print_line( " -- we don't have any treshold" );
 				#endif
 			}
 			if((sigT > 1.5 * sig1) || (sigT > 1.5 * sig2)) // Variance inter_clase
@@ -613,40 +633,76 @@ public:
 				{
 
 #ifdef DEBUG_MAZOUT
-					cl::print_line( "left: ", begin, " ", seuil );
+					AsyncLog::print_line( "left: ", begin, " ", seuil );
 					#endif
-					compute_thresholds( histogram, begin, seuil, tresholds );
+					compute_thresholds( histogram, begin, static_cast<uint32_t>( seuil ),
+					                    tresholds );
 				}
 				else
 				{
 #ifdef DEBUG_MAZOUT
-					cl::print_line( "right: ", seuil, " ", end );
+					AsyncLog::print_line( "right: ", seuil, " ", end );
 					#endif
-					compute_thresholds( histogram, seuil, end, tresholds );
+					compute_thresholds( histogram, static_cast<uint32_t>( seuil ), end, tresholds );
 				}
 			}
 
 		}
 	}
 
-	/// Compute the vector of class separation
-	void thresholding( const cv::Mat& channel, std::vector<uint32_t>& thresholds )
+	/// Computes the 256 bins histogram of a channel and its smoothed version.
+	void smooth_histogram( const cv::Mat& channel, Histogram& histogram, Histogram& smoothed )
 	{
-		Histogram histogram( 255 );
 		histogram.from_channel( channel );
-
-		Histogram smoothed( 255 );
 		BezierContourSmoothing( histogram, smoothed, 50 );
+	}
 
+	/// Greedy recursive Kittler split, reduced to at most 5 sorted thresholds.
+	void greedy_thresholds( const Histogram& smoothed, std::vector<uint32_t>& thresholds )
+	{
 		compute_thresholds( smoothed, 0, 255, thresholds );
 
 		std::sort( thresholds.begin(), thresholds.end());
 
 		// Reduction des minima selon le critere
 		ReduceMin( smoothed, thresholds, 5 );
-		thresholds.resize( 5 );
+		thresholds.resize( std::min<size_t>( thresholds.size(), 5 ) );
+	}
 
-		cl::print_container( thresholds );
+	/// Globally optimal thresholds of the configured number of classes, see MultiLevelThreshold.
+	void optimal_thresholds( const Histogram& smoothed, std::vector<uint32_t>& thresholds )
+	{
+		optimal_.set_histogram( std::vector<uint32_t>( smoothed.cbegin(), smoothed.cend() ) );
+		optimal_.compute( classes_, thresholds );
+	}
+
+	/// Smooths a 256 bins histogram and computes its sorted thresholds with the configured engine,
+	/// without any display.
+	void histogram_thresholds( const Histogram& histogram, std::vector<uint32_t>& thresholds )
+	{
+		Histogram smoothed( histogram.size() );
+		BezierContourSmoothing( histogram, smoothed, 50 );
+
+		thresholds.clear();
+		if( classes_ > 0 )
+		{
+			optimal_thresholds( smoothed, thresholds );
+		}
+		else
+		{
+			greedy_thresholds( smoothed, thresholds );
+		}
+	}
+
+	/// Compute the vector of class separation
+	void thresholding( const cv::Mat& channel, std::vector<uint32_t>& thresholds )
+	{
+		Histogram histogram( 256 );
+		histogram.from_channel( channel );
+
+		histogram_thresholds( histogram, thresholds );
+
+		AsyncLog::print_container( thresholds );
 
 #ifdef DEBUG_MAZOUT
 		exit(0);
@@ -663,6 +719,9 @@ public:
 
 //--Data members------------------------------------------------------------------------------------
 private:
+	const size_t classes_;
+
+	MultiLevelThreshold optimal_;
 };
 
 
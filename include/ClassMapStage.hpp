@@ -0,0 +1,187 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef CLASSMAPSTAGE_HPP
+#define CLASSMAPSTAGE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "ClassExtraction.hpp"
+#include "StereoFrame.hpp"
+
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+class WorkerPool;
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Largest number of classes of a channel, the joint label of a pixel is c0 + 6 * c1 + 36 * c2.
+const uint32_t MAX_CHANNEL_CLASSES{ 6 };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Classifies the pixels of a BGR image from the thresholds of every channel of a colour space.
+///
+/// The image is converted, then the histograms of all its channels are accumulated in a single
+/// pass over the pixels, one set per region. Every channel is thresholded concurrently by its
+/// own ClassExtraction, and the classes of a pixel in every channel are combined into a joint
+/// label.
+///
+/// The regions are row bands, or tiles in the adaptive mode. Every tile then gets as many
+/// thresholds as the whole image from a MultiLevelThreshold of its own histogram, and the
+/// thresholds of a pixel are bilinearly interpolated between the four nearest tile centres, as
+/// the curves of CLAHE. Regions, tile rows and label bands are run on a WorkerPool, every buffer
+/// is allocated at the first image.
+class ChannelClassifier
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ChannelClassifier( const ClassMapParams& params );
+
+	~ChannelClassifier();
+
+	/// Computes the CV_8UC1 joint class map of a BGR image, on the pool if there is one.
+	void process( const cv::Mat& image, cv::Mat& classMap, WorkerPool* pool );
+
+	/// Number of channels of the colour space.
+	size_t get_channels() const;
+
+	/// Sorted thresholds of a channel over the whole last image.
+	const std::vector<uint32_t>& get_thresholds( const size_t channel ) const;
+
+private:
+	void allocate( const cv::Size& size );
+
+	/// Band or tile of a histogram region.
+	cv::Rect get_region( const size_t region ) const;
+
+	/// Converts a region of an image to the colour space.
+	void convert( const cv::Mat& image, const cv::Rect& region );
+
+	/// Adds the sampled pixels of a region to the histograms of every channel, stored one after
+	/// the other.
+	void accumulate( const cv::Rect& region, uint32_t* histograms ) const;
+
+	/// Thresholds of one channel for every tile of a row of tiles.
+	void threshold_tiles( const size_t tileRow, const size_t channel );
+
+	/// Writes the joint labels of rows [firstRow, lastRow).
+	void label( const int32_t firstRow, const int32_t lastRow, cv::Mat& classMap ) const;
+
+	/// Writes the joint labels of rows [firstRow, lastRow) from the interpolated tile thresholds.
+	void label_tiles( const size_t band, const int32_t firstRow, const int32_t lastRow,
+	                  cv::Mat& classMap );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ClassMapParams params_;
+
+	/// cvtColor code of the colour space, -1 for the excess green computed here.
+	const int32_t conversion_;
+	const size_t channels_;
+	const size_t bands_;
+	const size_t tileColumns_;
+	const size_t tileRows_;
+	const size_t regions_;
+
+	cv::Size size_;
+	cv::Mat converted_;
+
+	/// Histograms of every channel for every region, then the merged histograms.
+	std::vector<uint32_t> histograms_;
+	std::vector<ClassExtraction> extractions_;
+	std::vector<std::vector<uint32_t>> thresholds_;
+
+	/// Class of every level of every channel, already multiplied by the weight of the channel.
+	std::vector<uint8_t> labels_;
+
+	/// Engine and result of every row of tiles and channel, thresholds of every tile and channel.
+	std::vector<MultiLevelThreshold> tileEngines_;
+	std::vector<std::vector<uint32_t>> tileResults_;
+	std::vector<float> tileThresholds_;
+
+	/// Left tile and weight of the right tile of every column, tile thresholds interpolated for
+	/// the current row of every band.
+	std::vector<uint16_t> columnTiles_;
+	std::vector<float> columnWeights_;
+	std::vector<float> rowThresholds_;
+};
+
+/// Computes the class map of the left image of the demosaiced pairs and writes it next to the
+/// recorded images.
+///
+/// The stage only reads the pairs it receives, its outputs get them unchanged. Behind a tone map
+/// it receives the mapped pairs as a StereoSink.
+class ClassMapStage
+	: public co::ProcessUnit
+	, public StereoSink
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ClassMapStage( const ClassMapParams& params, WorkerPool& pool, const uint32_t periodInUs,
+	               const std::string& folderPath );
+
+	~ClassMapStage();
+
+	/// Processes a demosaiced pair outside of the co graph.
+	bool process( const StereoFrame& frame );
+
+	/// Processes a pair handed over by a tone map.
+	virtual bool submit( const StereoFrame& frame ) final;
+
+	/// Class map of the last pair.
+	const cv::Mat& get_class_map() const;
+
+	/// Prints the number of pairs classified and their average cost against the frame period.
+	void print_report() const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ClassMapParams params_;
+	WorkerPool& pool_;
+	const double periodInUs_;
+	const std::string folderPath_;
+
+	ChannelClassifier classifier_;
+	cv::Mat classMap_;
+
+	uint64_t frames_;
+	uint64_t failed_;
+	uint64_t late_;
+	double timeInUs_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // CLASSMAPSTAGE_HPP
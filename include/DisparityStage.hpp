@@ -0,0 +1,163 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef DISPARITYSTAGE_HPP
+#define DISPARITYSTAGE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+#include "StereoRectifier.hpp"
+
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+class WorkerPool;
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Fixed-point scale of the disparity maps, a stored value of 16 is one pixel, 0 is invalid.
+const uint32_t DISPARITY_SCALE{ 16 };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Block matching of rectified grey pairs on a 5x5 census transform.
+///
+/// The Hamming costs of every disparity are aggregated over a square window with running column
+/// sums, the best disparity is refined to 1/16 pixel by a parabola fit, then dropped if it
+/// is not unique enough or does not match the disparity of the right view. Rows are split into
+/// bands matched in parallel, each with its own cost volume allocated at the first pair.
+class CensusMatcher
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	CensusMatcher( const DisparityParams& params );
+
+	~CensusMatcher();
+
+	/// Computes the CV_16UC1 disparity map of the left image, on the pool if there is one.
+	void compute( const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, WorkerPool* pool );
+
+	/// Number of disparities searched.
+	size_t get_range() const;
+
+private:
+	/// Working buffers of one band. The cost volume holds one row of costs per window row, every
+	/// row is stored disparity after disparity so that consecutive pixels are contiguous.
+	struct Band
+	{
+		std::vector<uint8_t> costs;
+		std::vector<int16_t> columns;
+		std::vector<int16_t> aggregated;
+		std::vector<int16_t> bestCosts;
+		std::vector<int16_t> bestDisparities;
+		std::vector<int16_t> secondCosts;
+		std::vector<int16_t> rightCosts;
+		std::vector<int16_t> rightDisparities;
+	};
+
+	void allocate( const cv::Size& size );
+
+	/// Census transform of rows [firstRow, lastRow) of an image.
+	void transform( const cv::Mat& image, const int32_t firstRow, const int32_t lastRow,
+	                cv::Mat& census ) const;
+
+	/// Costs of one row for every disparity, at columns [firstColumn, lastColumn).
+	void compute_costs( const int32_t row, const int32_t firstColumn, const int32_t lastColumn,
+	                    uint8_t* costs ) const;
+
+	void match( Band& band, const int32_t firstRow, const int32_t lastRow,
+	            cv::Mat& disparity ) const;
+
+	/// Winner-takes-all disparities of both views from the aggregated costs of one row.
+	void select( Band& band, const int32_t firstColumn, const int32_t lastColumn,
+	             uint16_t* disparity ) const;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const DisparityParams params_;
+	const size_t range_;
+	const int32_t radius_;
+
+	cv::Size size_;
+	cv::Mat census_[2];
+	std::vector<Band> bands_;
+};
+
+/// Rectifies the pairs, computes their disparity and writes it next to the recorded images.
+///
+/// The stage only reads the pairs it receives, its outputs get them unchanged.
+class DisparityStage
+	: public co::ProcessUnit
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	DisparityStage( const DisparityParams& params, WorkerPool& pool,
+	                const std::string& folderPath );
+
+	~DisparityStage();
+
+	/// Loads the calibration and copies it to the session folder, returns false if the pairs will
+	/// be matched without rectification.
+	bool open();
+
+	/// Processes a pair outside of the co graph.
+	bool process( const StereoFrame& frame );
+
+	/// Disparity map of the last pair.
+	const cv::Mat& get_disparity() const;
+
+	/// Prints the number of pairs matched and their average cost.
+	void print_report() const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const DisparityParams params_;
+	WorkerPool& pool_;
+	const std::string folderPath_;
+
+	StereoRectifier rectifier_;
+	CensusMatcher matcher_;
+
+	cv::Mat grey_[2];
+	cv::Mat rectified_[2];
+	cv::Mat disparity_;
+
+	uint64_t frames_;
+	uint64_t failed_;
+	double timeInUs_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // DISPARITYSTAGE_HPP
@@ -25,6 +25,11 @@
 #include "Importer/IMImporter.hpp"
 #include "IO/IOTiffWriter.hpp"
 
+#include "CaptureConfig.hpp"
+#include "FileOutput.hpp"
+#include "FrameTelemetry.hpp"
+#include "GracefulShutdown.hpp"
+
 #include "HTCmdLineParser.h"
 #include "HTLogger.h"
 #include "HTSignalHandler.hpp"
@@ -34,98 +39,26 @@
 //==================================================================================================
 // F O R W A R D   D E C L A R A T I O N S
 
+class LoadGovernor;
+
 //==================================================================================================
 // C O N S T A N T S
 
 //==================================================================================================
 // C L A S S E S
 
-class FileOutput
-	: public co::ProcessUnit
-{
-//--Methods-----------------------------------------------------------------------------------------
-public:
-	FileOutput( const std::string& folderPath )
-		: folderPath_{ folderPath }
-	{ }
-
-	~FileOutput(){ }
-
-	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final
-	{
-		const cm::BitmapPairEntry* bmEntry = dynamic_cast<cm::BitmapPairEntry*>(
-			&(*inResult.get_cached_entries().begin()->second) );
-
-		co::OutputResult result;
-		result.start_benchmark();
-
-		const cm::BitmapPairEntry::ID* id = dynamic_cast<cm::BitmapPairEntry::ID*>(
-			&(*inResult.get_cached_entries().begin()->first) );
-
-		std::string filepathL, filepathR;
-
-		bool generatedL = im::AsyncImporter::generate_filename( folderPath_, "",
-																id->get_index(),
-																id->get_timestamp(), "l",
-																"tif", filepathL );
-
-		bool generatedR = im::AsyncImporter::generate_filename( folderPath_, "",
-																id->get_index(),
-																id->get_timestamp(), "r",
-																"tif", filepathR );
-
-		if( generatedL && generatedR )
-		{
-			io::TiffWriter tiffWriterL{ filepathL };
-			tiffWriterL.write_to_file( bmEntry->bitmap_left(), id->get_index(),
-									   id->get_timestamp(), 22.f );
-
-			io::TiffWriter tiffWriterR{ filepathR };
-			tiffWriterR.write_to_file( bmEntry->bitmap_right(), id->get_index(),
-									   id->get_timestamp(), 22.f );
-		}
-		else
-		{
-			return false;
-		}
-
-		result.stop_benchmark();
-		//result.print_benchmark( "FileOuput:" );
-
-		for( auto& iter : get_output_list() )
-		{
-			if( iter )
-			{
-				if( !iter->compute_result( context, result ) )
-				{
-					return false;
-				}
-			}
-		}
-
-		return true;
-	}
-
-	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final
-	{
-		cl::ignore( outputMetrics );
-		return false;
-	}
-
-	virtual bool query_output_format( co::OutputFormat& outputFormat ) final
-	{
-		cl::ignore( outputFormat );
-		return false;
-	}
-
-//--Data members------------------------------------------------------------------------------------
-private:
-	const std::string folderPath_;
-};
-
 class EntryPoint
 	: private co::ProcessUnit
 {
+	enum class Mode
+	{
+		Capture,
+		Benchmark,
+		MultiRig,
+		Calibration,
+		Batch
+	};
+
 //--Methods-----------------------------------------------------------------------------------------
 public:
 	EntryPoint();
@@ -136,6 +69,9 @@ public:
 
 	bool is_signaled() const;
 
+	/// Shutdown armed by the next signal, null when no capture is running.
+	void watch_shutdown( GracefulShutdown* shutdown, const std::string& sessionPath );
+
 	/// Outputs a header for the program on the standard output stream.
 	void print_header() const;
 
@@ -145,6 +81,26 @@ public:
 	int32_t run( int32_t argc, const char** argv );
 
 private:
+	/// Acquisition settings of a BlueFox stereo bench.
+	static io::BlueFox::Params bluefox_params();
+
+	/// Records the stereo bench until a signal is received.
+	int32_t run_capture( const CaptureConfig& config );
+
+	/// Records the stereo benches of the multi_rig section until a signal is received.
+	int32_t run_rigs( const CaptureConfig& config );
+
+	/// Calibrates the stereo bench from a recorded session, or from pairs captured live.
+	int32_t run_calibration( const CaptureConfig& config );
+
+	/// Reprocesses the sessions of the batch section, an interrupted run resumes where it stopped.
+	int32_t run_batch( const CaptureConfig& config );
+
+	/// Pushes one cached stereo pair through the pipeline and records its outcome and timing.
+	bool process_entry( cm::BitmapCache& cache, const co::OutputMetrics& om,
+	                    const cm::BitmapPairEntrySPtr& entry, GracefulShutdown& shutdown,
+	                    FrameTelemetry& telemetry, LoadGovernor& governor );
+
 	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& result ) final;
 
 	virtual bool query_output_metrics( co::OutputMetrics& om ) final;
@@ -159,7 +115,17 @@ private:
 
 	ht::SignalHandler signalHandler_;
 
+	Mode mode_;
+
 	volatile bool signaled_;
+
+	/// Set by a second signal, ends the drain of the cache without waiting for its deadline.
+	volatile bool forced_;
+
+	/// Shutdown of the running capture, armed from the signal thread.
+	std::mutex shutdownMutex_;
+	GracefulShutdown* shutdown_;
+	std::string sessionPath_;
 };
 
 
@@ -0,0 +1,80 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef EVENTTRIGGER_HPP
+#define EVENTTRIGGER_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+#include "HTSignalHandler.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// External requests to save an event of the black box: SIGUSR1, creation of the trigger file, or
+/// any datagram sent to the trigger socket, e.g. with 'socat - UNIX-SENDTO:/tmp/camCapture.sock'.
+///
+/// The sources are watched by a thread of their own, the processing thread only reads a counter.
+class EventTrigger
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	/// A relative trigger file is looked for in the session folder.
+	EventTrigger( const BlackBoxParams& params, const std::string& folderPath );
+
+	~EventTrigger();
+
+	/// Installs the signal handler, binds the socket and starts watching.
+	bool start();
+
+	void stop();
+
+	/// Returns true if a trigger was received since the previous call.
+	bool consume();
+
+private:
+	void watch();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const BlackBoxParams params_;
+	const std::string triggerPath_;
+
+	ht::SignalHandler signalHandler_;
+	int32_t socket_;
+	std::atomic<uint32_t> pending_;
+	std::atomic<bool> running_;
+	std::thread thread_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // EVENTTRIGGER_HPP
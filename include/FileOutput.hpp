@@ -0,0 +1,209 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef FILEOUTPUT_HPP
+#define FILEOUTPUT_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+#include "Importer/IMImporter.hpp"
+#include "IO/IOTiffWriter.hpp"
+
+#include "FrameAccess.hpp"
+#include "FrameStore.hpp"
+#include "GracefulShutdown.hpp"
+#include "SessionReplay.hpp"
+
+#include "CLPrint.hpp"
+
+#include <fstream>
+#include <memory>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+class FileOutput
+	: public co::ProcessUnit
+	, public StereoSink
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	/// Windowed pairs are not the cached bitmaps, their tiff files are written by a TiffFrameStore.
+	FileOutput( const std::string& folderPath, const StorageParams& storage,
+	            const bool windowed = false )
+		: folderPath_{ folderPath }
+		, manifest_{ }
+		, store_{ }
+	{
+		if( storage.backend == "tiff" && !windowed )
+		{
+			manifest_.open( folderPath + "/" + SESSION_MANIFEST );
+			manifest_ << "index,timestamp,left,right" << std::endl;
+		}
+		else
+		{
+			store_ = make_frame_store( storage, folderPath );
+		}
+	}
+
+	~FileOutput(){ }
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final
+	{
+		co::OutputResult result;
+		result.start_benchmark();
+
+		if( store_ )
+		{
+			StereoFrame frame;
+			if( !extract_stereo_frame( inResult, frame ) || !store_->store( frame ) )
+			{
+				return false;
+			}
+		}
+		else if( !write_tiff( inResult ) )
+		{
+			return false;
+		}
+
+		result.stop_benchmark();
+		//result.print_benchmark( "FileOuput:" );
+
+		for( auto& iter : get_output_list() )
+		{
+			if( iter )
+			{
+				if( !iter->compute_result( context, result ) )
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/// Writes a pair handed over by a RoiStage or a gate, through the store of the backend.
+	virtual bool submit( const StereoFrame& frame ) final
+	{
+		return store_ && store_->store( frame );
+	}
+
+	/// Makes every frame written so far durable, called once acquisition has stopped.
+	bool flush()
+	{
+		if( store_ )
+		{
+			return store_->flush();
+		}
+
+		manifest_.flush();
+		return GracefulShutdown::sync_folder( folderPath_ );
+	}
+
+	/// Writes in flight in the store and the number at which storing blocks, 0 for tiff files.
+	size_t get_queue_depth( size_t& limit ) const
+	{
+		if( store_ )
+		{
+			return store_->get_queue_depth( limit );
+		}
+
+		limit = 0;
+		return 0;
+	}
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final
+	{
+		cl::ignore( outputMetrics );
+		return false;
+	}
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final
+	{
+		cl::ignore( outputFormat );
+		return false;
+	}
+
+private:
+	/// Writes the pair as two tiff files tagged with the camera index and timestamp.
+	bool write_tiff( const co::OutputResult& inResult )
+	{
+		const cm::BitmapPairEntry* bmEntry = dynamic_cast<cm::BitmapPairEntry*>(
+			&(*inResult.get_cached_entries().begin()->second) );
+
+		const cm::BitmapPairEntry::ID* id = dynamic_cast<cm::BitmapPairEntry::ID*>(
+			&(*inResult.get_cached_entries().begin()->first) );
+
+		std::string filepathL, filepathR;
+
+		bool generatedL = im::AsyncImporter::generate_filename( folderPath_, "",
+																id->get_index(),
+																id->get_timestamp(), "l",
+																"tif", filepathL );
+
+		bool generatedR = im::AsyncImporter::generate_filename( folderPath_, "",
+																id->get_index(),
+																id->get_timestamp(), "r",
+																"tif", filepathR );
+
+		if( generatedL && generatedR )
+		{
+			io::TiffWriter tiffWriterL{ filepathL };
+			tiffWriterL.write_to_file( bmEntry->bitmap_left(), id->get_index(),
+									   id->get_timestamp(), 22.f );
+
+			io::TiffWriter tiffWriterR{ filepathR };
+			tiffWriterR.write_to_file( bmEntry->bitmap_right(), id->get_index(),
+									   id->get_timestamp(), 22.f );
+
+			manifest_ << id->get_index() << "," << id->get_timestamp() << ","
+			          << filepathL.substr( filepathL.find_last_of( '/' ) + 1 ) << ","
+			          << filepathR.substr( filepathR.find_last_of( '/' ) + 1 ) << "\n";
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const std::string folderPath_;
+
+	/// Index, timestamp and file names of every written pair, read back by SessionReplay.
+	std::ofstream manifest_;
+
+	/// Container backend selected by the storage section, null for tiff files.
+	std::unique_ptr<FrameStore> store_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // FILEOUTPUT_HPP
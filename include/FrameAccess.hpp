@@ -0,0 +1,83 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef FRAMEACCESS_HPP
+#define FRAMEACCESS_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "StereoFrame.hpp"
+
+#include "HTBitmap.hpp"
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+/// Wraps the pixels of an 8 bits per channel bitmap, no pixel is copied.
+inline cv::Mat
+bitmap_view( const ht::Bitmap& bitmap )
+{
+	return cv::Mat( static_cast<int32_t>( bitmap.height() ), static_cast<int32_t>( bitmap.width() ),
+	                CV_8UC( static_cast<int32_t>( bitmap.channels() ) ),
+	                const_cast<uint8_t*>( bitmap.data() ) );
+}
+
+/// Gives access to the stereo pair of the first cached entry of a result as a StereoFrame.
+///
+/// The images are views on the cached bitmaps, they are only valid during the compute_result call
+/// that received the result and must be copied to outlive it.
+inline bool
+extract_stereo_frame( const co::OutputResult& result, StereoFrame& frame )
+{
+	if( result.get_cached_entries().empty() )
+	{
+		return false;
+	}
+
+	const cm::BitmapPairEntry* bmEntry = dynamic_cast<cm::BitmapPairEntry*>(
+		&(*result.get_cached_entries().begin()->second) );
+
+	const cm::BitmapPairEntry::ID* id = dynamic_cast<cm::BitmapPairEntry::ID*>(
+		&(*result.get_cached_entries().begin()->first) );
+
+	if( bmEntry == nullptr || id == nullptr )
+	{
+		return false;
+	}
+
+	frame.index = id->get_index();
+	frame.timestamp = id->get_timestamp();
+	frame.left = bitmap_view( bmEntry->bitmap_left() );
+	frame.right = bitmap_view( bmEntry->bitmap_right() );
+
+	return true;
+}
+
+#endif  // FRAMEACCESS_HPP
@@ -0,0 +1,207 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef FRAMERING_HPP
+#define FRAMERING_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Size of a cache line, the indexes written by the producer and by the consumer of a FrameRing
+/// are kept on separate lines so that a write of one side never invalidates the line of the other.
+const size_t CACHE_LINE_SIZE{ 64 };
+
+/// Failed polls of a blocking FrameRing::pop before the consumer goes to sleep.
+const size_t FRAME_RING_SPINS{ 256 };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Wait-free single-producer, single-consumer ring of frame handles, e.g. between an acquisition
+/// thread and the processing loop.
+///
+/// The slots are allocated once, a push or a pop moves one handle and publishes one index, in a
+/// bounded number of steps and without lock. Each side keeps a private copy of the index of the
+/// other side and only reloads it when the ring looks full or empty. The consumer may also block
+/// in pop(), the producer then only takes the mutex when the consumer is actually asleep.
+template<typename T>
+class FrameRing
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	/// Holds at least 'capacity' handles, rounded up to a power of two.
+	explicit FrameRing( const size_t capacity )
+		: mask_{ round_capacity( capacity ) - 1 }
+		, slots_{ new T[mask_ + 1] }
+		, tail_{ 0 }
+		, headCache_{ 0 }
+		, head_{ 0 }
+		, tailCache_{ 0 }
+		, sleeping_{ false }
+		, mutex_{ }
+		, condition_{ }
+	{ }
+
+	~FrameRing()
+	{ }
+
+	size_t capacity() const
+	{
+		return mask_ + 1;
+	}
+
+	/// Producer side, moves a handle into the ring, returns false without waiting if it is full.
+	bool try_push( T&& item )
+	{
+		const size_t tail{ tail_.load( std::memory_order_relaxed ) };
+		if( tail - headCache_ > mask_ )
+		{
+			headCache_ = head_.load( std::memory_order_acquire );
+			if( tail - headCache_ > mask_ )
+			{
+				return false;
+			}
+		}
+
+		slots_[tail & mask_] = std::move( item );
+		tail_.store( tail + 1, std::memory_order_release );
+
+		// Pairs with the fence of pop(): either the consumer sees the new tail before sleeping, or
+		// the producer sees it asleep.
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if( sleeping_.load( std::memory_order_relaxed ) )
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			condition_.notify_one();
+		}
+
+		return true;
+	}
+
+	/// Consumer side, returns false without waiting if the ring is empty.
+	bool try_pop( T& item )
+	{
+		const size_t head{ head_.load( std::memory_order_relaxed ) };
+		if( head == tailCache_ )
+		{
+			tailCache_ = tail_.load( std::memory_order_acquire );
+			if( head == tailCache_ )
+			{
+				return false;
+			}
+		}
+
+		// The slot is left moved-from, the ring never keeps a consumed frame alive.
+		item = std::move( slots_[head & mask_] );
+		head_.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	/// Consumer side, takes the newest handle and releases the older ones as
+	/// cm::BitmapCache::pop_newest_entry does. Returns false if the ring is empty.
+	bool try_pop_newest( T& item, size_t& skipped )
+	{
+		skipped = 0;
+		if( !try_pop( item ) )
+		{
+			return false;
+		}
+
+		while( try_pop( item ) )
+		{
+			++skipped;
+		}
+		return true;
+	}
+
+	/// Consumer side, waits up to 'timeout' for a handle, polling a few times before sleeping.
+	template<typename Rep, typename Period>
+	bool pop( T& item, const std::chrono::duration<Rep, Period>& timeout )
+	{
+		for( size_t i = 0; i < FRAME_RING_SPINS; ++i )
+		{
+			if( try_pop( item ) )
+			{
+				return true;
+			}
+		}
+
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			sleeping_.store( true, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+
+			condition_.wait_for( lock, timeout, [ this ]()
+			{
+				return head_.load( std::memory_order_relaxed ) !=
+				       tail_.load( std::memory_order_acquire );
+			} );
+
+			sleeping_.store( false, std::memory_order_relaxed );
+		}
+
+		return try_pop( item );
+	}
+
+private:
+	static size_t round_capacity( const size_t capacity )
+	{
+		size_t rounded{ 2 };
+		while( rounded < capacity )
+		{
+			rounded *= 2;
+		}
+		return rounded;
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const size_t mask_;
+	const std::unique_ptr<T[]> slots_;
+
+	/// Written by the producer, with its private copy of the consumer index.
+	alignas( CACHE_LINE_SIZE ) std::atomic<size_t> tail_;
+	size_t headCache_;
+
+	/// Written by the consumer, with its private copy of the producer index.
+	alignas( CACHE_LINE_SIZE ) std::atomic<size_t> head_;
+	size_t tailCache_;
+
+	/// Only used when the consumer blocks.
+	alignas( CACHE_LINE_SIZE ) std::atomic<bool> sleeping_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // FRAMERING_HPP
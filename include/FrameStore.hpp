@@ -0,0 +1,188 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef FRAMESTORE_HPP
+#define FRAMESTORE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef WITH_IO_URING
+#include <liburing.h>
+#endif
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Destination of the stereo pairs of a session handled as StereoFrame.
+class FrameStore
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	virtual ~FrameStore()
+	{ }
+
+	/// Writes a pair, never called by two threads at once.
+	virtual bool store( const StereoFrame& frame ) = 0;
+
+	/// Makes every pair stored so far durable.
+	virtual bool flush() = 0;
+
+	/// Writes in flight and the number at which a store blocks, 0 for the synchronous stores.
+	virtual size_t get_queue_depth( size_t& limit ) const
+	{
+		limit = 0;
+		return 0;
+	}
+};
+
+/// One tiff file per image plus the session manifest, the folder layout written by FileOutput so
+/// that SessionReplay reads both back the same way.
+class TiffFrameStore
+	: public FrameStore
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	TiffFrameStore( const std::string& folderPath );
+
+	virtual ~TiffFrameStore();
+
+	virtual bool store( const StereoFrame& frame ) final;
+
+	virtual bool flush() final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const std::string folderPath_;
+
+	std::ofstream manifest_;
+};
+
+
+/// Raw pairs appended to a single container file, see RawContainer.hpp, so that recordings bypass
+/// the page cache and never trigger writeback storms.
+///
+/// The file is opened with O_DIRECT and extended by fallocate ahead of the writes. Pairs are copied
+/// to aligned buffers, allocated for the size of the first pair, and up to 'queueDepth' writes are
+/// in flight, issued by as many writer threads or through io_uring for the 'uring' backend. A store
+/// only blocks when every buffer is in flight.
+class DirectFrameStore
+	: public FrameStore
+{
+	struct Request
+	{
+		size_t buffer;
+		uint64_t offset;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	DirectFrameStore( const StorageParams& params, const std::string& folderPath );
+
+	virtual ~DirectFrameStore();
+
+	virtual bool store( const StereoFrame& frame ) final;
+
+	/// Waits for the writes in flight, releases the preallocated tail and syncs the file.
+	virtual bool flush() final;
+
+	/// Writes not completed yet, out of the number of buffers. With io_uring the completions are
+	/// only collected by the stores.
+	virtual size_t get_queue_depth( size_t& limit ) const final;
+
+private:
+	/// Allocates the buffers and starts the writers for pairs of the size of 'frame'.
+	bool prepare( const StereoFrame& frame );
+
+	/// Extends the preallocation of the file so that it covers 'end'.
+	void reserve( const uint64_t end );
+
+	/// Returns a free buffer, waiting for a write to complete if none is.
+	size_t acquire_buffer();
+
+	void submit( const Request& request );
+
+	void complete( const size_t buffer, const bool success );
+
+	/// Waits until at most 'pending' writes are in flight.
+	void wait_in_flight( const size_t pending );
+
+	void write_loop();
+
+#ifdef WITH_IO_URING
+	/// Collects the io_uring completions, waiting while more than 'pending' writes are in flight.
+	void reap( const size_t pending );
+#endif
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const StorageParams params_;
+	const std::string folderPath_;
+
+	int32_t fd_;
+	bool uring_;
+
+	uint64_t recordSize_;
+	uint64_t offset_;
+	uint64_t allocated_;
+
+	std::vector<uint8_t*> buffers_;
+	std::vector<Request> requests_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable condition_;
+	std::deque<size_t> free_;
+	std::deque<size_t> queue_;
+	size_t inFlight_;
+	bool running_;
+	std::atomic<bool> failed_;
+
+	std::vector<std::thread> writers_;
+
+#ifdef WITH_IO_URING
+	io_uring ring_;
+#endif
+};
+
+/// Creates the store of the configured backend writing in 'folderPath'.
+std::unique_ptr<FrameStore> make_frame_store( const StorageParams& params,
+                                              const std::string& folderPath );
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // FRAMESTORE_HPP
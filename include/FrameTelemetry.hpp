@@ -0,0 +1,142 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef FRAMETELEMETRY_HPP
+#define FRAMETELEMETRY_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Statistics over the last 'window' samples, kept in a fixed ring so that adding a sample never
+/// allocates.
+class RollingStatistics
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	RollingStatistics( const size_t window )
+		: samples_( window, 0.0 )
+		, sorted_( window, 0.0 )
+		, next_{ }
+		, count_{ }
+	{ }
+
+	~RollingStatistics()
+	{ }
+
+	void add( const double sample )
+	{
+		samples_[next_] = sample;
+		next_ = (next_ + 1) % samples_.size();
+		count_ = std::min( count_ + 1, samples_.size() );
+	}
+
+	size_t count() const
+	{
+		return count_;
+	}
+
+	double mean() const;
+
+	double stddev() const;
+
+	double minimum() const;
+
+	double maximum() const;
+
+	/// Returns the sample below which 'ratio' of the window lies, e.g. 0.99 for the p99.
+	double percentile( const double ratio );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	std::vector<double> samples_;
+	std::vector<double> sorted_;
+	size_t next_;
+	size_t count_;
+};
+
+/// Checks the camera indexes and timestamps for gaps and jitter.
+///
+/// An index gap means the camera produced frames the host never processed, so the host is the
+/// bottleneck. A camera interval longer than the expected period without index gap means the
+/// camera itself stalled. Host jitter is the difference between the host and camera intervals.
+class FrameTelemetry
+{
+	using Clock = std::chrono::steady_clock;
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	FrameTelemetry( const TelemetryParams& params, const uint32_t periodInUs );
+
+	~FrameTelemetry();
+
+	/// Opens the csv file receiving the periodic exports.
+	bool open( const std::string& folderPath );
+
+	/// Records a frame, timestamps are in microseconds, processing time is the pipeline duration.
+	void observe( const uint64_t index, const uint64_t timestampInUs, const double processingInUs );
+
+	/// Writes the current statistics unconditionally.
+	void export_statistics();
+
+private:
+	/// Writes the current statistics if the export period has elapsed.
+	void update();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const TelemetryParams params_;
+	const double periodInUs_;
+
+	std::ofstream csv_;
+
+	Clock::time_point lastHostTime_;
+	Clock::time_point lastExport_;
+	uint64_t lastIndex_;
+	uint64_t lastTimestamp_;
+	bool hasLast_;
+
+	uint64_t frames_;
+	uint64_t hostDrops_;
+	uint64_t cameraStalls_;
+	uint64_t discontinuities_;
+
+	RollingStatistics cameraJitter_;
+	RollingStatistics hostJitter_;
+	RollingStatistics processing_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // FRAMETELEMETRY_HPP
@@ -0,0 +1,119 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef GRACEFULSHUTDOWN_HPP
+#define GRACEFULSHUTDOWN_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Frame accounting of a capture session, used to report what a shutdown has lost.
+struct CaptureCounters
+{
+	/// Camera indexes of the first and last frames seen by the processing loop.
+	uint64_t firstIndex{ };
+	uint64_t lastIndex{ };
+
+	/// Frames successfully pushed through the pipeline, before and after the stop request.
+	uint64_t processed{ };
+	uint64_t drained{ };
+
+	/// Frames rejected by the pipeline and frames left in the cache when the drain timed out.
+	uint64_t failed{ };
+	uint64_t discarded{ };
+
+	bool hasIndex{ };
+};
+
+/// Shutdown protocol: stop acquisition, drain the cache up to a deadline, flush the session and
+/// report the losses. A watchdog terminates the process if the whole sequence exceeds the hard
+/// deadline, e.g. because a stage is stuck in compute_result.
+class GracefulShutdown
+{
+	using Clock = std::chrono::steady_clock;
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	GracefulShutdown( const ShutdownParams& params );
+
+	~GracefulShutdown();
+
+	/// Starts the drain and hard deadlines, the session folder is synced before a forced exit.
+	/// Thread safe, only the first call has an effect.
+	void arm( const std::string& sessionPath );
+
+	/// Cancels the watchdog once the shutdown sequence has completed.
+	void disarm();
+
+	bool drain_expired() const;
+
+	/// Records the outcome of a frame pushed through the pipeline.
+	void count_frame( const uint64_t index, const bool success );
+
+	/// Records a frame left in the cache after the drain deadline.
+	void count_discarded();
+
+	const CaptureCounters& get_counters() const;
+
+	/// Prints the shutdown summary, frames lost include the ones the cache never delivered.
+	void print_report() const;
+
+	/// Flushes the file system holding the folder and the folder entries themselves.
+	static bool sync_folder( const std::string& folderPath );
+
+private:
+	void watch();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ShutdownParams params_;
+
+	std::string sessionPath_;
+
+	std::atomic<bool> armed_;
+
+	Clock::time_point armedAt_;
+
+	CaptureCounters counters_;
+
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	std::thread watchdog_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // GRACEFULSHUTDOWN_HPP
@@ -0,0 +1,174 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef LOADGOVERNOR_HPP
+#define LOADGOVERNOR_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Sheds the pipeline stages in a defined order when the pairs cost more than the frame period.
+///
+/// The smoothed cost of every pair, the camera frames lost while it was processed and the depth
+/// of the writer queue tell when the capture falls behind. The sheddable stages are then degraded
+/// one step at a time by increasing priority: every stage is decimated by 2, 4... up to its
+/// largest decimation, or skipped at once, before the next stage is touched. Stages are restored
+/// in the reverse order once the load stays low, and a stage over its own budget is decimated
+/// whatever the load. Only used from the processing thread.
+class LoadGovernor
+{
+	struct Stage
+	{
+		std::string name;
+		GovernedStageParams params;
+
+		/// Smoothed cost of a run, runs and skipped pairs, current decimation, 0 when skipped.
+		double cost;
+		uint64_t runs;
+		uint64_t skipped;
+		uint64_t counter;
+		uint32_t decimation;
+	};
+
+	/// Decimation applied to a stage by one shedding step.
+	struct Step
+	{
+		size_t stage;
+		uint32_t decimation;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	LoadGovernor( const GovernorParams& params, const uint32_t periodInUs );
+
+	~LoadGovernor();
+
+	/// Registers a stage, returns its slot.
+	size_t add_stage( const std::string& name );
+
+	/// Tells whether a stage runs on the current pair.
+	bool admit( const size_t slot );
+
+	/// Records the duration of a run of a stage.
+	void observe_stage( const size_t slot, const double costInUs );
+
+	/// Records the depth and capacity of a writer queue, a half-full queue is an overload.
+	void observe_queue( const size_t depth, const size_t limit );
+
+	/// Records a whole pair, then sheds or restores a stage if needed.
+	void observe_frame( const uint64_t index, const double costInUs );
+
+	/// Shedding level, i.e. number of steps applied.
+	size_t get_level() const;
+
+	/// Cost, runs and skipped pairs of every stage, and time spent shed.
+	void print_report() const;
+
+private:
+	/// Orders the shedding steps by stage priority.
+	void build_steps();
+
+	/// Sets the decimation of every stage from the level and from the stage budgets.
+	void apply_level();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const GovernorParams params_;
+	const double budgetInUs_;
+
+	std::vector<Stage> stages_;
+	std::vector<Step> steps_;
+	size_t level_;
+
+	double cost_;
+	bool hasCost_;
+	uint64_t lastIndex_;
+	bool hasIndex_;
+	bool queueOverloaded_;
+	uint32_t sinceChange_;
+	uint32_t sinceOverload_;
+
+	uint64_t frames_;
+	uint64_t lostFrames_;
+	uint64_t shedFrames_;
+	uint64_t changes_;
+	size_t maxLevel_;
+};
+
+/// Runs its outputs only on the pairs admitted by a LoadGovernor, and reports their cost to it.
+class GovernedStage
+	: public co::ProcessUnit
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	GovernedStage( LoadGovernor& governor, const std::string& name );
+
+	~GovernedStage();
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	LoadGovernor& governor_;
+	const size_t slot_;
+};
+
+/// GovernedStage of the sinks fed with StereoFrame, e.g. the outputs of a ToneMapStage.
+class GovernedSink
+	: public StereoSink
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	GovernedSink( LoadGovernor& governor, const std::string& name, StereoSink& sink );
+
+	~GovernedSink();
+
+	virtual bool submit( const StereoFrame& frame ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	LoadGovernor& governor_;
+	const size_t slot_;
+	StereoSink& sink_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // LOADGOVERNOR_HPP
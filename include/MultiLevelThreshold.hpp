@@ -0,0 +1,103 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef MULTILEVELTHRESHOLD_HPP
+#define MULTILEVELTHRESHOLD_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Criterion minimized by the multi-level thresholding.
+enum class ThresholdCriterion
+{
+	/// Within-class variance, the same partition as the largest between-class variance of Otsu.
+	Otsu,
+
+	/// Minimum error of Kittler and Illingworth, one gaussian fitted to every class.
+	Kittler
+};
+
+/// Globally optimal partition of a histogram into K classes of contiguous bins.
+///
+/// The cost of a class only depends on its weight, mean and variance, read in constant time from
+/// prefix sums of the histogram moments, and the criterion is the sum of the class costs. The
+/// best partition of the bins [0, j) into k classes is thus the best partition of [0, i) into
+/// k - 1 classes followed by the class [i, j), which dynamic programming solves exactly with
+/// O(N^2) class costs and O(K.N^2) additions, N being the span of the non-empty bins. It takes a
+/// fraction of a millisecond for 6 classes of 256 bins.
+class MultiLevelThreshold
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	MultiLevelThreshold( const ThresholdCriterion criterion );
+
+	~MultiLevelThreshold();
+
+	/// Computes the prefix sums of a histogram, the counts are normalized to probabilities.
+	void set_histogram( const std::vector<uint32_t>& histogram );
+
+	void set_histogram( const uint32_t* histogram, const size_t bins );
+
+	/// Computes the classes - 1 increasing thresholds minimizing the criterion, a threshold t
+	/// separating the bins below t from the bins from t on. Every class holds at least one
+	/// non-empty bin, returns false if the histogram has fewer non-empty bins than classes.
+	bool compute( const size_t classes, std::vector<uint32_t>& thresholds );
+
+	/// Criterion value of sorted thresholds, to compare them with those of another method.
+	double evaluate( const std::vector<uint32_t>& thresholds ) const;
+
+	ThresholdCriterion get_criterion() const;
+
+private:
+	/// Cost of the class made of the bins [begin, end).
+	double class_cost( const size_t begin, const size_t end ) const;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ThresholdCriterion criterion_;
+
+	/// Prefix sums of the probabilities and of their first and second moments, bins + 1 entries.
+	std::vector<double> weights_;
+	std::vector<double> sums_;
+	std::vector<double> squares_;
+
+	/// Cost of every class [begin, end), at end * (bins + 1) + begin.
+	std::vector<double> classCosts_;
+
+	/// Best costs and last thresholds of the partitions of [0, j) into k + 1 classes, row k.
+	std::vector<double> costs_;
+	std::vector<uint32_t> splits_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // MULTILEVELTHRESHOLD_HPP
@@ -0,0 +1,120 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef PREVIEWOUTPUT_HPP
+#define PREVIEWOUTPUT_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Decimated side-by-side preview of the demosaiced stereo pair.
+///
+/// The processing thread only copies the pair into a single slot when the preview thread is idle
+/// and the preview period has elapsed, otherwise the pair is skipped. Decimation, display and
+/// jpeg encoding all happen on the preview thread, whose cpu time is reported periodically.
+class PreviewOutput
+	: public co::ProcessUnit
+	, public StereoSink
+{
+	using Clock = std::chrono::steady_clock;
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	PreviewOutput( const PreviewParams& params, const ThreadRoleParams& placement,
+	               const std::string& folderPath );
+
+	~PreviewOutput();
+
+	void start();
+
+	void stop();
+
+	/// Hands a pair over to the preview thread, never waits for it, skips it if the thread is busy.
+	virtual bool submit( const StereoFrame& frame ) final;
+
+	/// Cpu time of the preview thread over the last report period, in percent of one core.
+	double get_cpu_load() const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+private:
+	void process();
+
+	void render();
+
+	void report( const Clock::time_point& now, const double cpuTimeInUs );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const PreviewParams params_;
+	const ThreadRoleParams placement_;
+	const std::string filepath_;
+
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	std::thread thread_;
+	bool running_;
+	bool pending_;
+
+	/// Copy of the last submitted pair, owned by the preview thread while pending_ is set.
+	StereoFrame slot_;
+
+	cv::Mat left_;
+	cv::Mat right_;
+	cv::Mat sideBySide_;
+
+	Clock::time_point lastSubmit_;
+	Clock::time_point lastReport_;
+
+	std::atomic<uint64_t> submitted_;
+	std::atomic<uint64_t> skipped_;
+	std::atomic<uint64_t> submitTimeInUs_;
+	std::atomic<double> cpuLoad_;
+
+	uint64_t rendered_;
+	double cpuTimeInUs_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // PREVIEWOUTPUT_HPP
@@ -0,0 +1,112 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef RAWCONTAINER_HPP
+#define RAWCONTAINER_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "RawPacking.hpp"
+#include "StereoFrame.hpp"
+
+#include <cstdint>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Name of the container file written by the 'direct' and 'uring' storage backends.
+const char* const RAW_CONTAINER{ "frames.raw" };
+
+/// Alignment of the O_DIRECT transfers, offsets and sizes of the records are multiples of it.
+const uint64_t DIRECT_ALIGNMENT{ 4096 };
+
+/// "RAWF" read as a little-endian integer.
+const uint32_t RAW_RECORD_MAGIC{ 0x46574152 };
+
+/// Bytes reserved for the header at the start of a record.
+const uint64_t RAW_HEADER_SIZE{ 64 };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Header of a container record, followed by the left then the right image with contiguous rows,
+/// then by padding up to recordSize. 16 bits images may be bit-packed, see RawPacking.hpp.
+struct RawRecordHeader
+{
+	uint32_t magic;
+	uint32_t headerSize;
+	uint64_t index;
+	uint64_t timestamp;
+	int32_t width;
+	int32_t height;
+
+	/// OpenCV type of both images, and bytes of each image in the record.
+	int32_t type;
+	uint32_t imageSize;
+	uint64_t recordSize;
+
+	/// Depth of bit-packed images, 0 for images stored as is, as in the records written before.
+	uint32_t packedBits;
+};
+
+static_assert( sizeof( RawRecordHeader ) <= RAW_HEADER_SIZE, "record header too large" );
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+/// Rounds a size up to the O_DIRECT alignment.
+inline uint64_t
+direct_aligned( const uint64_t size )
+{
+	return (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+}
+
+inline uint64_t
+image_size( const cv::Mat& image )
+{
+	return static_cast<uint64_t>( image.total() * image.elemSize() );
+}
+
+/// Depth the images of a pair are packed to with the configured depth, 0 if they are stored as is,
+/// only 16 bits images are packed.
+inline uint32_t
+record_packed_bits( const StereoFrame& frame, const uint32_t packedBits )
+{
+	return is_packed_depth( packedBits ) && frame.left.type() == CV_16UC1 ? packedBits : 0;
+}
+
+/// Size of an image of a pair in the container.
+inline uint64_t
+raw_image_size( const cv::Mat& image, const uint32_t packedBits )
+{
+	return packedBits ? packed_image_size( image, packedBits ) : image_size( image );
+}
+
+/// Size of the record of a pair in the container.
+inline uint64_t
+raw_record_size( const StereoFrame& frame, const uint32_t packedBits )
+{
+	const uint32_t bits{ record_packed_bits( frame, packedBits ) };
+	return direct_aligned( RAW_HEADER_SIZE + 2 * raw_image_size( frame.left, bits ) );
+}
+
+#endif  // RAWCONTAINER_HPP
@@ -0,0 +1,99 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef RAWPACKING_HPP
+#define RAWPACKING_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include <opencv2/core/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+// Packed rows of 10 or 12 bits pixels, as the 16 bits images of the high bit depth sensor modes
+// hold them. A row is split in two planes: the 8 most significant bits of every pixel, one byte
+// per pixel in order, then the remaining 2 or 4 low bits. The low plane of a 'width' pixels row
+// has L = ceil(width * lowBits / 8) bytes, the low bits of pixel x are in byte x % L, at bit
+// (x / L) * lowBits. A 752 pixels row takes 940 bytes at 10 bits and 1128 at 12, instead of 1504.
+//
+// The high plane alone is an 8 bits image with a row step, so that the 8 bits stages read packed
+// images without unpacking, see packed_msb_view().
+
+/// Depths packed by pack_image(), other depths are stored at full width.
+inline bool
+is_packed_depth( const uint32_t bits )
+{
+	return bits == 10 || bits == 12;
+}
+
+/// Bytes of a packed row.
+inline size_t
+packed_row_size( const size_t width, const uint32_t bits )
+{
+	const size_t slots{ 8 / (bits - 8) };
+	return width + (width + slots - 1) / slots;
+}
+
+/// Bytes of a packed 16 bits image.
+inline uint64_t
+packed_image_size( const cv::Mat& image, const uint32_t bits )
+{
+	return static_cast<uint64_t>( image.rows ) *
+	       packed_row_size( static_cast<size_t>( image.cols ), bits );
+}
+
+/// Packs 'width' pixels to 'dst', pixels over the depth are saturated.
+void pack_row( const uint16_t* src, const size_t width, const uint32_t bits, uint8_t* dst );
+
+void unpack_row( const uint8_t* src, const size_t width, const uint32_t bits, uint16_t* dst );
+
+/// Packs the rows of a CV_16UC1 image one after the other to 'dst', returns the end of the written
+/// bytes.
+uint8_t* pack_image( const cv::Mat& image, const uint32_t bits, uint8_t* dst );
+
+/// Packs a CV_16UC1 image to a CV_8UC1 matrix of packed rows, reallocated only if its size changes.
+void pack_image( const cv::Mat& image, const uint32_t bits, cv::Mat& packed );
+
+/// Unpacks 'height' rows of 'width' pixels to a CV_16UC1 image.
+void unpack_image( const uint8_t* src, const int32_t width, const int32_t height,
+                   const uint32_t bits, cv::Mat& image );
+
+/// 8 bits view of the most significant bits of packed rows, no pixel is copied.
+inline cv::Mat
+packed_msb_view( const uint8_t* src, const int32_t width, const int32_t height,
+                 const uint32_t bits )
+{
+	return cv::Mat( height, width, CV_8UC1, const_cast<uint8_t*>( src ),
+	                packed_row_size( static_cast<size_t>( width ), bits ) );
+}
+
+#endif  // RAWPACKING_HPP
@@ -0,0 +1,121 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef RECORDINGGATE_HPP
+#define RECORDINGGATE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Decides whether a frame differs enough from the last stored one to be worth storing.
+///
+/// The signature of a frame is a grid of block averages over a subsampled image, compared with
+/// the signature of the last stored frame by its mean and maximum absolute difference.
+class ChangeDetector
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ChangeDetector( const GateParams& params );
+
+	~ChangeDetector();
+
+	/// Computes the block averages of the first channel of an image.
+	void compute_signature( const cv::Mat& image, std::vector<float>& signature ) const;
+
+	/// Returns true if the frame has to be stored, it then becomes the new reference.
+	bool is_keyframe( const StereoFrame& frame );
+
+	double get_mean_difference() const;
+
+	double get_max_difference() const;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const GateParams params_;
+
+	std::vector<float> reference_;
+	std::vector<float> current_;
+	bool hasReference_;
+	uint64_t referenceTimestamp_;
+
+	double meanDifference_;
+	double maxDifference_;
+};
+
+/// Forwards a frame to its outputs and sinks only if the ChangeDetector considers it a keyframe.
+class RecordingGate
+	: public co::ProcessUnit
+	, public StereoSink
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	RecordingGate( const GateParams& params );
+
+	~RecordingGate();
+
+	/// Adds a consumer of the keyframes.
+	void add_sink( StereoSink& sink );
+
+	/// Hands a keyframe over to the consumers, a skipped frame is not a failure.
+	virtual bool submit( const StereoFrame& frame ) final;
+
+	/// Prints the number of frames stored and skipped.
+	void print_report() const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+private:
+	/// Returns true if the frame is a keyframe, and counts it as stored or skipped.
+	bool admit( const StereoFrame& frame );
+
+	/// Hands a keyframe over to every sink, returns false if any of them failed.
+	bool forward( const StereoFrame& frame );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	ChangeDetector detector_;
+	std::vector<StereoSink*> sinks_;
+
+	uint64_t stored_;
+	uint64_t skipped_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // RECORDINGGATE_HPP
@@ -0,0 +1,101 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef RIGSCHEDULER_HPP
+#define RIGSCHEDULER_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureRig.hpp"
+#include "WorkerPool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Dispatches the pairs of several rigs to a shared WorkerPool.
+///
+/// At most one pair per rig is in flight, so rigs progress in parallel on the pool while each rig
+/// keeps its pairs ordered. A rig whose previous pair is still being processed keeps acquiring in
+/// its own cache, and only its newest pair is dispatched once it is free again.
+class RigScheduler
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Slot
+	{
+		CaptureRig* rig;
+		std::atomic<bool> busy;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	RigScheduler( WorkerPool& pool );
+
+	~RigScheduler();
+
+	void add_rig( CaptureRig& rig );
+
+	/// Dispatches the pairs of the rigs until 'stopped' returns true, then waits for the pairs in
+	/// flight. The rigs must be started.
+	void run( const std::function<bool()>& stopped );
+
+	/// Processes the pairs left in the rigs once they are stopped, until none is left or 'expired'
+	/// returns true. The pairs still left then are counted as discarded.
+	void drain( const std::function<bool()>& expired );
+
+	/// Frames processed, failed, discarded and lost per rig, and the total throughput of the last
+	/// run.
+	void print_report() const;
+
+private:
+	/// Hands the newest pair of every free rig to the pool, returns false if none was dispatched.
+	bool dispatch();
+
+	void complete( Slot& slot );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	WorkerPool& pool_;
+
+	std::vector<std::unique_ptr<Slot>> slots_;
+
+	std::mutex mutex_;
+	std::condition_variable condition_;
+
+	Clock::duration elapsed_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // RIGSCHEDULER_HPP
@@ -0,0 +1,104 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef ROISTAGE_HPP
+#define ROISTAGE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Crops the pairs to the configured region and optionally bins them, at the head of the pipeline
+/// for the raw pairs and behind the demosaicing for the colour ones.
+///
+/// The crop is a view on the cached bitmaps, only the binning writes pixels. The windowed pair is
+/// handed over to StereoSink consumers such as the recording, as ToneMapStage does, the cached
+/// entries forwarded to the outputs of the stage are left untouched.
+class RoiStage
+	: public co::ProcessUnit
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	RoiStage( const RoiParams& params, const int32_t width, const int32_t height );
+
+	~RoiStage();
+
+	/// Region of the sensor frames kept, aligned on the Bayer pattern and clamped to the frame.
+	const cv::Rect& get_region() const;
+
+	/// Size of the pairs produced, the region halved by the binning.
+	cv::Size get_output_size() const;
+
+	/// Crops and bins a pair outside of the co graph. The images of 'windowed' are views on
+	/// 'frame' or on buffers of the stage, valid until the next call. Pairs already of the size of
+	/// the region, e.g. from filters that honour the region of the output metrics, are only binned.
+	bool process( const StereoFrame& frame, StereoFrame& windowed );
+
+	/// Adds a consumer of the windowed pairs.
+	void add_sink( StereoSink& sink );
+
+	/// Prints the number of pairs windowed and their average cost.
+	void print_report() const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const RoiParams params_;
+	const cv::Rect region_;
+
+	StereoFrame windowed_;
+	std::vector<StereoSink*> sinks_;
+
+	uint64_t frames_;
+	double timeInUs_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+/// Aligns a configured region on the 2x2 Bayer pattern, on 4x4 blocks with binning, and clamps it
+/// to a frame. An empty region, or a disabled one, covers the whole frame.
+cv::Rect align_region( const RoiParams& params, const int32_t width, const int32_t height );
+
+/// Averages every 2x2 block of same colour pixels of a raw Bayer image into 'dst', which keeps
+/// the Bayer layout at half the size. Output pixel (x, y) is the rounded mean of the input pixels
+/// at columns 2x - x % 2 and 2x - x % 2 + 2, rows 2y - y % 2 and 2y - y % 2 + 2. The size of 'src'
+/// must be a multiple of 4, 8 bits images use SIMD.
+void bin_bayer( const cv::Mat& src, cv::Mat& dst );
+
+#endif  // ROISTAGE_HPP
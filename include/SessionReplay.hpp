@@ -0,0 +1,97 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef SESSIONREPLAY_HPP
+#define SESSIONREPLAY_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "StereoFrame.hpp"
+
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Name of the file listing the pairs written in a session folder.
+const char* const SESSION_MANIFEST{ "frames.csv" };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Reads back the stereo pairs recorded in a date-named session folder.
+///
+/// Pairs are read from the raw container of the 'direct' storage backends when the folder holds
+/// one, else listed from the session manifest. Sessions recorded without either are scanned for
+/// '*l.tif' files with a matching '*r.tif', ordered by name, with timestamps synthesized from the
+/// frame period.
+class SessionReplay
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	SessionReplay( const std::string& folderPath, const uint32_t periodInUs );
+
+	~SessionReplay();
+
+	/// Lists the recorded pairs, returns false if the folder holds none.
+	bool open();
+
+	size_t size() const;
+
+	/// Loads a recorded pair as stored, i.e. raw Bayer images for a capture session.
+	bool read( const size_t position, StereoFrame& frame ) const;
+
+	const std::string& get_folder_path() const;
+
+private:
+	struct Record
+	{
+		uint64_t index;
+		uint64_t timestamp;
+		std::string left;
+		std::string right;
+
+		/// Offset of the record in the raw container, the file names are empty for those.
+		uint64_t offset;
+	};
+
+	bool load_container();
+
+	bool read_container( const Record& record, StereoFrame& frame ) const;
+
+	bool load_manifest();
+
+	bool scan_folder();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const std::string folderPath_;
+	const uint32_t periodInUs_;
+
+	std::vector<Record> records_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // SESSIONREPLAY_HPP
@@ -0,0 +1,394 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef STATICPIPELINE_HPP
+#define STATICPIPELINE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "StereoFrame.hpp"
+
+#include "CLPrint.hpp"
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Rows every pass of a FusedPass processes before moving to the next band, few enough for the
+/// band of both images to stay in cache and even so that every band keeps the Bayer layout.
+const int32_t FUSED_BAND_ROWS{ 32 };
+
+/// Rows read around a band by the demosaicing, the band then matches the whole image conversion.
+const int32_t DEMOSAIC_MARGIN{ 2 };
+
+/// Levels at or below which a pixel is under-exposed, at or above which it is saturated.
+const uint32_t DARK_LEVEL{ 8 };
+const uint32_t BRIGHT_LEVEL{ 247 };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Mean level and ratios of under and over-exposed pixels of an image.
+struct ExposureStatistics
+{
+	double mean{ };
+	double dark{ };
+	double bright{ };
+};
+
+/// Pair travelling through a StaticPipeline: the raw pair, then what the passes compute from it.
+struct PipelineFrame
+{
+	StereoFrame raw;
+	cv::Mat colour[2];
+	ExposureStatistics exposure[2];
+};
+
+/// Chain of passes composed at compile time, for the fixed topologies.
+///
+/// A pass is any class with a non-virtual 'bool process( PipelineFrame& frame )'. The passes are
+/// called in order until one fails, without output list, null check nor virtual call between
+/// them, so that the compiler inlines the whole chain. Topologies decided at run time, such as
+/// the live capture, keep the co::ProcessUnit graph.
+template<typename... Passes>
+class StaticPipeline
+{
+	template<size_t I>
+	using Index = std::integral_constant<size_t, I>;
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	StaticPipeline()
+		: passes_{ }
+	{ }
+
+	~StaticPipeline()
+	{ }
+
+	bool process( PipelineFrame& frame )
+	{
+		return process( frame, Index<0>{ } );
+	}
+
+	/// Pass 'I' of the chain, to configure it between two frames.
+	template<size_t I>
+	typename std::tuple_element<I, std::tuple<Passes...>>::type& get()
+	{
+		return std::get<I>( passes_ );
+	}
+
+private:
+	template<size_t I>
+	bool process( PipelineFrame& frame, Index<I> )
+	{
+		return std::get<I>( passes_ ).process( frame ) && process( frame, Index<I + 1>{ } );
+	}
+
+	bool process( PipelineFrame& frame, Index<sizeof...( Passes )> )
+	{
+		cl::ignore( frame );
+		return true;
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	std::tuple<Passes...> passes_;
+};
+
+/// Per-pixel passes fused into a single sweep over the images.
+///
+/// Instead of every pass going over the whole images in turn, each band of FUSED_BAND_ROWS rows
+/// goes through all the passes while it is still in cache. A fused pass provides
+/// 'bool prepare( PipelineFrame& frame )', called before the first band to allocate its outputs,
+/// 'void process_rows( PipelineFrame& frame, const int32_t begin, const int32_t end )', which
+/// only reads the rows of the band from the outputs of the previous passes, and
+/// 'void finish( PipelineFrame& frame )', called after the last band.
+template<typename... Passes>
+class FusedPass
+{
+	template<size_t I>
+	using Index = std::integral_constant<size_t, I>;
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	FusedPass()
+		: passes_{ }
+	{ }
+
+	~FusedPass()
+	{ }
+
+	bool process( PipelineFrame& frame )
+	{
+		if( !prepare( frame, Index<0>{ } ) )
+		{
+			return false;
+		}
+
+		const int32_t rows{ std::max( frame.raw.left.rows, frame.raw.right.rows ) };
+		for( int32_t begin = 0; begin < rows; begin += FUSED_BAND_ROWS )
+		{
+			process_rows( frame, begin, std::min( begin + FUSED_BAND_ROWS, rows ), Index<0>{ } );
+		}
+
+		finish( frame, Index<0>{ } );
+		return true;
+	}
+
+	template<size_t I>
+	typename std::tuple_element<I, std::tuple<Passes...>>::type& get()
+	{
+		return std::get<I>( passes_ );
+	}
+
+private:
+	template<size_t I>
+	bool prepare( PipelineFrame& frame, Index<I> )
+	{
+		return std::get<I>( passes_ ).prepare( frame ) && prepare( frame, Index<I + 1>{ } );
+	}
+
+	bool prepare( PipelineFrame& frame, Index<sizeof...( Passes )> )
+	{
+		cl::ignore( frame );
+		return true;
+	}
+
+	template<size_t I>
+	void process_rows( PipelineFrame& frame, const int32_t begin, const int32_t end, Index<I> )
+	{
+		std::get<I>( passes_ ).process_rows( frame, begin, end );
+		process_rows( frame, begin, end, Index<I + 1>{ } );
+	}
+
+	void process_rows( PipelineFrame& frame, const int32_t begin, const int32_t end,
+	                   Index<sizeof...( Passes )> )
+	{
+		cl::ignore( frame, begin, end );
+	}
+
+	template<size_t I>
+	void finish( PipelineFrame& frame, Index<I> )
+	{
+		std::get<I>( passes_ ).finish( frame );
+		finish( frame, Index<I + 1>{ } );
+	}
+
+	void finish( PipelineFrame& frame, Index<sizeof...( Passes )> )
+	{
+		cl::ignore( frame );
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	std::tuple<Passes...> passes_;
+};
+
+/// Demosaics the raw pair into the colour pair, raw images that already have colour channels are
+/// copied.
+class DemosaicPass
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	DemosaicPass()
+		: band_{ }
+	{ }
+
+	~DemosaicPass()
+	{ }
+
+	bool process( PipelineFrame& frame )
+	{
+		demosaic( frame.raw.left, frame.colour[0] );
+		demosaic( frame.raw.right, frame.colour[1] );
+		return !frame.colour[0].empty() && !frame.colour[1].empty();
+	}
+
+	bool prepare( PipelineFrame& frame )
+	{
+		for( size_t view = 0; view < 2; ++view )
+		{
+			const cv::Mat& raw = view == 0 ? frame.raw.left : frame.raw.right;
+			if( raw.empty() )
+			{
+				return false;
+			}
+			frame.colour[view].create( raw.size(), CV_MAKETYPE( raw.depth(), 3 ) );
+		}
+		return true;
+	}
+
+	void process_rows( PipelineFrame& frame, const int32_t begin, const int32_t end )
+	{
+		for( size_t view = 0; view < 2; ++view )
+		{
+			const cv::Mat& raw = view == 0 ? frame.raw.left : frame.raw.right;
+			const int32_t last{ std::min( end, raw.rows ) };
+			if( begin >= last )
+			{
+				continue;
+			}
+
+			cv::Mat colour = frame.colour[view].rowRange( begin, last );
+			if( raw.channels() != 1 )
+			{
+				raw.rowRange( begin, last ).copyTo( colour );
+				continue;
+			}
+
+			// OpenCV replicates the border rows of the image it converts, the margins keep the
+			// rows of the band from being taken as borders.
+			const int32_t from{ std::max( begin - DEMOSAIC_MARGIN, 0 ) };
+			const int32_t to{ std::min( last + DEMOSAIC_MARGIN, raw.rows ) };
+			cv::cvtColor( raw.rowRange( from, to ), band_, BAYER_TO_BGR );
+			band_.rowRange( begin - from, last - from ).copyTo( colour );
+		}
+	}
+
+	void finish( PipelineFrame& frame )
+	{
+		cl::ignore( frame );
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	cv::Mat band_;
+};
+
+/// Exposure statistics of the 8 bits raw pair, on the raw levels of Bayer images and on the grey
+/// levels of colour images.
+class ExposurePass
+{
+	struct Counts
+	{
+		uint64_t sum;
+		uint64_t dark;
+		uint64_t bright;
+		uint64_t pixels;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ExposurePass()
+		: counts_{ }
+		, grey_{ }
+	{ }
+
+	~ExposurePass()
+	{ }
+
+	bool process( PipelineFrame& frame )
+	{
+		if( !prepare( frame ) )
+		{
+			return false;
+		}
+
+		process_rows( frame, 0, std::max( frame.raw.left.rows, frame.raw.right.rows ) );
+		finish( frame );
+		return true;
+	}
+
+	bool prepare( PipelineFrame& frame )
+	{
+		counts_[0] = Counts{ };
+		counts_[1] = Counts{ };
+		return frame.raw.left.depth() == CV_8U && frame.raw.right.depth() == CV_8U;
+	}
+
+	void process_rows( PipelineFrame& frame, const int32_t begin, const int32_t end )
+	{
+		for( size_t view = 0; view < 2; ++view )
+		{
+			const cv::Mat& raw = view == 0 ? frame.raw.left : frame.raw.right;
+			const int32_t last{ std::min( end, raw.rows ) };
+			if( begin >= last )
+			{
+				continue;
+			}
+
+			cv::Mat band = raw.rowRange( begin, last );
+			if( raw.channels() != 1 )
+			{
+				cv::cvtColor( band, grey_, CV_BGR2GRAY );
+				band = grey_;
+			}
+
+			count( band, counts_[view] );
+		}
+	}
+
+	void finish( PipelineFrame& frame )
+	{
+		for( size_t view = 0; view < 2; ++view )
+		{
+			const double pixels{ static_cast<double>( std::max<uint64_t>( counts_[view].pixels,
+			                                                              1 ) ) };
+			frame.exposure[view].mean = static_cast<double>( counts_[view].sum ) / pixels;
+			frame.exposure[view].dark = static_cast<double>( counts_[view].dark ) / pixels;
+			frame.exposure[view].bright = static_cast<double>( counts_[view].bright ) / pixels;
+		}
+	}
+
+private:
+	static void count( const cv::Mat& grey, Counts& counts )
+	{
+		for( int32_t y = 0; y < grey.rows; ++y )
+		{
+			const uint8_t* row = grey.ptr<uint8_t>( y );
+
+			// 32 bits row sums let the compiler vectorise the loop.
+			uint32_t sum{ };
+			uint32_t dark{ };
+			uint32_t bright{ };
+			for( int32_t x = 0; x < grey.cols; ++x )
+			{
+				const uint32_t level{ row[x] };
+				sum += level;
+				dark += level <= DARK_LEVEL ? 1 : 0;
+				bright += level >= BRIGHT_LEVEL ? 1 : 0;
+			}
+
+			counts.sum += sum;
+			counts.dark += dark;
+			counts.bright += bright;
+		}
+		counts.pixels += grey.total();
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	Counts counts_[2];
+	cv::Mat grey_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // STATICPIPELINE_HPP
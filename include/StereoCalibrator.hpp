@@ -0,0 +1,117 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef STEREOCALIBRATOR_HPP
+#define STEREOCALIBRATOR_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+class SessionReplay;
+class StereoRectifier;
+class WorkerPool;
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Stereo calibration of a bench from pairs showing a chessboard or a circle grid.
+///
+/// Every added pair is searched for the pattern by a task of its own on a WorkerPool, so the
+/// detections, by far the longest part, run on every cpu while the pairs are still being
+/// collected. The two cameras are then calibrated concurrently, and cv::stereoCalibrate only
+/// solves the pose of the right camera with fixed intrinsics, over a bounded number of views.
+class StereoCalibrator
+{
+	using Clock = std::chrono::steady_clock;
+
+	/// Pattern points found in both views of a pair.
+	struct View
+	{
+		uint64_t index;
+		std::vector<cv::Point2f> points[2];
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	StereoCalibrator( const CalibrationParams& params, WorkerPool& pool );
+
+	~StereoCalibrator();
+
+	/// Queues the detection of the pattern in a pair, the images are copied.
+	void add_pair( const StereoFrame& frame );
+
+	/// Queues the detection of the pattern in a recorded pair, read by the worker. The replay
+	/// must outlive the detection.
+	void add_pair( const SessionReplay& replay, const size_t position );
+
+	/// Waits for the queued detections, then solves the calibration from the pairs where the
+	/// pattern was found in both views. Returns false if there are too few of them.
+	bool calibrate( StereoRectifier& rectifier );
+
+	/// Pairs examined, pairs with the pattern, reprojection errors and durations.
+	void print_report() const;
+
+private:
+	/// Searches the pattern in both images of a pair and keeps the view if it is in both.
+	void detect( const StereoFrame& frame );
+
+	/// Finds the pattern in a raw Bayer or BGR image, with sub-pixel chessboard corners.
+	bool find_pattern( const cv::Mat& image, cv::Mat& grey,
+	                   std::vector<cv::Point2f>& points ) const;
+
+	/// Position of every point of the pattern on its plane.
+	std::vector<cv::Point3f> pattern_points() const;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const CalibrationParams params_;
+	const cv::Size patternSize_;
+
+	WorkerPool& pool_;
+
+	std::mutex mutex_;
+	std::vector<View> views_;
+	cv::Size imageSize_;
+	size_t pairs_;
+
+	size_t used_;
+	double errors_[3];
+
+	/// Time of the first pair, the detection time runs from it to the last detection.
+	Clock::time_point start_;
+	Clock::duration detection_;
+	Clock::duration solving_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // STEREOCALIBRATOR_HPP
@@ -0,0 +1,132 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef STEREOFRAME_HPP
+#define STEREOFRAME_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Bayer layout of the BlueFox sensors, as seen by OpenCV.
+const int32_t BAYER_TO_BGR{ CV_BayerBG2BGR };
+const int32_t BAYER_TO_GREY{ CV_BayerBG2GRAY };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Stereo pair handled outside of the cm::BitmapCache, e.g. replayed from a recorded session.
+struct StereoFrame
+{
+	/// Camera frame index and timestamp in microseconds.
+	uint64_t index{ };
+	uint64_t timestamp{ };
+
+	cv::Mat left;
+	cv::Mat right;
+};
+
+/// Receiver of the pairs produced by the stages working on StereoFrame rather than cache entries.
+class StereoSink
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	virtual ~StereoSink()
+	{ }
+
+	/// Receives a pair whose images are only valid during the call. Returns false only on a
+	/// failure, a pair deliberately skipped or decimated by the sink is not one.
+	virtual bool submit( const StereoFrame& frame ) = 0;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+/// Converts a raw Bayer image to BGR, images that already have colour channels are copied.
+inline void
+demosaic( const cv::Mat& src, cv::Mat& dst )
+{
+	if( src.channels() == 1 )
+	{
+		cv::cvtColor( src, dst, BAYER_TO_BGR );
+	}
+	else
+	{
+		src.copyTo( dst );
+	}
+}
+
+/// Converts a raw Bayer image or a BGR image to grey.
+inline void
+to_grey( const cv::Mat& src, cv::Mat& dst )
+{
+	if( src.channels() == 3 )
+	{
+		cv::cvtColor( src, dst, CV_BGR2GRAY );
+	}
+	else
+	{
+		cv::cvtColor( src, dst, BAYER_TO_GREY );
+	}
+}
+
+/// Fills a raw stereo pair with a moving diagonal gradient scaled by 'gain', enough texture to keep
+/// every stage busy. The buffers of 'frame' are reused when they already have the right size.
+inline void
+synthesize( const uint64_t index, const int32_t width, const int32_t height, const double gain,
+            StereoFrame& frame )
+{
+	frame.index = index;
+	frame.left.create( height, width, CV_8UC1 );
+	frame.right.create( height, width, CV_8UC1 );
+
+	uint8_t table[256];
+	for( size_t value = 0; value < 256; ++value )
+	{
+		table[value] = static_cast<uint8_t>(
+			std::min( 255.0, gain * static_cast<double>( value ) + 0.5 ) );
+	}
+
+	const size_t offset{ static_cast<size_t>( index * 8 ) };
+
+	for( int32_t y = 0; y < height; ++y )
+	{
+		uint8_t* left = frame.left.ptr<uint8_t>( y );
+		uint8_t* right = frame.right.ptr<uint8_t>( y );
+
+		for( int32_t x = 0; x < width; ++x )
+		{
+			const size_t value{ static_cast<size_t>( x + y ) + offset };
+			left[x] = table[value & 0xFF];
+			right[x] = table[(value + 4) & 0xFF];
+		}
+	}
+}
+
+#endif  // STEREOFRAME_HPP
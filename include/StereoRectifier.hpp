@@ -0,0 +1,93 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef STEREORECTIFIER_HPP
+#define STEREORECTIFIER_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Name of the calibration file of a session folder.
+const char* const STEREO_CALIB_FILE{ "stereo_calib.yml" };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Rectification of the stereo pairs from an OpenCV calibration file.
+///
+/// The file holds the camera matrices M1 and M2, the distortion coefficients D1 and D2 and the
+/// pose R, T of the right camera, as written by cv::stereoCalibrate. The remap tables are computed
+/// once per image size, then any row band of an image can be rectified independently.
+class StereoRectifier
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	StereoRectifier();
+
+	~StereoRectifier();
+
+	/// Reads a calibration file, returns false if it is missing or incomplete.
+	bool load( const std::string& filepath );
+
+	/// Writes the calibration, returns false if there is none or the file can not be written.
+	bool save( const std::string& filepath ) const;
+
+	/// Sets the calibration computed by cv::stereoCalibrate.
+	void set_calibration( const cv::Mat& cameraLeft, const cv::Mat& distortionLeft,
+	                      const cv::Mat& cameraRight, const cv::Mat& distortionRight,
+	                      const cv::Mat& rotation, const cv::Mat& translation );
+
+	bool is_calibrated() const;
+
+	/// Computes the remap tables of an image size, does nothing if they are up to date.
+	void prepare( const cv::Size& size );
+
+	/// Rectifies rows [firstRow, lastRow) of the left (0) or right (1) image into the same rows of
+	/// 'dst', which must already have the size and type of 'src'.
+	void rectify( const size_t view, const cv::Mat& src, cv::Mat& dst, const int32_t firstRow,
+	              const int32_t lastRow ) const;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	cv::Mat cameraLeft_;
+	cv::Mat distortionLeft_;
+	cv::Mat cameraRight_;
+	cv::Mat distortionRight_;
+	cv::Mat rotation_;
+	cv::Mat translation_;
+	bool calibrated_;
+
+	cv::Size size_;
+	cv::Mat mapsX_[2];
+	cv::Mat mapsY_[2];
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // STEREORECTIFIER_HPP
@@ -0,0 +1,185 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef STREAMOUTPUT_HPP
+#define STREAMOUTPUT_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+/// Boundary between the images of the multipart stream.
+const char* const STREAM_BOUNDARY{ "camcapture" };
+
+//==================================================================================================
+// C L A S S E S
+
+/// Pairs handled by a StreamOutput since it started.
+struct StreamCounters
+{
+	/// Pairs handed over by the processing thread, and pairs it skipped because the stream thread
+	/// was still busy.
+	uint64_t submitted;
+	uint64_t skipped;
+
+	uint64_t encoded;
+
+	/// Pairs fully written to a client, and pairs a client skipped because it was still receiving
+	/// an earlier one, summed over the clients.
+	uint64_t sent;
+	uint64_t dropped;
+
+	/// Connections accepted.
+	uint64_t clients;
+};
+
+/// Live stream of the stereo pairs as MJPEG over HTTP, viewed with e.g. a browser or
+/// 'ffplay http://<robot>:8090/'.
+///
+/// The processing thread only copies a pair into a single slot when the stream thread is idle and
+/// the stream period has elapsed, as for the preview. The stream thread encodes the pair once with
+/// libjpeg, then writes it to every client through non-blocking sockets. A client still receiving
+/// an earlier pair gets the newest one once done and skips those in between, so that a slow client
+/// only lowers its own frame rate.
+class StreamOutput
+	: public co::ProcessUnit
+	, public StereoSink
+{
+	using Clock = std::chrono::steady_clock;
+	using Chunk = std::shared_ptr<const std::string>;
+
+	struct Client
+	{
+		int32_t socket;
+
+		/// Bytes of 'sending' already written, and newest pair waiting for it to complete.
+		Chunk sending;
+		size_t offset;
+		Chunk next;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	StreamOutput( const StreamParams& params, const ThreadRoleParams& placement );
+
+	~StreamOutput();
+
+	/// Listens to the configured address and starts the stream thread, returns false if the
+	/// address can not be bound.
+	bool start();
+
+	void stop();
+
+	/// Port listened to, the one chosen by the system when the configured port is 0.
+	uint16_t get_port() const;
+
+	StreamCounters get_counters() const;
+
+	/// Hands a pair over to the stream thread, never waits for it, skips it if the thread is busy.
+	virtual bool submit( const StereoFrame& frame ) final;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+private:
+	void process();
+
+	/// Accepts the pending connections, closes those over the client limit.
+	void accept_clients();
+
+	/// Encodes the pair of the slot into a chunk of one or two multipart images.
+	Chunk encode();
+
+	/// Appends an image of the slot pair to a chunk, returns false if it could not be encoded.
+	bool append_image( const cv::Mat& image, const char* view, std::string& chunk );
+
+	/// Hands a chunk to every client, those still sending keep it for later.
+	void broadcast( const Chunk& chunk );
+
+	/// Writes as much of the pending chunks of a client as its socket takes, returns false if the
+	/// client is gone.
+	bool send_to( Client& client );
+
+	/// Reads and discards what a client sends, returns false if it closed the connection.
+	bool receive_from( Client& client );
+
+	void report( const Clock::time_point& now );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const StreamParams params_;
+	const ThreadRoleParams placement_;
+
+	int32_t listener_;
+	int32_t wakeup_;
+	uint16_t port_;
+
+	std::mutex mutex_;
+	std::thread thread_;
+	std::atomic<bool> running_;
+	bool pending_;
+
+	/// Copy of the last submitted pair, owned by the stream thread while pending_ is set.
+	StereoFrame slot_;
+
+	cv::Mat left_;
+	cv::Mat right_;
+	cv::Mat sideBySide_;
+	cv::Mat rgb_;
+	std::vector<uint8_t> jpeg_;
+
+	/// Response header, the first chunk of every client.
+	const Chunk header_;
+	std::vector<Client> clients_;
+
+	Clock::time_point lastSubmit_;
+	Clock::time_point lastReport_;
+
+	std::atomic<uint64_t> submitted_;
+	std::atomic<uint64_t> skipped_;
+	std::atomic<uint64_t> encoded_;
+	std::atomic<uint64_t> sent_;
+	std::atomic<uint64_t> dropped_;
+	std::atomic<uint64_t> clientCount_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // STREAMOUTPUT_HPP
@@ -0,0 +1,64 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef THREADPLACEMENT_HPP
+#define THREADPLACEMENT_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+
+#include <pthread.h>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// CPU affinity, real-time priority and memory locking of the pipeline threads.
+///
+/// Threads created after a placement is applied inherit both the affinity and the scheduling
+/// policy of their creator, which is how the importer's own read thread gets placed.
+class ThreadPlacement
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	/// Applies a role to a thread, returns false if any part of it was refused, typically
+	/// SCHED_FIFO without CAP_SYS_NICE.
+	static bool apply( const pthread_t thread, const ThreadRoleParams& role );
+
+	static bool apply_to_current_thread( const ThreadRoleParams& role );
+
+	/// Restores the default time-sharing policy and lets the calling thread run on every CPU.
+	static bool reset_current_thread();
+
+	/// Locks the current and future pages of the process in RAM.
+	static bool lock_memory();
+
+	static bool unlock_memory();
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // THREADPLACEMENT_HPP
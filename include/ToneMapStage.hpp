@@ -0,0 +1,127 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef TONEMAPSTAGE_HPP
+#define TONEMAPSTAGE_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "Core/COProcessUnit.hpp"
+
+#include "CaptureConfig.hpp"
+#include "StereoFrame.hpp"
+
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+class WorkerPool;
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Maps the wide dynamic range of the HDR sensor output onto a stable 8 bits contrast.
+///
+/// A single curve is computed for both images of a pair, from the contrast-limited equalization of
+/// their sampled luminance histogram, mixed with the identity and smoothed over time. The curve is
+/// applied to every channel through a lookup table. Both the histograms and the table lookups are
+/// split into row bands run on a WorkerPool, every buffer is allocated at the first pair.
+class ToneMapper
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ToneMapper( const ToneMapParams& params );
+
+	~ToneMapper();
+
+	/// Tone maps an 8 bits pair into 'dst', on the pool if there is one.
+	void process( const StereoFrame& src, StereoFrame& dst, WorkerPool* pool );
+
+	/// Lookup table applied to the last pair.
+	const cv::Mat& get_lut() const;
+
+private:
+	/// Adds the sampled luminance of rows [firstRow, lastRow) of an image to a histogram.
+	void accumulate( const cv::Mat& image, const int32_t firstRow, const int32_t lastRow,
+	                 uint32_t* histogram ) const;
+
+	/// Updates the smoothed curve and the lookup table from the merged histogram.
+	void update_curve();
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ToneMapParams params_;
+
+	/// One histogram per image and band, then the merged histogram.
+	std::vector<uint32_t> histograms_;
+	std::vector<double> curve_;
+	cv::Mat lut_;
+	bool hasCurve_;
+};
+
+/// Tone maps the demosaiced pairs and hands them over to StereoSink consumers such as the preview.
+///
+/// The pairs forwarded to the outputs of the stage are left untouched, the recording keeps the
+/// sensor output. Behind a RoiStage it receives the windowed pairs as a StereoSink.
+class ToneMapStage
+	: public co::ProcessUnit
+	, public StereoSink
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ToneMapStage( const ToneMapParams& params, WorkerPool& pool );
+
+	~ToneMapStage();
+
+	/// Adds a consumer of the tone-mapped pairs.
+	void add_sink( StereoSink& sink );
+
+	/// Tone maps a pair and hands it over to the consumers, returns false if any of them failed.
+	virtual bool submit( const StereoFrame& frame ) final;
+
+	/// Prints the number of pairs tone mapped and their average cost.
+	void print_report() const;
+
+	virtual bool compute_result( co::ParamContext& context, const co::OutputResult& inResult ) final;
+
+	virtual bool query_output_metrics( co::OutputMetrics& outputMetrics ) final;
+
+	virtual bool query_output_format( co::OutputFormat& outputFormat ) final;
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ToneMapParams params_;
+	WorkerPool& pool_;
+
+	ToneMapper mapper_;
+	StereoFrame mapped_;
+	std::vector<StereoSink*> sinks_;
+
+	uint64_t frames_;
+	double timeInUs_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+#endif  // TONEMAPSTAGE_HPP
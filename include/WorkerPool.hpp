@@ -0,0 +1,128 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//==================================================================================================
+// F O R W A R D   D E C L A R A T I O N S
+
+//==================================================================================================
+// C O N S T A N T S
+
+//==================================================================================================
+// C L A S S E S
+
+/// Fixed set of threads running submitted tasks, shared by every stage that needs parallelism.
+///
+/// Every worker has its own queue. A task submitted by a worker goes to the queue of that worker,
+/// other tasks are spread over the queues in turn. A worker runs the oldest task of its queue and
+/// steals the oldest task of another queue once its own is empty, so the queues never contend on
+/// a single lock and a worker left with long tasks is relieved by the idle ones.
+class WorkerPool
+{
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	using Task = std::function<void()>;
+
+	/// Starts 'workers' threads, one per cpu if 0, all placed according to 'placement'.
+	WorkerPool( const uint32_t workers, const ThreadRoleParams& placement );
+
+	~WorkerPool();
+
+	size_t size() const;
+
+	/// Index of the calling worker in [0, size()), size() for a thread outside of the pool.
+	size_t get_worker_index() const;
+
+	void submit( Task task );
+
+	/// Waits until every submitted task has completed.
+	void wait_idle();
+
+	/// Calls body( i ) for every i of [0, count) on the workers and on the calling thread, and
+	/// returns once all calls have completed. The calling thread takes its share of the items, so
+	/// a task running on the pool may use it without waiting for busy workers.
+	void parallel_for( const size_t count, const std::function<void( size_t )>& body );
+
+private:
+	void work( const size_t index );
+
+	/// Takes the oldest task of the queue of a worker, else steals one from the other queues.
+	bool pop( const size_t index, Task& task );
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const ThreadRoleParams placement_;
+
+	std::vector<std::unique_ptr<Queue>> queues_;
+
+	/// Tasks waiting in the queues, and tasks submitted but not completed yet.
+	std::atomic<size_t> queued_;
+	std::atomic<size_t> pending_;
+	std::atomic<size_t> nextQueue_;
+
+	/// Only guards the sleep of the idle workers and of wait_idle.
+	std::mutex mutex_;
+	std::condition_variable taskCondition_;
+	std::condition_variable idleCondition_;
+	bool running_;
+
+	std::vector<std::thread> threads_;
+};
+
+
+//==================================================================================================
+// I N L I N E   F U N C T I O N S   C O D E   S E C T I O N
+
+/// Runs a parallel_for on the pool, or sequentially on the calling thread when there is none.
+inline void
+parallel_for( WorkerPool* pool, const size_t count, const std::function<void( size_t )>& body )
+{
+	if( pool != nullptr )
+	{
+		pool->parallel_for( count, body );
+		return;
+	}
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		body( i );
+	}
+}
+
+#endif  // WORKERPOOL_HPP
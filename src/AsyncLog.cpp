@@ -0,0 +1,354 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "AsyncLog.hpp"
+#include "ThreadPlacement.hpp"
+
+#include "HTLogger.h"
+#include "CLPrint.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Sleep of flush() between two checks of the rings.
+const std::chrono::milliseconds FLUSH_PERIOD{ 1 };
+
+template<typename T>
+T
+read_value( const LogRecord& record, size_t& offset )
+{
+	T value;
+	std::memcpy( &value, record.payload + offset, sizeof( value ) );
+	offset += sizeof( value );
+	return value;
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+std::atomic<AsyncLog*> AsyncLog::current_{ nullptr };
+std::atomic<uint64_t> AsyncLog::generations_{ 0 };
+
+thread_local uint64_t AsyncLog::cachedGeneration_{ 0 };
+thread_local AsyncLog::Producer* AsyncLog::cachedProducer_{ nullptr };
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+AsyncLog::AsyncLog( const LogParams& params, const ThreadRoleParams& placement )
+	: params_{ params }
+	, placement_{ placement }
+	, generation_{ ++generations_ }
+	, previous_{ current_.load( std::memory_order_acquire ) }
+	, mutex_{ }
+	, producers_{ }
+	, draining_{ }
+	, running_{ params.async }
+	, thread_{ }
+{
+	if( running_ )
+	{
+		thread_ = std::thread( &AsyncLog::process, this );
+	}
+
+	current_.store( this, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+AsyncLog::~AsyncLog()
+{
+	current_.store( previous_, std::memory_order_release );
+
+	running_ = false;
+	if( thread_.joinable() )
+	{
+		thread_.join();
+	}
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+AsyncLog::flush()
+{
+	for( ;; )
+	{
+		bool pending{ false };
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			for( const auto& producer : producers_ )
+			{
+				pending = pending || producer->popped.load( std::memory_order_acquire ) !=
+				                     producer->pushed.load( std::memory_order_acquire );
+			}
+		}
+
+		if( !pending || !running_ )
+		{
+			return;
+		}
+		std::this_thread::sleep_for( FLUSH_PERIOD );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+uint64_t
+AsyncLog::get_dropped() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	uint64_t dropped{ };
+	for( const auto& producer : producers_ )
+	{
+		dropped += producer->dropped.load( std::memory_order_relaxed );
+	}
+	return dropped;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+AsyncLog::ProducerDeleter::operator()( Producer* producer ) const
+{
+	producer->~Producer();
+	std::free( producer );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+AsyncLog::append_text( LogRecord& record, const char* text, const size_t length )
+{
+	const size_t header{ 1 + sizeof( uint16_t ) };
+	if( record.size + header >= LOG_PAYLOAD_SIZE )
+	{
+		record.truncated = true;
+		return;
+	}
+
+	const size_t available{ LOG_PAYLOAD_SIZE - record.size - header };
+	const uint16_t size{ static_cast<uint16_t>( std::min( length, available ) ) };
+	record.truncated = record.truncated || size < length;
+
+	record.payload[record.size] = static_cast<uint8_t>( LogRecord::Type::Text );
+	std::memcpy( record.payload + record.size + 1, &size, sizeof( size ) );
+	std::memcpy( record.payload + record.size + header, text, size );
+	record.size = static_cast<uint16_t>( record.size + header + size );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+AsyncLog::submit( const LogRecord& record )
+{
+	AsyncLog* log = current_.load( std::memory_order_acquire );
+	if( log == nullptr || !log->running_ )
+	{
+		write( record );
+		return;
+	}
+
+	Producer* producer = log->get_producer();
+	if( producer == nullptr )
+	{
+		write( record );
+		return;
+	}
+
+	// Only this thread writes the counters of its producer, a load and a store is enough.
+	LogRecord copy = record;
+	if( producer->ring.try_push( std::move( copy ) ) )
+	{
+		producer->pushed.store( producer->pushed.load( std::memory_order_relaxed ) + 1,
+		                        std::memory_order_release );
+	}
+	else
+	{
+		producer->dropped.store( producer->dropped.load( std::memory_order_relaxed ) + 1,
+		                         std::memory_order_relaxed );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+AsyncLog::write( const LogRecord& record )
+{
+	std::ostringstream line;
+	line.precision( 6 );
+
+	size_t offset{ 0 };
+	while( offset < record.size )
+	{
+		const LogRecord::Type type = static_cast<LogRecord::Type>( record.payload[offset++] );
+		switch( type )
+		{
+			case LogRecord::Type::Signed:
+				line << read_value<int64_t>( record, offset );
+				break;
+			case LogRecord::Type::Unsigned:
+				line << read_value<uint64_t>( record, offset );
+				break;
+			case LogRecord::Type::Real:
+				line << read_value<double>( record, offset );
+				break;
+			case LogRecord::Type::Boolean:
+				line << read_value<bool>( record, offset );
+				break;
+			case LogRecord::Type::Character:
+				line << read_value<char>( record, offset );
+				break;
+			case LogRecord::Type::Text:
+			{
+				const uint16_t size = read_value<uint16_t>( record, offset );
+				line.write( reinterpret_cast<const char*>( record.payload + offset ), size );
+				offset += size;
+				break;
+			}
+		}
+	}
+
+	if( record.truncated )
+	{
+		line << "...";
+	}
+
+	if( record.level == LogLevel::Warning )
+	{
+		ht::log_warning( line.str() );
+	}
+	else
+	{
+		cl::print_line( line.str() );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+AsyncLog::Producer*
+AsyncLog::get_producer()
+{
+	if( cachedGeneration_ == generation_ )
+	{
+		return cachedProducer_;
+	}
+
+	// First call of this thread through this instance, or first since a nested instance was
+	// destroyed, a thread keeps a single ring per instance.
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	Producer* producer{ nullptr };
+	for( const auto& iter : producers_ )
+	{
+		if( iter->thread == std::this_thread::get_id() )
+		{
+			producer = iter.get();
+		}
+	}
+
+	if( producer == nullptr )
+	{
+		void* memory{ nullptr };
+		if( ::posix_memalign( &memory, CACHE_LINE_SIZE, sizeof( Producer ) ) != 0 )
+		{
+			return nullptr;
+		}
+
+		producer = new( memory ) Producer{ params_.queueRecords };
+		producers_.emplace_back( producer );
+	}
+
+	cachedGeneration_ = generation_;
+	cachedProducer_ = producer;
+	return cachedProducer_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+AsyncLog::process()
+{
+	ThreadPlacement::apply_to_current_thread( placement_ );
+
+	while( running_ )
+	{
+		if( !drain() )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( params_.pollPeriodInMs ) );
+		}
+	}
+
+	drain();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+AsyncLog::drain()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		draining_.clear();
+		for( const auto& producer : producers_ )
+		{
+			draining_.push_back( producer.get() );
+		}
+	}
+
+	bool drained{ false };
+	LogRecord record;
+
+	for( Producer* producer : draining_ )
+	{
+		while( producer->ring.try_pop( record ) )
+		{
+			write( record );
+			producer->popped.store( producer->popped.load( std::memory_order_relaxed ) + 1,
+			                        std::memory_order_release );
+			drained = true;
+		}
+
+		const uint64_t dropped = producer->dropped.load( std::memory_order_relaxed );
+		if( dropped != producer->reported )
+		{
+			ht::log_warning( std::to_string( dropped - producer->reported ) +
+			                 " log records dropped, the log queue is full" );
+			producer->reported = dropped;
+		}
+	}
+
+	return drained;
+}
@@ -0,0 +1,505 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "BatchReprocessor.hpp"
+#include "ClassMapStage.hpp"
+#include "WorkerPool.hpp"
+
+#include "Importer/IMImporter.hpp"
+
+#include "HTLogger.h"
+#include "CLFileSystem.h"
+#include "CLPrint.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstdio>
+#include <sstream>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Frames in flight per worker, enough to keep every worker busy while the oldest frames commit.
+const size_t FRAMES_PER_WORKER{ 4 };
+
+/// Committed frames between two saves of the progress file.
+const size_t PROGRESS_PERIOD{ 16 };
+
+const char* const EXPOSURE_HEADER{ "index,timestamp,left_mean,left_dark,left_bright,"
+                                   "right_mean,right_dark,right_bright" };
+
+/// Statistics fields of a frame that failed, left empty.
+const char* const EMPTY_EXPOSURE{ ",,,,,," };
+
+/// Rectifies the colour pair in place with the calibration of the session of the frame, if any.
+class RectifyPass
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	RectifyPass()
+		: rectifier_{ }
+		, rectified_{ }
+	{ }
+
+	~RectifyPass()
+	{ }
+
+	void set_rectifier( const StereoRectifier* rectifier )
+	{
+		rectifier_ = rectifier;
+	}
+
+	bool process( PipelineFrame& frame )
+	{
+		if( rectifier_ == nullptr )
+		{
+			return true;
+		}
+
+		for( size_t view = 0; view < 2; ++view )
+		{
+			const cv::Mat& image = frame.colour[view];
+			rectified_[view].create( image.size(), image.type() );
+			rectifier_->rectify( view, image, rectified_[view], 0, image.rows );
+			cv::swap( frame.colour[view], rectified_[view] );
+		}
+		return true;
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	const StereoRectifier* rectifier_;
+	cv::Mat rectified_[2];
+};
+
+/// Class map of the left colour image, when enabled.
+class ClassMapPass
+{
+//--Methods-----------------------------------------------------------------------------------------
+public:
+	ClassMapPass()
+		: classifier_{ }
+		, classMap_{ }
+	{ }
+
+	~ClassMapPass()
+	{ }
+
+	void enable( const ClassMapParams& params )
+	{
+		classifier_.reset( new ChannelClassifier{ params } );
+	}
+
+	bool is_enabled() const
+	{
+		return classifier_ != nullptr;
+	}
+
+	const cv::Mat& get_class_map() const
+	{
+		return classMap_;
+	}
+
+	bool process( PipelineFrame& frame )
+	{
+		if( classifier_ )
+		{
+			classifier_->process( frame.colour[0], classMap_, nullptr );
+		}
+		return true;
+	}
+
+//--Data members------------------------------------------------------------------------------------
+private:
+	std::unique_ptr<ChannelClassifier> classifier_;
+	cv::Mat classMap_;
+};
+
+void
+add_exposure( const ExposureStatistics& exposure, std::ostream& row )
+{
+	row << "," << exposure.mean << "," << exposure.dark << "," << exposure.bright;
+}
+
+/// Writes an image as a png tagged like the recorded pairs.
+bool
+write_image( const std::string& folderPath, const StereoFrame& frame, const std::string& suffix,
+             const cv::Mat& image )
+{
+	std::string filepath;
+	return im::AsyncImporter::generate_filename( folderPath, "", frame.index, frame.timestamp,
+	                                             suffix, "png", filepath ) &&
+	       cv::imwrite( filepath, image );
+}
+
+}
+
+/// Fixed topology of the reprocessing, the exposure statistics are computed on the raw levels
+/// during the demosaicing sweep.
+struct BatchPipeline
+	: public StaticPipeline<FusedPass<DemosaicPass, ExposurePass>, RectifyPass, ClassMapPass>
+{ };
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+BatchReprocessor::BatchReprocessor( const BatchParams& params, const ClassMapParams& classMap,
+                                    WorkerPool& pool )
+	: params_{ params }
+	, classMapParams_{ classMap }
+	, pool_{ pool }
+	, sessions_{ }
+	, contexts_{ }
+	, mutex_{ }
+	, condition_{ }
+	, inFlight_{ }
+	, elapsed_{ }
+{
+	for( size_t i = 0; i < pool_.size(); ++i )
+	{
+		contexts_.emplace_back( new Context{ } );
+		contexts_.back()->pipeline.reset( new BatchPipeline{ } );
+		if( params_.classMap )
+		{
+			contexts_.back()->pipeline->get<2>().enable( classMapParams_ );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+BatchReprocessor::~BatchReprocessor()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BatchReprocessor::run( const std::function<bool()>& stopped )
+{
+	const Clock::time_point start = Clock::now();
+	const size_t window{ FRAMES_PER_WORKER * pool_.size() };
+	bool opened{ true };
+
+	for( const std::string& folderPath : params_.sessions )
+	{
+		if( stopped() )
+		{
+			break;
+		}
+
+		sessions_.emplace_back( new Session{ folderPath, params_.periodInUs } );
+		Session& session = *sessions_.back();
+
+		if( !open_session( session ) )
+		{
+			ht::log_warning( "unable to open session " + folderPath );
+			opened = false;
+			continue;
+		}
+
+		for( size_t position = session.first; position < session.replay.size(); ++position )
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			condition_.wait( lock, [ this, window ]()
+			{ return inFlight_ < window; } );
+
+			if( stopped() )
+			{
+				break;
+			}
+			++inFlight_;
+			lock.unlock();
+
+			Session* target = &session;
+			pool_.submit( [ this, target, position ]()
+			{ process( *target, position ); } );
+		}
+	}
+
+	pool_.wait_idle();
+	elapsed_ = Clock::now() - start;
+
+	for( std::unique_ptr<Session>& session : sessions_ )
+	{
+		if( session->end == Clock::time_point{ } )
+		{
+			session->end = Clock::now();
+		}
+		if( session->next > session->first )
+		{
+			write_progress( *session );
+		}
+		session->csv.close();
+	}
+
+	return opened;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BatchReprocessor::open_session( Session& session )
+{
+	const std::string& folderPath = session.replay.get_folder_path();
+	session.outputPath = folderPath + "/" + params_.output;
+	session.start = Clock::now();
+
+	if( !session.replay.open() )
+	{
+		return false;
+	}
+	cl::filesystem::folder_create( session.outputPath );
+
+	session.first = params_.resume ? resume_session( session ) : 0;
+	session.next = session.first;
+
+	if( params_.exposure && !session.csv.is_open() )
+	{
+		session.csv.open( session.outputPath + "/" + BATCH_EXPOSURE_FILE,
+		                  std::ios::out | std::ios::trunc );
+		session.csv << EXPOSURE_HEADER << "\n";
+	}
+
+	if( params_.rectify && session.first < session.replay.size() &&
+	    session.rectifier.load( folderPath + "/" + STEREO_CALIB_FILE ) )
+	{
+		// The remap tables are shared read-only by the workers once prepared for the pair size.
+		StereoFrame frame;
+		if( session.replay.read( session.first, frame ) )
+		{
+			session.rectifier.prepare( frame.left.size() );
+			session.rectified = true;
+		}
+	}
+
+	if( session.first >= session.replay.size() )
+	{
+		session.end = session.start;
+	}
+
+	return !params_.exposure || session.csv.is_open();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+BatchReprocessor::resume_session( Session& session ) const
+{
+	std::ifstream progress{ session.outputPath + "/" + BATCH_PROGRESS_FILE };
+	size_t committed{ };
+	if( !(progress >> committed) )
+	{
+		return 0;
+	}
+	committed = std::min( committed, session.replay.size() );
+
+	if( !params_.exposure )
+	{
+		return committed;
+	}
+
+	// Rows written after the last save of the progress file are dropped and computed again.
+	const std::string filepath{ session.outputPath + "/" + BATCH_EXPOSURE_FILE };
+	std::vector<std::string> lines;
+	{
+		std::ifstream csv{ filepath };
+		std::string line;
+		while( lines.size() <= committed && std::getline( csv, line ) )
+		{
+			lines.push_back( line );
+		}
+	}
+
+	if( lines.empty() )
+	{
+		return 0;
+	}
+	committed = lines.size() - 1;
+
+	session.csv.open( filepath, std::ios::out | std::ios::trunc );
+	for( const std::string& line : lines )
+	{
+		session.csv << line << "\n";
+	}
+
+	return committed;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BatchReprocessor::process( Session& session, const size_t position )
+{
+	Context& context = *contexts_[pool_.get_worker_index()];
+	BatchPipeline& pipeline = *context.pipeline;
+	const StereoFrame& frame = context.frame.raw;
+	std::ostringstream row;
+
+	pipeline.get<1>().set_rectifier( session.rectified ? &session.rectifier : nullptr );
+
+	const bool read{ session.replay.read( position, context.frame.raw ) };
+	bool success{ read && pipeline.process( context.frame ) };
+
+	// A failed frame still gets its row, the resume counts one row per frame.
+	if( params_.exposure )
+	{
+		if( read )
+		{
+			row << frame.index << "," << frame.timestamp;
+		}
+		else
+		{
+			row << ",";
+		}
+
+		if( success )
+		{
+			add_exposure( context.frame.exposure[0], row );
+			add_exposure( context.frame.exposure[1], row );
+		}
+		else
+		{
+			row << EMPTY_EXPOSURE;
+		}
+	}
+
+	if( success )
+	{
+		const ClassMapPass& classMap = pipeline.get<2>();
+		if( params_.writeImages )
+		{
+			success = write_image( session.outputPath, frame, "l", context.frame.colour[0] ) &&
+			          write_image( session.outputPath, frame, "r", context.frame.colour[1] ) &&
+			          (!classMap.is_enabled() ||
+			           write_image( session.outputPath, frame, "c", classMap.get_class_map() ));
+		}
+	}
+
+	commit( session, position, success, row.str() );
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		--inFlight_;
+	}
+	condition_.notify_one();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BatchReprocessor::commit( Session& session, const size_t position, const bool success,
+                          const std::string& row )
+{
+	std::lock_guard<std::mutex> lock( session.mutex );
+
+	++session.processed;
+	if( !success )
+	{
+		++session.failed;
+	}
+
+	session.waiting[position] = row;
+
+	auto iter = session.waiting.begin();
+	while( iter != session.waiting.end() && iter->first == session.next )
+	{
+		if( session.csv.is_open() && !iter->second.empty() )
+		{
+			session.csv << iter->second << "\n";
+		}
+
+		iter = session.waiting.erase( iter );
+		++session.next;
+
+		if( (session.next - session.first) % PROGRESS_PERIOD == 0 )
+		{
+			write_progress( session );
+		}
+	}
+
+	if( session.next == session.replay.size() )
+	{
+		session.end = Clock::now();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BatchReprocessor::write_progress( Session& session ) const
+{
+	if( !session.replay.size() )
+	{
+		return;
+	}
+
+	// The rows must be on disk before the progress file counts them.
+	session.csv.flush();
+
+	const std::string filepath{ session.outputPath + "/" + BATCH_PROGRESS_FILE };
+	{
+		std::ofstream progress{ filepath + ".tmp", std::ios::out | std::ios::trunc };
+		progress << session.next << std::endl;
+	}
+
+	if( std::rename( (filepath + ".tmp").c_str(), filepath.c_str() ) != 0 )
+	{
+		ht::log_warning( "unable to save the progress of " + session.replay.get_folder_path() );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BatchReprocessor::print_report() const
+{
+	const double seconds{ std::chrono::duration<double>( elapsed_ ).count() };
+	size_t total{ };
+
+	for( const std::unique_ptr<Session>& session : sessions_ )
+	{
+		const double sessionSeconds{ std::chrono::duration<double>(
+			session->end - session->start ).count() };
+
+		cl::print_line( "  ", session->replay.get_folder_path(), ": ", session->processed,
+		                " frames processed, ", session->first, " skipped, ", session->failed,
+		                " failed, ", session->replay.size() - session->next, " left, ",
+		                sessionSeconds > 0.0 ? static_cast<double>( session->processed ) /
+		                                       sessionSeconds : 0.0, " fps" );
+
+		total += session->processed;
+	}
+
+	cl::print_line( "  total: ", total, " frames in ", seconds, " s, ",
+	                seconds > 0.0 ? static_cast<double>( total ) / seconds : 0.0, " fps on ",
+	                pool_.size(), " workers" );
+}
@@ -0,0 +1,1452 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "BenchmarkSuite.hpp"
+#include "AsyncLog.hpp"
+#include "CaptureRig.hpp"
+#include "ClassExtraction.hpp"
+#include "ClassMapStage.hpp"
+#include "DisparityStage.hpp"
+#include "FrameRing.hpp"
+#include "FrameStore.hpp"
+#include "FrameTelemetry.hpp"
+#include "MultiLevelThreshold.hpp"
+#include "RawContainer.hpp"
+#include "RawPacking.hpp"
+#include "RoiStage.hpp"
+#include "RigScheduler.hpp"
+#include "SessionReplay.hpp"
+#include "StaticPipeline.hpp"
+#include "StreamOutput.hpp"
+#include "ThreadPlacement.hpp"
+#include "ToneMapStage.hpp"
+#include "WorkerPool.hpp"
+
+#include "HTLogger.h"
+#include "CLFileSystem.h"
+#include "CLPrint.hpp"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/// Size of the synthetic frames, the BlueFox resolution.
+const int32_t SYNTHETIC_WIDTH{ 752 };
+const int32_t SYNTHETIC_HEIGHT{ 480 };
+
+/// Number of distinct synthetic frames, the benchmarks cycle over them.
+const size_t SYNTHETIC_FRAMES{ 16 };
+
+/// Duration of every pass of the multi-rig benchmark.
+const auto RIGS_PASS_DURATION = std::chrono::seconds( 3 );
+
+/// Number of store calls the latency percentiles of the storage benchmark are computed over.
+const size_t STORAGE_LATENCY_WINDOW{ 1 << 16 };
+
+const double BYTES_PER_MB{ 1024.0 * 1024.0 };
+
+/// Handles in flight of the handoff benchmark, period of its paced pass and handles of its unpaced
+/// pass.
+const size_t HANDOFF_CAPACITY{ 16 };
+const auto HANDOFF_PERIOD = std::chrono::milliseconds( 1 );
+const auto HANDOFF_TIMEOUT = std::chrono::milliseconds( 100 );
+const size_t HANDOFF_ITEMS{ 1 << 20 };
+
+/// The slow client of the stream benchmark reads an image every this many frame periods, through a
+/// receive buffer small enough for the stream to notice.
+const uint32_t STREAM_SLOW_FACTOR{ 3 };
+const int32_t STREAM_RECEIVE_BUFFER{ 64 * 1024 };
+
+/// Longest wait for the clients of the stream benchmark to connect, then for the last pairs to be
+/// sent once the submissions stop.
+const auto STREAM_CONNECT_TIMEOUT = std::chrono::seconds( 2 );
+const auto STREAM_DRAIN = std::chrono::milliseconds( 500 );
+
+/// Lines logged per frame by the logging benchmark, in a single burst, and period of the bursts.
+const size_t LOGGING_BURST{ 64 };
+const auto LOGGING_PERIOD = std::chrono::milliseconds( 1 );
+
+double
+elapsed_us( const Clock::time_point& from, const Clock::time_point& to )
+{
+	return static_cast<double>(
+		std::chrono::duration_cast<std::chrono::microseconds>( to - from ).count() );
+}
+
+void
+print_statistics( const std::string& label, RollingStatistics& statistics )
+{
+	cl::print_line( "  ", label, " mean: ", statistics.mean(), " us stddev: ",
+	                statistics.stddev(), " us p99: ", statistics.percentile( 0.99 ),
+	                " us max: ", statistics.maximum(), " us" );
+}
+
+/// Worker counts of the scaling benchmarks, 1, 2, 4... always finishing with one worker per cpu.
+std::vector<uint32_t>
+worker_passes()
+{
+	const uint32_t cpus{ std::max<uint32_t>( std::thread::hardware_concurrency(), 1 ) };
+
+	std::vector<uint32_t> passes;
+	for( uint32_t workers = 1; workers < cpus; workers *= 2 )
+	{
+		passes.push_back( workers );
+	}
+	passes.push_back( cpus );
+
+	return passes;
+}
+
+/// Bursts of per-pair lines through an AsyncLog with the given parameters. The standard output is
+/// sent to /dev/null meanwhile, so that the synchronous figures are those of the formatting and of
+/// the write calls, a lower bound of what a terminal or a log file costs.
+void
+measure_logging( const std::string& label, const LogParams& params, const size_t count )
+{
+	RollingStatistics callCost{ count * LOGGING_BURST };
+	RollingStatistics burstCost{ count };
+	uint64_t dropped{ };
+
+	std::cout.flush();
+	const int32_t console = ::dup( STDOUT_FILENO );
+	const int32_t null = ::open( "/dev/null", O_WRONLY | O_CLOEXEC );
+	if( console < 0 || null < 0 || ::dup2( null, STDOUT_FILENO ) < 0 )
+	{
+		ht::log_warning( "unable to redirect the standard output" );
+		::close( console );
+		::close( null );
+		return;
+	}
+
+	{
+		AsyncLog log{ params, ThreadRoleParams{ } };
+		Clock::time_point deadline = Clock::now();
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			deadline += LOGGING_PERIOD;
+			std::this_thread::sleep_until( deadline );
+
+			const Clock::time_point burst = Clock::now();
+			for( size_t line = 0; line < LOGGING_BURST; ++line )
+			{
+				// Calls last well under a microsecond, elapsed_us() would round them to zero.
+				const Clock::time_point start = Clock::now();
+				AsyncLog::print_line( "pair ", i, " line ", line, ": ",
+				                      1e3 / static_cast<double>( line + 1 ), " us" );
+				callCost.add( std::chrono::duration<double, std::micro>(
+					Clock::now() - start ).count() );
+			}
+			burstCost.add( elapsed_us( burst, Clock::now() ) );
+		}
+
+		log.flush();
+		dropped = log.get_dropped();
+	}
+
+	std::cout.flush();
+	::dup2( console, STDOUT_FILENO );
+	::close( console );
+	::close( null );
+
+	cl::print_line( " ", label, ", ", dropped, " lines dropped" );
+	print_statistics( "call time", callCost );
+	print_statistics( "burst time", burstCost );
+}
+
+/// Frame handle of the handoff benchmark, stamped by the producer.
+struct Handoff
+{
+	std::shared_ptr<const StereoFrame> frame;
+	Clock::time_point sent;
+};
+
+/// Deque guarded by a mutex and a condition variable, the locking of the cm::BitmapCache between
+/// the importer thread and the capture loop, with the interface of a FrameRing.
+template<typename T>
+class LockedHandoff
+{
+public:
+	explicit LockedHandoff( const size_t capacity )
+		: capacity_{ capacity }
+		, items_{ }
+		, mutex_{ }
+		, condition_{ }
+	{ }
+
+	bool try_push( T&& item )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			if( items_.size() >= capacity_ )
+			{
+				return false;
+			}
+			items_.push_back( std::move( item ) );
+		}
+		condition_.notify_one();
+		return true;
+	}
+
+	bool try_pop( T& item )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		return take( item );
+	}
+
+	template<typename Rep, typename Period>
+	bool pop( T& item, const std::chrono::duration<Rep, Period>& timeout )
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		condition_.wait_for( lock, timeout, [ this ]()
+		{ return !items_.empty(); } );
+		return take( item );
+	}
+
+private:
+	bool take( T& item )
+	{
+		if( items_.empty() )
+		{
+			return false;
+		}
+		item = std::move( items_.front() );
+		items_.pop_front();
+		return true;
+	}
+
+	const size_t capacity_;
+	std::deque<T> items_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+};
+
+/// Latency of handles sent at a fixed period to a consumer blocked in pop(), then throughput of
+/// handles sent as fast as both sides can go.
+template<typename Queue>
+void
+measure_handoff( const std::string& label,
+                 const std::vector<std::shared_ptr<const StereoFrame>>& handles,
+                 const size_t count )
+{
+	{
+		Queue queue{ HANDOFF_CAPACITY };
+		RollingStatistics latency{ count };
+
+		std::thread producer( [ & ]()
+		{
+			Clock::time_point deadline = Clock::now();
+			for( size_t i = 0; i < count; ++i )
+			{
+				deadline += HANDOFF_PERIOD;
+				std::this_thread::sleep_until( deadline );
+
+				Handoff handoff{ handles[i % handles.size()], Clock::now() };
+				while( !queue.try_push( std::move( handoff ) ) )
+				{
+					std::this_thread::yield();
+				}
+			}
+		} );
+
+		Handoff received;
+		for( size_t i = 0; i < count; )
+		{
+			if( queue.pop( received, HANDOFF_TIMEOUT ) )
+			{
+				latency.add( elapsed_us( received.sent, Clock::now() ) );
+				++i;
+			}
+		}
+		producer.join();
+
+		print_statistics( label + " paced latency", latency );
+	}
+
+	{
+		Queue queue{ HANDOFF_CAPACITY };
+		const Clock::time_point start = Clock::now();
+
+		std::thread producer( [ & ]()
+		{
+			for( size_t i = 0; i < HANDOFF_ITEMS; ++i )
+			{
+				Handoff handoff{ handles[i % handles.size()], start };
+				while( !queue.try_push( std::move( handoff ) ) )
+				{
+					std::this_thread::yield();
+				}
+			}
+		} );
+
+		Handoff received;
+		for( size_t i = 0; i < HANDOFF_ITEMS; )
+		{
+			if( queue.try_pop( received ) )
+			{
+				++i;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+		producer.join();
+
+		const double seconds{ elapsed_us( start, Clock::now() ) / 1e6 };
+		cl::print_line( "  ", label, " unpaced: ",
+		                static_cast<double>( HANDOFF_ITEMS ) / std::max( seconds, 1e-6 ) / 1e6,
+		                " M handles/s" );
+	}
+}
+
+/// Stage of the dynamic chain of the pipeline benchmark, dispatched like a co::ProcessUnit: a
+/// virtual call per stage then a walk of its null-checked output list.
+class DynamicStage
+{
+public:
+	DynamicStage()
+		: outputs_{ }
+	{ }
+
+	virtual ~DynamicStage()
+	{ }
+
+	void add_output( DynamicStage& output )
+	{
+		outputs_.push_back( &output );
+	}
+
+	bool process( PipelineFrame& frame )
+	{
+		if( !compute_result( frame ) )
+		{
+			return false;
+		}
+
+		for( DynamicStage* output : outputs_ )
+		{
+			if( output )
+			{
+				if( !output->process( frame ) )
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+protected:
+	virtual bool compute_result( PipelineFrame& frame ) = 0;
+
+private:
+	std::vector<DynamicStage*> outputs_;
+};
+
+template<typename Pass>
+class DynamicPass
+	: public DynamicStage
+{
+public:
+	DynamicPass()
+		: pass_{ }
+	{ }
+
+protected:
+	virtual bool compute_result( PipelineFrame& frame ) final
+	{
+		return pass_.process( frame );
+	}
+
+private:
+	Pass pass_;
+};
+
+/// Time per pair of a pipeline over 'count' pairs, the outputs of the last pair are left in
+/// 'frame'. Returns false if a pair failed.
+template<typename Pipeline>
+bool
+measure_pipeline( Pipeline& pipeline, const std::vector<StereoFrame>& frames, const size_t count,
+                  PipelineFrame& frame, RollingStatistics& cost )
+{
+	// The first pair allocates the buffers, it is not timed.
+	frame.raw = frames[0];
+	if( !pipeline.process( frame ) )
+	{
+		return false;
+	}
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		frame.raw = frames[i % frames.size()];
+
+		const Clock::time_point start = Clock::now();
+		if( !pipeline.process( frame ) )
+		{
+			return false;
+		}
+		cost.add( elapsed_us( start, Clock::now() ) );
+	}
+	return true;
+}
+
+/// True if two pipelines computed the same colour pair and exposure statistics.
+bool
+same_outputs( const PipelineFrame& first, const PipelineFrame& second )
+{
+	for( size_t view = 0; view < 2; ++view )
+	{
+		if( first.colour[view].size() != second.colour[view].size() ||
+		    cv::norm( first.colour[view], second.colour[view], cv::NORM_INF ) > 0.0 ||
+		    std::fabs( first.exposure[view].mean - second.exposure[view].mean ) > 1e-9 ||
+		    std::fabs( first.exposure[view].dark - second.exposure[view].dark ) > 1e-9 ||
+		    std::fabs( first.exposure[view].bright - second.exposure[view].bright ) > 1e-9 )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Reads the MJPEG stream of a StreamOutput listening on the loopback until it closes, sleeping
+/// 'delay' after every image. Returns the number of images received.
+size_t
+receive_stream( const uint16_t port, const Clock::duration& delay )
+{
+	const int32_t connection{ ::socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 ) };
+	if( connection < 0 )
+	{
+		return 0;
+	}
+
+	sockaddr_in address{ };
+	address.sin_family = AF_INET;
+	address.sin_port = htons( port );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	const std::string request{ "GET / HTTP/1.0\r\n\r\n" };
+	::setsockopt( connection, SOL_SOCKET, SO_RCVBUF, &STREAM_RECEIVE_BUFFER,
+	              sizeof( STREAM_RECEIVE_BUFFER ) );
+
+	if( ::connect( connection, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) ) != 0 ||
+	    ::send( connection, request.data(), request.size(), MSG_NOSIGNAL ) < 0 )
+	{
+		::close( connection );
+		return 0;
+	}
+
+	const std::string lengthField{ "Content-Length: " };
+	std::string received;
+	std::vector<char> buffer( 1 << 16 );
+	size_t images{ };
+
+	for( ;; )
+	{
+		// Header of the response or of the next image, then the image and its line end.
+		const size_t headerEnd{ received.find( "\r\n\r\n" ) };
+		if( headerEnd != std::string::npos )
+		{
+			const size_t field{ received.find( lengthField ) };
+			if( field == std::string::npos || field > headerEnd )
+			{
+				received.erase( 0, headerEnd + 4 );
+				continue;
+			}
+
+			const size_t length{ std::stoul( received.substr( field + lengthField.size() ) ) };
+			if( received.size() >= headerEnd + 4 + length + 2 )
+			{
+				received.erase( 0, headerEnd + 4 + length + 2 );
+				++images;
+				std::this_thread::sleep_for( delay );
+				continue;
+			}
+		}
+
+		const ssize_t size{ ::recv( connection, buffer.data(), buffer.size(), 0 ) };
+		if( size <= 0 )
+		{
+			break;
+		}
+		received.append( buffer.data(), static_cast<size_t>( size ) );
+	}
+
+	::close( connection );
+	return images;
+}
+
+/// Removes a folder and the files it holds, sub-folders are not expected.
+void
+remove_folder( const std::string& folderPath )
+{
+	DIR* folder = opendir( folderPath.c_str() );
+	if( folder == nullptr )
+	{
+		return;
+	}
+
+	while( dirent* entry = readdir( folder ) )
+	{
+		const std::string name{ entry->d_name };
+		if( name != "." && name != ".." )
+		{
+			::unlink( (folderPath + "/" + name).c_str() );
+		}
+	}
+	closedir( folder );
+
+	::rmdir( folderPath.c_str() );
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+BenchmarkSuite::BenchmarkSuite( const CaptureConfig& config )
+	: config_( config )
+	, frames_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+BenchmarkSuite::~BenchmarkSuite()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run()
+{
+	if( !load_frames() )
+	{
+		return false;
+	}
+
+	bool success{ true };
+
+	for( const std::string& name : config_.benchmark.run )
+	{
+		if( name == "jitter" )
+		{
+			success = run_jitter() && success;
+		}
+		else if( name == "rigs" )
+		{
+			success = run_rigs() && success;
+		}
+		else if( name == "storage" )
+		{
+			success = run_storage() && success;
+		}
+		else if( name == "tonemap" )
+		{
+			success = run_tonemap() && success;
+		}
+		else if( name == "disparity" )
+		{
+			success = run_disparity() && success;
+		}
+		else if( name == "thresholding" )
+		{
+			success = run_thresholding() && success;
+		}
+		else if( name == "classmap" )
+		{
+			success = run_classmap() && success;
+		}
+		else if( name == "handoff" )
+		{
+			success = run_handoff() && success;
+		}
+		else if( name == "pipeline" )
+		{
+			success = run_pipeline() && success;
+		}
+		else if( name == "stream" )
+		{
+			success = run_stream() && success;
+		}
+		else if( name == "logging" )
+		{
+			success = run_logging() && success;
+		}
+		else if( name == "packing" )
+		{
+			success = run_packing() && success;
+		}
+		else if( name == "roi" )
+		{
+			success = run_roi() && success;
+		}
+		else
+		{
+			ht::log_warning( "unknown benchmark: " + name );
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::load_frames()
+{
+	frames_.clear();
+
+	if( !config_.benchmark.session.empty() )
+	{
+		SessionReplay replay{ config_.benchmark.session, config_.benchmark.periodInUs };
+		if( !replay.open() )
+		{
+			ht::log_warning( "no stereo pair found in " + config_.benchmark.session );
+			return false;
+		}
+
+		const size_t count = std::min<size_t>( replay.size(), config_.benchmark.frames );
+		frames_.resize( count );
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			if( !replay.read( i, frames_[i] ) )
+			{
+				ht::log_warning( "unable to read a stereo pair of " + config_.benchmark.session );
+				return false;
+			}
+		}
+
+		cl::print_line( "Benchmarking on ", count, " pairs of ", config_.benchmark.session );
+		return true;
+	}
+
+	frames_.resize( SYNTHETIC_FRAMES );
+
+	for( size_t i = 0; i < SYNTHETIC_FRAMES; ++i )
+	{
+		synthesize( i, SYNTHETIC_WIDTH, SYNTHETIC_HEIGHT, 1.0, frames_[i] );
+		frames_[i].timestamp = i * config_.benchmark.periodInUs;
+	}
+
+	cl::print_line( "Benchmarking on synthetic frames" );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_jitter()
+{
+	cl::print_line( "jitter: ", config_.benchmark.frames, " frames paced at ",
+	                config_.benchmark.periodInUs, " us" );
+
+	measure_jitter( false );
+	measure_jitter( true );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BenchmarkSuite::measure_jitter( const bool placed )
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+	const auto period = std::chrono::microseconds( config_.benchmark.periodInUs );
+
+	RollingStatistics wakeup{ count };
+	RollingStatistics processing{ count };
+	bool applied{ true };
+
+	std::thread worker( [ & ]()
+	{
+		if( placed )
+		{
+			applied = ThreadPlacement::apply_to_current_thread(
+				config_.threads.role( "processing" ) );
+
+			if( config_.threads.lockMemory )
+			{
+				applied = ThreadPlacement::lock_memory() && applied;
+			}
+		}
+		else
+		{
+			ThreadPlacement::reset_current_thread();
+		}
+
+		// The chain of the processing thread: demosaicing then exposure statistics dispatched as
+		// in the co graph, then the tone map when the capture enables it.
+		DynamicPass<DemosaicPass> demosaicStage;
+		DynamicPass<ExposurePass> exposureStage;
+		demosaicStage.add_output( exposureStage );
+
+		ToneMapper toneMapper{ config_.toneMap };
+		PipelineFrame frame;
+		StereoFrame colour;
+		StereoFrame mapped;
+
+		Clock::time_point deadline = Clock::now();
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			deadline += period;
+			std::this_thread::sleep_until( deadline );
+
+			const Clock::time_point start = Clock::now();
+			wakeup.add( elapsed_us( deadline, start ) );
+
+			frame.raw = frames_[i % frames_.size()];
+			if( demosaicStage.process( frame ) && config_.toneMap.enabled )
+			{
+				colour.left = frame.colour[0];
+				colour.right = frame.colour[1];
+				toneMapper.process( colour, mapped, nullptr );
+			}
+
+			processing.add( elapsed_us( start, Clock::now() ) );
+		}
+
+		if( placed && config_.threads.lockMemory )
+		{
+			ThreadPlacement::unlock_memory();
+		}
+	} );
+
+	worker.join();
+
+	cl::print_line( placed ? " placed" : " unplaced",
+	                applied ? "" : " (placement refused, check CAP_SYS_NICE)" );
+	print_statistics( "wake-up latency", wakeup );
+	print_statistics( "frame time     ", processing );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_rigs()
+{
+	const uint32_t cpus{ std::max<uint32_t>( std::thread::hardware_concurrency(), 1 ) };
+
+	RigParams params;
+	params.source = config_.benchmark.session.empty() ? "synthetic" : "replay";
+	params.session = config_.benchmark.session;
+	params.periodInUs = 0;
+	params.record = false;
+
+	cl::print_line( "rigs: ", cpus, " free-running ", params.source, " rigs" );
+
+	for( const uint32_t workers : worker_passes() )
+	{
+		WorkerPool pool{ workers, ThreadRoleParams{ } };
+		RigScheduler scheduler{ pool };
+		std::vector<std::unique_ptr<CaptureRig>> rigs;
+
+		for( uint32_t i = 0; i < cpus; ++i )
+		{
+			params.name = "rig" + std::to_string( i );
+			rigs.emplace_back( new SimulatedRig( params, StorageParams{ }, pool, "" ) );
+
+			if( !rigs.back()->start() )
+			{
+				return false;
+			}
+			scheduler.add_rig( *rigs.back() );
+		}
+
+		const Clock::time_point deadline = Clock::now() + RIGS_PASS_DURATION;
+		scheduler.run( [ & ]()
+		{ return Clock::now() >= deadline; } );
+
+		cl::print_line( " ", workers, " workers" );
+		scheduler.print_report();
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_storage()
+{
+	std::vector<std::string> backends{ "tiff", "direct" };
+#ifdef WITH_IO_URING
+	backends.push_back( "uring" );
+#endif
+
+	cl::print_line( "storage: ", config_.benchmark.storageSeconds, " s of unpaced writes per",
+	                " backend in ", config_.benchmark.storageFolder );
+
+	bool success{ true };
+	for( const std::string& backend : backends )
+	{
+		success = measure_storage( backend ) && success;
+	}
+
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::measure_storage( const std::string& backend )
+{
+	const std::string folderPath{ config_.benchmark.storageFolder + "/storage_" + backend };
+	cl::filesystem::folder_create( folderPath );
+
+	StorageParams params{ config_.storage };
+	params.backend = backend;
+
+	const double pairSizeInMb{ static_cast<double>( 2 * image_size( frames_.front().left ) ) /
+	                           BYTES_PER_MB };
+
+	RollingStatistics latency{ STORAGE_LATENCY_WINDOW };
+	RollingStatistics throughput{ std::max<size_t>( config_.benchmark.storageSeconds, 1 ) };
+	uint64_t pairs{ };
+	double flushInMs{ };
+	bool success{ true };
+
+	{
+		std::unique_ptr<FrameStore> store = make_frame_store( params, folderPath );
+
+		const Clock::time_point deadline = Clock::now() +
+		                                   std::chrono::seconds( config_.benchmark.storageSeconds );
+		Clock::time_point secondStart = Clock::now();
+		uint64_t secondPairs{ };
+
+		while( success && Clock::now() < deadline )
+		{
+			StereoFrame frame = frames_[pairs % frames_.size()];
+			frame.index = pairs;
+			frame.timestamp = pairs * config_.benchmark.periodInUs;
+
+			const Clock::time_point start = Clock::now();
+			success = store->store( frame );
+			const Clock::time_point end = Clock::now();
+
+			latency.add( elapsed_us( start, end ) );
+			++pairs;
+			++secondPairs;
+
+			if( end - secondStart >= std::chrono::seconds( 1 ) )
+			{
+				throughput.add( static_cast<double>( secondPairs ) * pairSizeInMb * 1e6 /
+				                elapsed_us( secondStart, end ) );
+				secondStart = end;
+				secondPairs = 0;
+			}
+		}
+
+		const Clock::time_point start = Clock::now();
+		success = store->flush() && success;
+		flushInMs = elapsed_us( start, Clock::now() ) / 1000.0;
+	}
+
+	remove_folder( folderPath );
+
+	if( !success )
+	{
+		ht::log_warning( "storage benchmark failed on the " + backend + " backend" );
+		return false;
+	}
+
+	cl::print_line( " ", backend, ": ", static_cast<double>( pairs ) * pairSizeInMb, " MB, ",
+	                throughput.mean(), " MB/s mean, ", throughput.minimum(), " min, ",
+	                throughput.stddev(), " stddev, flush ", flushInMs, " ms" );
+	cl::print_line( "  store latency p99.9: ", latency.percentile( 0.999 ), " us" );
+	print_statistics( "store latency", latency );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_tonemap()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+
+	// The stage receives demosaiced pairs, the conversion is kept out of the timings.
+	std::vector<StereoFrame> colourFrames( frames_.size() );
+	for( size_t i = 0; i < frames_.size(); ++i )
+	{
+		colourFrames[i].index = frames_[i].index;
+		colourFrames[i].timestamp = frames_[i].timestamp;
+		demosaic( frames_[i].left, colourFrames[i].left );
+		demosaic( frames_[i].right, colourFrames[i].right );
+	}
+
+	cl::print_line( "tonemap: ", count, " pairs, ", std::max<uint32_t>( config_.toneMap.bands, 1 ),
+	                " bands per image" );
+
+	// 0 stands for the calling thread alone.
+	std::vector<uint32_t> passes{ worker_passes() };
+	passes.insert( passes.begin(), 0 );
+
+	for( const uint32_t workers : passes )
+	{
+		std::unique_ptr<WorkerPool> pool{ workers ? new WorkerPool{ workers, ThreadRoleParams{ } }
+		                                          : nullptr };
+		ToneMapper mapper{ config_.toneMap };
+		StereoFrame mapped;
+		RollingStatistics cost{ count };
+
+		// The first pair allocates the outputs, it is not timed.
+		mapper.process( colourFrames[0], mapped, pool.get() );
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			const Clock::time_point start = Clock::now();
+			mapper.process( colourFrames[i % colourFrames.size()], mapped, pool.get() );
+			cost.add( elapsed_us( start, Clock::now() ) );
+		}
+
+		cl::print_line( workers ? " " + std::to_string( workers ) + " workers"
+		                        : std::string{ " calling thread" } );
+		print_statistics( "pair time", cost );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_disparity()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+	const double budgetInUs{ static_cast<double>( config_.benchmark.periodInUs ) };
+
+	DisparityParams params{ config_.disparity };
+	params.write = false;
+
+	cl::print_line( "disparity: ", count, " pairs, ", params.numDisparities, " disparities, ",
+	                params.windowSize, "x", params.windowSize, " window, ", budgetInUs,
+	                " us per pair available" );
+
+	for( const uint32_t workers : worker_passes() )
+	{
+		WorkerPool pool{ workers, ThreadRoleParams{ } };
+		DisparityStage stage{ params, pool, "" };
+		RollingStatistics cost{ count };
+
+		stage.open();
+
+		// The first pair allocates the cost volumes, it is not timed.
+		stage.process( frames_[0] );
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			const Clock::time_point start = Clock::now();
+			stage.process( frames_[i % frames_.size()] );
+			cost.add( elapsed_us( start, Clock::now() ) );
+		}
+
+		cl::print_line( " ", workers, " workers, ", 1e6 / std::max( cost.mean(), 1.0 ), " fps",
+		                cost.percentile( 0.99 ) > budgetInUs ? ", p99 over the frame period" : "" );
+		print_statistics( "pair time", cost );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_thresholding()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+
+	// Both engines work on the smoothed histogram, which is kept out of the timings.
+	ClassExtraction greedy;
+	std::vector<Histogram> histograms;
+	for( const StereoFrame& frame : frames_ )
+	{
+		cv::Mat grey;
+		to_grey( frame.left, grey );
+
+		Histogram histogram( 256 );
+		histograms.emplace_back( 256 );
+		greedy.smooth_histogram( grey, histogram, histograms.back() );
+	}
+
+	cl::print_line( "thresholding: ", count, " images, greedy Kittler split against the optimal ",
+	                "partition with as many classes" );
+
+	RollingStatistics greedyCost{ count };
+	RollingStatistics kittlerCost{ count };
+	RollingStatistics otsuCost{ count };
+	MultiLevelThreshold kittler{ ThresholdCriterion::Kittler };
+	MultiLevelThreshold otsu{ ThresholdCriterion::Otsu };
+	double greedyCriterion{ };
+	double optimalCriterion{ };
+	size_t classes{ };
+	size_t improved{ };
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		const Histogram& smoothed = histograms[i % histograms.size()];
+		std::vector<uint32_t> greedyThresholds;
+		std::vector<uint32_t> optimalThresholds;
+
+		Clock::time_point start = Clock::now();
+		greedy.greedy_thresholds( smoothed, greedyThresholds );
+		greedyCost.add( elapsed_us( start, Clock::now() ) );
+
+		// The greedy split may find fewer thresholds than it keeps, the optimal partition is
+		// computed with the same number of classes so that the criteria compare.
+		const size_t imageClasses{ greedyThresholds.size() + 1 };
+		const std::vector<uint32_t> bins( smoothed.cbegin(), smoothed.cend() );
+
+		start = Clock::now();
+		kittler.set_histogram( bins );
+		kittler.compute( imageClasses, optimalThresholds );
+		kittlerCost.add( elapsed_us( start, Clock::now() ) );
+
+		start = Clock::now();
+		otsu.set_histogram( bins );
+		otsu.compute( imageClasses, optimalThresholds );
+		otsuCost.add( elapsed_us( start, Clock::now() ) );
+
+		kittler.compute( imageClasses, optimalThresholds );
+
+		const double greedyValue{ kittler.evaluate( greedyThresholds ) };
+		const double optimalValue{ kittler.evaluate( optimalThresholds ) };
+
+		greedyCriterion += greedyValue;
+		optimalCriterion += optimalValue;
+		classes += imageClasses;
+		improved += optimalValue < greedyValue ? 1 : 0;
+	}
+
+	const double images{ static_cast<double>( count ) };
+	cl::print_line( " ", static_cast<double>( classes ) / images, " classes per image, Kittler ",
+	                "criterion greedy: ", greedyCriterion / images, " optimal: ",
+	                optimalCriterion / images, ", lower on ", improved, " of ", count, " images" );
+	print_statistics( "greedy Kittler time", greedyCost );
+	print_statistics( "optimal Kittler time", kittlerCost );
+	print_statistics( "optimal Otsu time", otsuCost );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_classmap()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+	const double budgetInUs{ static_cast<double>( config_.benchmark.periodInUs ) };
+
+	// The stage receives demosaiced pairs, the conversion is kept out of the timings.
+	std::vector<cv::Mat> images( frames_.size() );
+	for( size_t i = 0; i < frames_.size(); ++i )
+	{
+		demosaic( frames_[i].left, images[i] );
+	}
+
+	cl::print_line( "classmap: ", count, " images, ", config_.classMap.colourSpace, ", ",
+	                config_.classMap.classes ? std::to_string( config_.classMap.classes ) + " " +
+	                config_.classMap.criterion + " classes" : std::string{ "greedy Kittler" },
+	                " per channel, ", config_.classMap.tileColumns * config_.classMap.tileRows,
+	                " tiles, ", budgetInUs, " us per pair available" );
+
+	for( const uint32_t workers : worker_passes() )
+	{
+		WorkerPool pool{ workers, ThreadRoleParams{ } };
+		ChannelClassifier classifier{ config_.classMap };
+		cv::Mat classMap;
+		RollingStatistics cost{ count };
+
+		// The first image allocates the buffers, it is not timed.
+		classifier.process( images[0], classMap, &pool );
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			const Clock::time_point start = Clock::now();
+			classifier.process( images[i % images.size()], classMap, &pool );
+			cost.add( elapsed_us( start, Clock::now() ) );
+		}
+
+		cl::print_line( " ", workers, " workers, ", 1e6 / std::max( cost.mean(), 1.0 ), " fps",
+		                cost.percentile( 0.99 ) > budgetInUs ? ", p99 over the frame period" : "" );
+		print_statistics( "image time", cost );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_handoff()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+
+	// The handles share the benchmark frames, a handoff never allocates nor copies pixels.
+	std::vector<std::shared_ptr<const StereoFrame>> handles;
+	for( const StereoFrame& frame : frames_ )
+	{
+		handles.push_back( std::make_shared<const StereoFrame>( frame ) );
+	}
+
+	const auto periodInUs = std::chrono::duration_cast<std::chrono::microseconds>( HANDOFF_PERIOD );
+	cl::print_line( "handoff: ", count, " handles paced at ", periodInUs.count(), " us, then ",
+	                HANDOFF_ITEMS, " unpaced, ", HANDOFF_CAPACITY, " in flight" );
+
+	measure_handoff<LockedHandoff<Handoff>>( "locked", handles, count );
+	measure_handoff<FrameRing<Handoff>>( "ring  ", handles, count );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_pipeline()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+
+	DynamicPass<DemosaicPass> demosaicStage;
+	DynamicPass<ExposurePass> exposureStage;
+	demosaicStage.add_output( exposureStage );
+
+	StaticPipeline<DemosaicPass, ExposurePass> composed;
+	StaticPipeline<FusedPass<DemosaicPass, ExposurePass>> fused;
+
+	cl::print_line( "pipeline: ", count, " pairs demosaiced then exposure statistics, fused in ",
+	                "bands of ", FUSED_BAND_ROWS, " rows" );
+
+	PipelineFrame dynamicFrame;
+	PipelineFrame composedFrame;
+	PipelineFrame fusedFrame;
+	RollingStatistics dynamicCost{ count };
+	RollingStatistics composedCost{ count };
+	RollingStatistics fusedCost{ count };
+
+	if( !measure_pipeline( demosaicStage, frames_, count, dynamicFrame, dynamicCost ) ||
+	    !measure_pipeline( composed, frames_, count, composedFrame, composedCost ) ||
+	    !measure_pipeline( fused, frames_, count, fusedFrame, fusedCost ) )
+	{
+		ht::log_warning( "the pipeline benchmark needs 8 bits pairs" );
+		return false;
+	}
+
+	print_statistics( "dynamic graph pair time", dynamicCost );
+	print_statistics( "composed pair time", composedCost );
+	print_statistics( "fused pair time", fusedCost );
+	cl::print_line( "  saved per pair: composed ", dynamicCost.mean() - composedCost.mean(),
+	                " us, fused ", dynamicCost.mean() - fusedCost.mean(), " us" );
+
+	if( !same_outputs( dynamicFrame, composedFrame ) || !same_outputs( dynamicFrame, fusedFrame ) )
+	{
+		ht::log_warning( "the composed pipelines differ from the dynamic graph" );
+		return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_stream()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+	const auto period = std::chrono::microseconds( config_.benchmark.periodInUs );
+
+	// The configured stream, only reachable from this host on a port chosen by the system.
+	StreamParams params{ config_.stream };
+	params.address = "127.0.0.1";
+	params.port = 0;
+	params.reportPeriodInMs = 0;
+
+	StreamOutput stream{ params, ThreadRoleParams{ } };
+	if( !stream.start() )
+	{
+		return false;
+	}
+
+	cl::print_line( "stream: ", count, " pairs paced at ", period.count(), " us, ", params.layout,
+	                ", to a client reading as fast as it can and to a client reading an image ",
+	                "every ", STREAM_SLOW_FACTOR, " periods" );
+
+	size_t fastImages{ };
+	size_t slowImages{ };
+	std::thread fast( [ & ]()
+	{ fastImages = receive_stream( stream.get_port(), Clock::duration::zero() ); } );
+	std::thread slow( [ & ]()
+	{ slowImages = receive_stream( stream.get_port(), STREAM_SLOW_FACTOR * period ); } );
+
+	const Clock::time_point connectDeadline = Clock::now() + STREAM_CONNECT_TIMEOUT;
+	while( stream.get_counters().clients < 2 && Clock::now() < connectDeadline )
+	{
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+
+	RollingStatistics submitCost{ count };
+	Clock::time_point deadline = Clock::now();
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		deadline += period;
+		std::this_thread::sleep_until( deadline );
+
+		const Clock::time_point start = Clock::now();
+		stream.submit( frames_[i % frames_.size()] );
+		submitCost.add( elapsed_us( start, Clock::now() ) );
+	}
+
+	std::this_thread::sleep_for( STREAM_DRAIN );
+	const StreamCounters counters = stream.get_counters();
+	stream.stop();
+	fast.join();
+	slow.join();
+
+	const size_t views{ params.layout == "separate" ? 2U : 1U };
+	cl::print_line( "  ", counters.encoded, " pairs encoded, ", counters.skipped,
+	                " skipped while the stream thread was busy, ",
+	                count - counters.submitted - counters.skipped, " within the stream period" );
+	cl::print_line( "  fast client: ", fastImages / views, " pairs, slow client: ",
+	                slowImages / views, " pairs, ", counters.dropped, " dropped for it" );
+	print_statistics( "processing thread submit time", submitCost );
+
+	if( fastImages == 0 )
+	{
+		ht::log_warning( "no pair received from the stream on port " +
+		                 std::to_string( stream.get_port() ) );
+		return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_logging()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+
+	const auto periodInUs = std::chrono::duration_cast<std::chrono::microseconds>( LOGGING_PERIOD );
+	cl::print_line( "logging: ", count, " bursts of ", LOGGING_BURST, " lines every ",
+	                periodInUs.count(), " us, ", config_.logging.queueRecords,
+	                " records queued per thread" );
+
+	LogParams params{ config_.logging };
+
+	params.async = false;
+	measure_logging( "synchronous", params, count );
+
+	params.async = true;
+	measure_logging( "asynchronous", params, count );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_packing()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+
+	if( frames_[0].left.type() != CV_8UC1 )
+	{
+		ht::log_warning( "the packing benchmark needs 8 bits raw pairs" );
+		return false;
+	}
+
+	cl::print_line( "packing: ", count, " images of ", frames_[0].left.cols, "x",
+	                frames_[0].left.rows, ", 10 and 12 bits images scaled from the 8 bits frames" );
+
+	for( const uint32_t bits : { 10u, 12u } )
+	{
+		std::vector<cv::Mat> images( frames_.size() );
+		for( size_t i = 0; i < frames_.size(); ++i )
+		{
+			frames_[i].left.convertTo( images[i], CV_16U,
+			                           static_cast<double>( (1u << bits) - 1 ) / 255.0 );
+		}
+
+		const int32_t width{ images[0].cols };
+		const int32_t height{ images[0].rows };
+		std::vector<uint8_t> copied( static_cast<size_t>( image_size( images[0] ) ) );
+		std::vector<uint8_t> packed( static_cast<size_t>( packed_image_size( images[0], bits ) ) );
+		cv::Mat unpacked;
+		cv::Mat reduced;
+		cv::Mat colour;
+
+		RollingStatistics copyCost{ count };
+		RollingStatistics packCost{ count };
+		RollingStatistics unpackCost{ count };
+		RollingStatistics viewCost{ count };
+		RollingStatistics reduceCost{ count };
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			const cv::Mat& image = images[i % images.size()];
+
+			// The store of a full width image, as the container writer copies it.
+			Clock::time_point start = Clock::now();
+			std::memcpy( copied.data(), image.data, copied.size() );
+			copyCost.add( elapsed_us( start, Clock::now() ) );
+
+			start = Clock::now();
+			pack_image( image, bits, packed.data() );
+			packCost.add( elapsed_us( start, Clock::now() ) );
+
+			start = Clock::now();
+			unpack_image( packed.data(), width, height, bits, unpacked );
+			unpackCost.add( elapsed_us( start, Clock::now() ) );
+
+			if( cv::norm( unpacked, image, cv::NORM_INF ) > 0.0 )
+			{
+				ht::log_warning( "unpacked images differ from the packed ones" );
+				return false;
+			}
+
+			// An 8 bits stage reads the high plane in place, or the unpacked image reduced.
+			start = Clock::now();
+			demosaic( packed_msb_view( packed.data(), width, height, bits ), colour );
+			viewCost.add( elapsed_us( start, Clock::now() ) );
+
+			start = Clock::now();
+			unpack_image( packed.data(), width, height, bits, unpacked );
+			unpacked.convertTo( reduced, CV_8U, 1.0 / static_cast<double>( 1u << (bits - 8) ) );
+			demosaic( reduced, colour );
+			reduceCost.add( elapsed_us( start, Clock::now() ) );
+		}
+
+		cl::print_line( " ", bits, " bits: ", packed.size(), " bytes per image instead of ",
+		                copied.size(), ", ", 100 * packed.size() / copied.size(), "%" );
+		print_statistics( "full width copy time", copyCost );
+		print_statistics( "pack time", packCost );
+		print_statistics( "unpack time", unpackCost );
+		print_statistics( "8 bits view demosaic time", viewCost );
+		print_statistics( "unpacked demosaic time", reduceCost );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BenchmarkSuite::run_roi()
+{
+	const size_t count{ std::max<size_t>( config_.benchmark.frames, 1 ) };
+	const int32_t width{ frames_[0].left.cols };
+	const int32_t height{ frames_[0].left.rows };
+
+	if( frames_[0].left.type() != CV_8UC1 )
+	{
+		ht::log_warning( "the roi benchmark needs 8 bits raw pairs" );
+		return false;
+	}
+
+	cl::print_line( "roi: ", count, " pairs of ", width, "x", height );
+
+	StereoFrame colour;
+	RollingStatistics fullCost{ count };
+	for( size_t i = 0; i < count; ++i )
+	{
+		const StereoFrame& frame = frames_[i % frames_.size()];
+
+		const Clock::time_point start = Clock::now();
+		demosaic( frame.left, colour.left );
+		demosaic( frame.right, colour.right );
+		fullCost.add( elapsed_us( start, Clock::now() ) );
+	}
+	print_statistics( "whole frames demosaic time", fullCost );
+
+	for( const bool binning : { false, true } )
+	{
+		RoiParams params = config_.roi;
+		params.enabled = true;
+		params.binning = binning;
+
+		RoiStage stage( params, width, height );
+		const cv::Size size = stage.get_output_size();
+
+		StereoFrame windowed;
+		RollingStatistics windowCost{ count };
+		RollingStatistics demosaicCost{ count };
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			const StereoFrame& frame = frames_[i % frames_.size()];
+
+			Clock::time_point start = Clock::now();
+			if( !stage.process( frame, windowed ) )
+			{
+				ht::log_warning( "the benchmark frames do not contain the region of interest" );
+				return false;
+			}
+			windowCost.add( elapsed_us( start, Clock::now() ) );
+
+			start = Clock::now();
+			demosaic( windowed.left, colour.left );
+			demosaic( windowed.right, colour.right );
+			demosaicCost.add( elapsed_us( start, Clock::now() ) );
+		}
+
+		cl::print_line( binning ? " cropped and binned: " : " cropped: ", size.width, "x",
+		                size.height, ", ", 100 * size.area() / (width * height),
+		                "% of the pixels" );
+		print_statistics( "window time", windowCost );
+		print_statistics( "demosaic time", demosaicCost );
+	}
+
+	return true;
+}
@@ -0,0 +1,479 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "BlackBoxOutput.hpp"
+#include "FrameAccess.hpp"
+#include "RawContainer.hpp"
+#include "ThreadPlacement.hpp"
+
+#include "HTLogger.h"
+#include "CLFileSystem.h"
+#include "CLPrint.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+const uint64_t BYTES_PER_MB{ 1024 * 1024 };
+
+/// Fastest png compression, the encoding runs on the processing thread.
+const std::vector<int32_t> PNG_PARAMS{ CV_IMWRITE_PNG_COMPRESSION, 1 };
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+BlackBoxOutput::BlackBoxOutput( const BlackBoxParams& params, const StorageParams& storage,
+                                const ThreadRoleParams& placement, const std::string& folderPath,
+                                const uint32_t periodInUs )
+	: params_{ params }
+	, storage_{ storage }
+	, placement_{ placement }
+	, folderPath_{ folderPath }
+	, periodInUs_{ std::max<uint64_t>( periodInUs, 1 ) }
+	, compressed_{ params.compression == "png" }
+	, trigger_{ params, folderPath }
+	, ring_{ }
+	, next_{ }
+	, count_{ }
+	, inEvent_{ }
+	, eventEnd_{ }
+	, events_{ }
+	, mutex_{ }
+	, condition_{ }
+	, queue_{ }
+	, spares_{ }
+	, queueLimit_{ }
+	, running_{ }
+	, thread_{ }
+	, written_{ }
+	, dropped_{ }
+	, failed_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+BlackBoxOutput::~BlackBoxOutput()
+{
+	stop();
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::start()
+{
+	if( running_ )
+	{
+		return;
+	}
+
+	if( !trigger_.start() )
+	{
+		ht::log_warning( "some black box triggers are unavailable" );
+	}
+
+	running_ = true;
+	thread_ = std::thread( &BlackBoxOutput::write_loop, this );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::stop()
+{
+	trigger_.stop();
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		running_ = false;
+	}
+	condition_.notify_all();
+
+	if( thread_.joinable() )
+	{
+		thread_.join();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlackBoxOutput::record( const StereoFrame& frame )
+{
+	if( ring_.empty() )
+	{
+		allocate( frame );
+	}
+
+	if( trigger_.consume() )
+	{
+		if( !inEvent_ )
+		{
+			open_event( frame.timestamp );
+			inEvent_ = true;
+		}
+		eventEnd_ = frame.timestamp + params_.postTriggerInMs * 1000ull;
+	}
+
+	if( inEvent_ )
+	{
+		if( frame.timestamp <= eventEnd_ )
+		{
+			Slot slot{ take_spare() };
+			copy_to( frame, slot );
+			enqueue( std::move( slot ) );
+			return true;
+		}
+
+		inEvent_ = false;
+	}
+
+	copy_to( frame, ring_[next_] );
+	next_ = (next_ + 1) % ring_.size();
+	count_ = std::min( count_ + 1, ring_.size() );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlackBoxOutput::submit( const StereoFrame& frame )
+{
+	return record( frame );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::print_report() const
+{
+	cl::print_line( "Black box: ", events_, " events, ", written_, " pairs written, ", dropped_,
+	                " dropped, ", failed_, " failed" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+BlackBoxOutput::get_queue_depth( size_t& limit ) const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	limit = queueLimit_;
+	return queue_.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlackBoxOutput::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) || !record( frame ) )
+	{
+		return false;
+	}
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, inResult ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlackBoxOutput::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlackBoxOutput::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::allocate( const StereoFrame& frame )
+{
+	const uint32_t packedBits{ compressed_ ? 0 : record_packed_bits( frame, storage_.packedBits ) };
+	if( storage_.packedBits && !packedBits )
+	{
+		ht::log_warning( "storage.packed_bits has no effect on the black box, its pairs are "
+		                 "compressed or are not 16 bits raw images" );
+	}
+
+	const uint64_t pairSize{ std::max<uint64_t>(
+		raw_image_size( frame.left, packedBits ) + raw_image_size( frame.right, packedBits ), 1 ) };
+
+	// Compressed pairs are bounded by their raw size, the memory bound holds in both modes.
+	const uint64_t windowPairs{ params_.preTriggerInMs * 1000ull / periodInUs_ + 1 };
+	const uint64_t memoryPairs{ params_.maxMemoryInMb * BYTES_PER_MB / pairSize };
+	const size_t capacity{ static_cast<size_t>(
+		std::max<uint64_t>( std::min( windowPairs, memoryPairs ), 1 ) ) };
+
+	ring_.resize( capacity );
+
+	for( Slot& slot : ring_ )
+	{
+		if( compressed_ )
+		{
+			slot.encodedLeft.reserve( static_cast<size_t>( image_size( frame.left ) ) );
+			slot.encodedRight.reserve( static_cast<size_t>( image_size( frame.right ) ) );
+		}
+		else if( packedBits )
+		{
+			const int32_t rowSize{ static_cast<int32_t>(
+				packed_row_size( static_cast<size_t>( frame.left.cols ), packedBits ) ) };
+			slot.left.create( frame.left.rows, rowSize, CV_8UC1 );
+			slot.right.create( frame.right.rows, rowSize, CV_8UC1 );
+		}
+		else
+		{
+			slot.left.create( frame.left.rows, frame.left.cols, frame.left.type() );
+			slot.right.create( frame.right.rows, frame.right.cols, frame.right.type() );
+		}
+	}
+
+	const uint64_t postPairs{ params_.postTriggerInMs * 1000ull / periodInUs_ + 1 };
+	queueLimit_ = static_cast<size_t>( 2 * (capacity + postPairs) );
+
+	if( windowPairs > memoryPairs )
+	{
+		ht::log_warning( "black box window shortened to fit max_memory_mb" );
+	}
+
+	cl::print_line( "Black box: ", capacity, " pairs (", capacity * periodInUs_ / 1000,
+	                " ms) kept in memory" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::copy_to( const StereoFrame& frame, Slot& slot ) const
+{
+	slot.index = frame.index;
+	slot.timestamp = frame.timestamp;
+	slot.packedBits = compressed_ ? 0 : record_packed_bits( frame, storage_.packedBits );
+	slot.width = frame.left.cols;
+
+	if( compressed_ )
+	{
+		cv::imencode( ".png", frame.left, slot.encodedLeft, PNG_PARAMS );
+		cv::imencode( ".png", frame.right, slot.encodedRight, PNG_PARAMS );
+	}
+	else if( slot.packedBits )
+	{
+		pack_image( frame.left, slot.packedBits, slot.left );
+		pack_image( frame.right, slot.packedBits, slot.right );
+	}
+	else
+	{
+		frame.left.copyTo( slot.left );
+		frame.right.copyTo( slot.right );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::open_event( const uint64_t timestamp )
+{
+	++events_;
+
+	const uint64_t window{ params_.preTriggerInMs * 1000ull };
+	const uint64_t windowStart{ timestamp > window ? timestamp - window : 0 };
+	const size_t oldest{ (next_ + ring_.size() - count_) % ring_.size() };
+
+	for( size_t i = 0; i < count_; ++i )
+	{
+		Slot& slot = ring_[(oldest + i) % ring_.size()];
+
+		if( slot.timestamp >= windowStart )
+		{
+			enqueue( std::move( slot ) );
+
+			// The images now belong to the writer, the slot takes over buffers it handed back.
+			slot = take_spare();
+		}
+	}
+
+	count_ = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::enqueue( Slot&& slot )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+
+		if( queue_.size() >= queueLimit_ )
+		{
+			++dropped_;
+			spares_.push_back( std::move( slot ) );
+			return;
+		}
+
+		queue_.push_back( Pending{ events_ - 1, std::move( slot ) } );
+	}
+	condition_.notify_one();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+BlackBoxOutput::Slot
+BlackBoxOutput::take_spare()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	if( spares_.empty() )
+	{
+		return Slot{ };
+	}
+
+	Slot slot{ std::move( spares_.back() ) };
+	spares_.pop_back();
+
+	return slot;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlackBoxOutput::restore( const Slot& slot, StereoFrame& frame ) const
+{
+	frame.index = slot.index;
+	frame.timestamp = slot.timestamp;
+
+	if( compressed_ )
+	{
+		frame.left = cv::imdecode( slot.encodedLeft, CV_LOAD_IMAGE_UNCHANGED );
+		frame.right = cv::imdecode( slot.encodedRight, CV_LOAD_IMAGE_UNCHANGED );
+	}
+	else if( slot.packedBits )
+	{
+		unpack_image( slot.left.data, slot.width, slot.left.rows, slot.packedBits, frame.left );
+		unpack_image( slot.right.data, slot.width, slot.right.rows, slot.packedBits, frame.right );
+	}
+	else
+	{
+		frame.left = slot.left;
+		frame.right = slot.right;
+	}
+
+	return !frame.left.empty() && !frame.right.empty();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlackBoxOutput::write_loop()
+{
+	ThreadPlacement::apply_to_current_thread( placement_ );
+
+	std::unique_ptr<FrameStore> store;
+	uint32_t event{ };
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+
+	while( true )
+	{
+		condition_.wait( lock, [ this ]()
+		{ return !queue_.empty() || !running_; } );
+
+		if( queue_.empty() )
+		{
+			break;
+		}
+
+		Pending pending{ std::move( queue_.front() ) };
+		queue_.pop_front();
+		lock.unlock();
+
+		if( !store || pending.event != event )
+		{
+			if( store && !store->flush() )
+			{
+				ht::log_warning( "unable to sync the black box event " + std::to_string( event ) );
+			}
+
+			event = pending.event;
+			const std::string eventPath{ folderPath_ + "/event_" + std::to_string( event ) };
+			cl::filesystem::folder_create( eventPath );
+			store = make_frame_store( storage_, eventPath );
+		}
+
+		StereoFrame frame;
+		const bool stored{ restore( pending.slot, frame ) && store->store( frame ) };
+
+		// The store copies the images, the buffers can hold the next pairs.
+		frame = StereoFrame{ };
+
+		lock.lock();
+		spares_.push_back( std::move( pending.slot ) );
+		if( stored )
+		{
+			++written_;
+		}
+		else
+		{
+			++failed_;
+		}
+	}
+
+	lock.unlock();
+
+	if( store && !store->flush() )
+	{
+		ht::log_warning( "unable to sync the black box event " + std::to_string( event ) );
+	}
+}
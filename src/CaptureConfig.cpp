@@ -0,0 +1,346 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureConfig.hpp"
+
+#include <json/json.h>
+
+#include <fstream>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+void
+read_value( const Json::Value& node, const char* key, uint32_t& value )
+{
+	if( node.isMember( key ) )
+	{
+		value = node[key].asUInt();
+	}
+}
+
+void
+read_value( const Json::Value& node, const char* key, int32_t& value )
+{
+	if( node.isMember( key ) )
+	{
+		value = node[key].asInt();
+	}
+}
+
+void
+read_value( const Json::Value& node, const char* key, double& value )
+{
+	if( node.isMember( key ) )
+	{
+		value = node[key].asDouble();
+	}
+}
+
+void
+read_value( const Json::Value& node, const char* key, bool& value )
+{
+	if( node.isMember( key ) )
+	{
+		value = node[key].asBool();
+	}
+}
+
+void
+read_value( const Json::Value& node, const char* key, std::string& value )
+{
+	if( node.isMember( key ) )
+	{
+		value = node[key].asString();
+	}
+}
+
+void
+read_value( const Json::Value& node, const char* key, std::vector<uint32_t>& values )
+{
+	if( node.isMember( key ) )
+	{
+		values.clear();
+		for( const Json::Value& item : node[key] )
+		{
+			values.push_back( item.asUInt() );
+		}
+	}
+}
+
+void
+read_value( const Json::Value& node, const char* key, std::vector<std::string>& values )
+{
+	if( node.isMember( key ) )
+	{
+		values.clear();
+		for( const Json::Value& item : node[key] )
+		{
+			values.push_back( item.asString() );
+		}
+	}
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+CaptureConfig::CaptureConfig()
+	: shutdown{ }
+	, telemetry{ }
+	, logging{ }
+	, threads{ }
+	, roi{ }
+	, preview{ }
+	, stream{ }
+	, toneMap{ }
+	, disparity{ }
+	, classMap{ }
+	, governor{ }
+	, gate{ }
+	, blackBox{ }
+	, storage{ }
+	, multiRig{ }
+	, calibration{ }
+	, batch{ }
+	, benchmark{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+CaptureConfig::~CaptureConfig()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+CaptureConfig::load( const std::string& filepath )
+{
+	std::ifstream file{ filepath };
+	Json::Value root;
+	Json::Reader reader;
+
+	if( !file.is_open() || !reader.parse( file, root ) )
+	{
+		return false;
+	}
+
+	const Json::Value& shutdownNode = root["shutdown"];
+	read_value( shutdownNode, "drain_deadline_ms", shutdown.drainDeadlineInMs );
+	read_value( shutdownNode, "hard_deadline_ms", shutdown.hardDeadlineInMs );
+
+	const Json::Value& telemetryNode = root["telemetry"];
+	read_value( telemetryNode, "enabled", telemetry.enabled );
+	read_value( telemetryNode, "window", telemetry.window );
+	read_value( telemetryNode, "export_period_ms", telemetry.exportPeriodInMs );
+	read_value( telemetryNode, "print", telemetry.print );
+
+	const Json::Value& logNode = root["log"];
+	read_value( logNode, "async", logging.async );
+	read_value( logNode, "queue_records", logging.queueRecords );
+	read_value( logNode, "poll_period_ms", logging.pollPeriodInMs );
+
+	const Json::Value& threadsNode = root["threads"];
+	read_value( threadsNode, "lock_memory", threads.lockMemory );
+	read_value( threadsNode, "workers", threads.workers );
+	for( const std::string& name : threadsNode.getMemberNames() )
+	{
+		if( threadsNode[name].isObject() )
+		{
+			ThreadRoleParams& role = threads.roles[name];
+			read_value( threadsNode[name], "cpus", role.cpus );
+			read_value( threadsNode[name], "priority", role.priority );
+		}
+	}
+
+	const Json::Value& roiNode = root["roi"];
+	read_value( roiNode, "enabled", roi.enabled );
+	read_value( roiNode, "x", roi.x );
+	read_value( roiNode, "y", roi.y );
+	read_value( roiNode, "width", roi.width );
+	read_value( roiNode, "height", roi.height );
+	read_value( roiNode, "binning", roi.binning );
+
+	const Json::Value& previewNode = root["preview"];
+	read_value( previewNode, "enabled", preview.enabled );
+	read_value( previewNode, "decimation", preview.decimation );
+	read_value( previewNode, "period_ms", preview.periodInMs );
+	read_value( previewNode, "display", preview.display );
+	read_value( previewNode, "file", preview.file );
+	read_value( previewNode, "jpeg_quality", preview.jpegQuality );
+	read_value( previewNode, "report_period_ms", preview.reportPeriodInMs );
+
+	const Json::Value& streamNode = root["stream"];
+	read_value( streamNode, "enabled", stream.enabled );
+	read_value( streamNode, "address", stream.address );
+	read_value( streamNode, "port", stream.port );
+	read_value( streamNode, "layout", stream.layout );
+	read_value( streamNode, "decimation", stream.decimation );
+	read_value( streamNode, "period_ms", stream.periodInMs );
+	read_value( streamNode, "jpeg_quality", stream.jpegQuality );
+	read_value( streamNode, "max_clients", stream.maxClients );
+	read_value( streamNode, "send_buffer_kb", stream.sendBufferInKb );
+	read_value( streamNode, "report_period_ms", stream.reportPeriodInMs );
+
+	const Json::Value& toneMapNode = root["tone_map"];
+	read_value( toneMapNode, "enabled", toneMap.enabled );
+	read_value( toneMapNode, "clip_limit", toneMap.clipLimit );
+	read_value( toneMapNode, "strength", toneMap.strength );
+	read_value( toneMapNode, "smoothing", toneMap.smoothing );
+	read_value( toneMapNode, "sample_step", toneMap.sampleStep );
+	read_value( toneMapNode, "bands", toneMap.bands );
+	read_value( toneMapNode, "print_benchmark", toneMap.printBenchmark );
+
+	const Json::Value& disparityNode = root["disparity"];
+	read_value( disparityNode, "enabled", disparity.enabled );
+	read_value( disparityNode, "calibration", disparity.calibration );
+	read_value( disparityNode, "min_disparity", disparity.minDisparity );
+	read_value( disparityNode, "num_disparities", disparity.numDisparities );
+	read_value( disparityNode, "window_size", disparity.windowSize );
+	read_value( disparityNode, "uniqueness_ratio", disparity.uniquenessRatio );
+	read_value( disparityNode, "lr_tolerance", disparity.lrTolerance );
+	read_value( disparityNode, "bands", disparity.bands );
+	read_value( disparityNode, "write", disparity.write );
+	read_value( disparityNode, "print_benchmark", disparity.printBenchmark );
+
+	const Json::Value& classMapNode = root["class_map"];
+	read_value( classMapNode, "enabled", classMap.enabled );
+	read_value( classMapNode, "colour_space", classMap.colourSpace );
+	read_value( classMapNode, "classes", classMap.classes );
+	read_value( classMapNode, "criterion", classMap.criterion );
+	read_value( classMapNode, "sample_step", classMap.sampleStep );
+	read_value( classMapNode, "tile_columns", classMap.tileColumns );
+	read_value( classMapNode, "tile_rows", classMap.tileRows );
+	read_value( classMapNode, "bands", classMap.bands );
+	read_value( classMapNode, "write", classMap.write );
+	read_value( classMapNode, "print_benchmark", classMap.printBenchmark );
+
+	const Json::Value& governorNode = root["governor"];
+	read_value( governorNode, "enabled", governor.enabled );
+	read_value( governorNode, "budget_us", governor.budgetInUs );
+	read_value( governorNode, "high_ratio", governor.highRatio );
+	read_value( governorNode, "low_ratio", governor.lowRatio );
+	read_value( governorNode, "smoothing", governor.smoothing );
+	read_value( governorNode, "hold_frames", governor.holdFrames );
+	read_value( governorNode, "print", governor.print );
+	const Json::Value& stagesNode = governorNode["stages"];
+	for( const std::string& name : stagesNode.getMemberNames() )
+	{
+		GovernedStageParams& stage = governor.stages[name];
+		read_value( stagesNode[name], "priority", stage.priority );
+		read_value( stagesNode[name], "budget_us", stage.budgetInUs );
+		read_value( stagesNode[name], "sheddable", stage.sheddable );
+		read_value( stagesNode[name], "max_decimation", stage.maxDecimation );
+	}
+
+	const Json::Value& gateNode = root["gate"];
+	read_value( gateNode, "enabled", gate.enabled );
+	read_value( gateNode, "grid_width", gate.gridWidth );
+	read_value( gateNode, "grid_height", gate.gridHeight );
+	read_value( gateNode, "step", gate.step );
+	read_value( gateNode, "mean_threshold", gate.meanThreshold );
+	read_value( gateNode, "block_threshold", gate.blockThreshold );
+	read_value( gateNode, "max_interval_ms", gate.maxIntervalInMs );
+
+	const Json::Value& blackBoxNode = root["black_box"];
+	read_value( blackBoxNode, "enabled", blackBox.enabled );
+	read_value( blackBoxNode, "pre_trigger_ms", blackBox.preTriggerInMs );
+	read_value( blackBoxNode, "post_trigger_ms", blackBox.postTriggerInMs );
+	read_value( blackBoxNode, "max_memory_mb", blackBox.maxMemoryInMb );
+	read_value( blackBoxNode, "compression", blackBox.compression );
+	read_value( blackBoxNode, "trigger_file", blackBox.triggerFile );
+	read_value( blackBoxNode, "socket_path", blackBox.socketPath );
+
+	const Json::Value& storageNode = root["storage"];
+	read_value( storageNode, "backend", storage.backend );
+	read_value( storageNode, "queue_depth", storage.queueDepth );
+	read_value( storageNode, "preallocate_mb", storage.preallocateInMb );
+	read_value( storageNode, "packed_bits", storage.packedBits );
+
+	const Json::Value& multiRigNode = root["multi_rig"];
+	read_value( multiRigNode, "workers", multiRig.workers );
+	if( multiRigNode.isMember( "rigs" ) )
+	{
+		multiRig.rigs.clear();
+		for( const Json::Value& rigNode : multiRigNode["rigs"] )
+		{
+			RigParams rig;
+			read_value( rigNode, "name", rig.name );
+			read_value( rigNode, "source", rig.source );
+			read_value( rigNode, "device", rig.device );
+			read_value( rigNode, "session", rig.session );
+			read_value( rigNode, "period_us", rig.periodInUs );
+			read_value( rigNode, "target_grey", rig.targetGrey );
+			read_value( rigNode, "record", rig.record );
+
+			if( rig.name.empty() )
+			{
+				rig.name = "rig" + std::to_string( multiRig.rigs.size() );
+			}
+			multiRig.rigs.push_back( rig );
+		}
+	}
+
+	const Json::Value& calibrationNode = root["calibration"];
+	read_value( calibrationNode, "session", calibration.session );
+	read_value( calibrationNode, "pattern", calibration.pattern );
+	read_value( calibrationNode, "columns", calibration.columns );
+	read_value( calibrationNode, "rows", calibration.rows );
+	read_value( calibrationNode, "square_size", calibration.squareSize );
+	read_value( calibrationNode, "frames", calibration.frames );
+	read_value( calibrationNode, "period_ms", calibration.periodInMs );
+	read_value( calibrationNode, "step", calibration.step );
+	read_value( calibrationNode, "max_views", calibration.maxViews );
+	read_value( calibrationNode, "workers", calibration.workers );
+	read_value( calibrationNode, "output", calibration.output );
+
+	const Json::Value& batchNode = root["batch"];
+	read_value( batchNode, "sessions", batch.sessions );
+	read_value( batchNode, "output", batch.output );
+	read_value( batchNode, "workers", batch.workers );
+	read_value( batchNode, "period_us", batch.periodInUs );
+	read_value( batchNode, "rectify", batch.rectify );
+	read_value( batchNode, "exposure", batch.exposure );
+	read_value( batchNode, "class_map", batch.classMap );
+	read_value( batchNode, "write_images", batch.writeImages );
+	read_value( batchNode, "resume", batch.resume );
+
+	const Json::Value& benchmarkNode = root["benchmark"];
+	read_value( benchmarkNode, "run", benchmark.run );
+	read_value( benchmarkNode, "session", benchmark.session );
+	read_value( benchmarkNode, "frames", benchmark.frames );
+	read_value( benchmarkNode, "period_us", benchmark.periodInUs );
+	read_value( benchmarkNode, "storage_folder", benchmark.storageFolder );
+	read_value( benchmarkNode, "storage_seconds", benchmark.storageSeconds );
+
+	return true;
+}
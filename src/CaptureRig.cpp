@@ -0,0 +1,475 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "CaptureRig.hpp"
+#include "WorkerPool.hpp"
+
+#include "IO/IOBlueFoxStereoCalib.hpp"
+
+#include "HTLogger.h"
+
+#include <algorithm>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Size of the synthetic frames, the BlueFox resolution.
+const int32_t SYNTHETIC_WIDTH{ 752 };
+const int32_t SYNTHETIC_HEIGHT{ 480 };
+
+/// Fraction of the exposure error corrected by every frame of a synthetic rig.
+const double EXPOSURE_DAMPING{ 0.25 };
+
+const double MIN_GAIN{ 0.05 };
+const double MAX_GAIN{ 4.0 };
+
+/// Row bands of a pair per worker of the pool, a few so that a slow band is relieved by stealing.
+const size_t BANDS_PER_WORKER{ 2 };
+
+co::OutputMetrics
+make_output_metrics( const io::BlueFox::Params& blueFoxParams )
+{
+	vm::Size size{ blueFoxParams.width, blueFoxParams.height };
+	cl::Rect2u32 roi{ 0, 0, size.width(), size.height() };
+	return co::OutputMetrics{ size, roi };
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+CaptureRig::CaptureRig( const RigParams& params, const std::string& folderPath )
+	: params_{ params }
+	, folderPath_{ folderPath }
+	, counters_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+CaptureRig::~CaptureRig()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+BlueFoxRig::BlueFoxRig( const RigParams& params, const io::BlueFox::Params& blueFoxParams,
+                        const StorageParams& storage, const std::string& folderPath )
+	: CaptureRig( params, folderPath )
+	, importer_{ im::unique_bluefox_stereo_importer( blueFoxParams ) }
+	, bitmapCache_{ }
+	, om_{ make_output_metrics( blueFoxParams ) }
+	, output_{ folderPath, storage }
+	, demosaicingFilter_{ }
+	, exposureFilter_{ }
+	, entry_{ }
+{
+	this->add_output( output_ );
+
+	demosaicingFilter_.prepare_filter( om_ );
+	this->add_output( demosaicingFilter_ );
+
+	exposureFilter_.prepare_filter( om_ );
+	demosaicingFilter_.add_output( exposureFilter_ );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+BlueFoxRig::~BlueFoxRig()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+SimulatedRig::SimulatedRig( const RigParams& params, const StorageParams& storage,
+                            WorkerPool& pool, const std::string& folderPath )
+	: CaptureRig( params, folderPath )
+	, storage_{ storage }
+	, pool_( pool )
+	, replay_{ params.session, params.periodInUs }
+	, store_{ }
+	, startTime_{ }
+	, nextIndex_{ }
+	, running_{ }
+	, pendingIndex_{ }
+	, frame_{ }
+	, demosaicPasses_( std::max<size_t>( pool.size(), 1 ) * BANDS_PER_WORKER )
+	, greys_( demosaicPasses_.size() )
+	, sums_( demosaicPasses_.size(), 0.0 )
+	, gain_{ 1.0 }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+SimulatedRig::~SimulatedRig()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+const RigParams&
+CaptureRig::get_params() const
+{
+	return params_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const std::string&
+CaptureRig::get_folder_path() const
+{
+	return folderPath_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const CaptureCounters&
+CaptureRig::get_counters() const
+{
+	return counters_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CaptureRig::count_frame( const uint64_t index, const bool success )
+{
+	if( !counters_.hasIndex )
+	{
+		counters_.firstIndex = index;
+		counters_.lastIndex = index;
+		counters_.hasIndex = true;
+	}
+
+	counters_.firstIndex = std::min( counters_.firstIndex, index );
+	counters_.lastIndex = std::max( counters_.lastIndex, index );
+
+	if( success )
+	{
+		++counters_.processed;
+	}
+	else
+	{
+		++counters_.failed;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CaptureRig::count_discarded()
+{
+	++counters_.discarded;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::start()
+{
+	io::BlueFoxStereoCalib calibrationParams;
+	calibrationParams.load_from_stereo_rig( *importer_ );
+	calibrationParams.save_to_file( get_folder_path(), "capture" );
+
+	importer_->open( get_params().device );
+	importer_->start_async_read( bitmapCache_ );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlueFoxRig::stop()
+{
+	importer_->stop_async_read();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+BlueFoxRig::close()
+{
+	importer_->close();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::acquire()
+{
+	return bitmapCache_.wait_for_new_entry( 0 ) && bitmapCache_.pop_newest_entry( entry_ );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::process()
+{
+	co::OutputResult result{ om_ };
+	co::ParamContext ctx( bitmapCache_ );
+
+	result.add_cache_entries( entry_->get_cache_id(), entry_ );
+
+	const bool success = compute_result( ctx, result );
+	if( success )
+	{
+		importer_->set_exposure_overshoot( exposureFilter_.get_greylevel_diff() );
+	}
+
+	const cm::BitmapPairEntry::ID* id = dynamic_cast<cm::BitmapPairEntry::ID*>(
+		&(*entry_->get_cache_id()) );
+
+	if( id )
+	{
+		count_frame( id->get_index(), success );
+	}
+
+	entry_.reset();
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::flush()
+{
+	return output_.flush();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::compute_result( co::ParamContext& context, const co::OutputResult& result )
+{
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, result ) )
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::query_output_metrics( co::OutputMetrics& om )
+{
+	cl::ignore( om );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+BlueFoxRig::query_output_format( co::OutputFormat& of )
+{
+	cl::ignore( of );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SimulatedRig::start()
+{
+	if( get_params().source == "replay" && !replay_.open() )
+	{
+		ht::log_warning( "no stereo pair found in " + get_params().session );
+		return false;
+	}
+
+	if( get_params().record )
+	{
+		store_ = make_frame_store( storage_, get_folder_path() );
+	}
+
+	startTime_ = Clock::now();
+	nextIndex_ = 0;
+	running_ = true;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+SimulatedRig::stop()
+{
+	// The simulated camera keeps no pair of its own, nothing is left to drain.
+	running_ = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+SimulatedRig::close()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SimulatedRig::acquire()
+{
+	const uint64_t periodInUs{ get_params().periodInUs };
+
+	if( !running_ )
+	{
+		return false;
+	}
+
+	if( periodInUs == 0 )
+	{
+		pendingIndex_ = nextIndex_++;
+		return true;
+	}
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		Clock::now() - startTime_ );
+
+	// Index of the newest frame the simulated camera has produced so far.
+	const uint64_t newest{ static_cast<uint64_t>( elapsed.count() ) / periodInUs };
+	if( newest < nextIndex_ )
+	{
+		return false;
+	}
+
+	pendingIndex_ = newest;
+	nextIndex_ = newest + 1;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SimulatedRig::process()
+{
+	StereoFrame& raw = frame_.raw;
+
+	if( replay_.size() > 0 )
+	{
+		if( !replay_.read( static_cast<size_t>( pendingIndex_ % replay_.size() ), raw ) )
+		{
+			count_frame( pendingIndex_, false );
+			return false;
+		}
+	}
+	else
+	{
+		synthesize( pendingIndex_, SYNTHETIC_WIDTH, SYNTHETIC_HEIGHT, gain_, raw );
+	}
+
+	// The replay loops over the session, indexes keep increasing like those of a camera.
+	raw.index = pendingIndex_;
+	raw.timestamp = pendingIndex_ * get_params().periodInUs;
+
+	if( !demosaicPasses_[0].prepare( frame_ ) )
+	{
+		count_frame( pendingIndex_, false );
+		return false;
+	}
+
+	// Called on a worker of the pool, which takes its share of the bands.
+	parallel_for( &pool_, demosaicPasses_.size(), [ this ]( const size_t band )
+	{
+		process_band( band );
+	} );
+
+	update_exposure();
+
+	const bool success{ !store_ || store_->store( raw ) };
+	count_frame( pendingIndex_, success );
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+SimulatedRig::process_band( const size_t band )
+{
+	// Even band heights keep the Bayer layout of every band.
+	const int32_t rows{ std::max( frame_.raw.left.rows, frame_.raw.right.rows ) };
+	const int32_t bands{ static_cast<int32_t>( demosaicPasses_.size() ) };
+	const int32_t height{ ((rows + bands - 1) / bands + 1) & ~1 };
+	const int32_t begin{ std::min( static_cast<int32_t>( band ) * height, rows ) };
+	const int32_t end{ std::min( begin + height, rows ) };
+
+	sums_[band] = 0.0;
+	if( begin >= end )
+	{
+		return;
+	}
+
+	demosaicPasses_[band].process_rows( frame_, begin, end );
+
+	const cv::Mat& left = frame_.colour[0];
+	if( begin < left.rows )
+	{
+		cv::cvtColor( left.rowRange( begin, std::min( end, left.rows ) ), greys_[band],
+		              CV_BGR2GRAY );
+		sums_[band] = cv::sum( greys_[band] )[0];
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SimulatedRig::flush()
+{
+	return !store_ || store_->flush();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+SimulatedRig::update_exposure()
+{
+	const cv::Mat& left = frame_.colour[0];
+	const double pixels{ static_cast<double>( std::max( left.rows * left.cols, 1 ) ) };
+
+	double sum{ };
+	for( const double bandSum : sums_ )
+	{
+		sum += bandSum;
+	}
+
+	const double mean{ sum / pixels };
+	if( mean < 1.0 || replay_.size() > 0 )
+	{
+		// A replayed session can not be re-exposed, only synthetic frames close the loop.
+		return;
+	}
+
+	const double correction{ get_params().targetGrey / mean - 1.0 };
+	gain_ *= 1.0 + EXPOSURE_DAMPING * correction;
+	gain_ = std::min( MAX_GAIN, std::max( MIN_GAIN, gain_ ) );
+}
@@ -0,0 +1,640 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "ClassMapStage.hpp"
+#include "AsyncLog.hpp"
+#include "FrameAccess.hpp"
+#include "WorkerPool.hpp"
+
+#include "Importer/IMImporter.hpp"
+
+#include "CLPrint.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+const size_t LEVELS{ 256 };
+
+/// Largest number of thresholds of a channel.
+const size_t MAX_THRESHOLDS{ MAX_CHANNEL_CLASSES - 1 };
+
+/// Levels merged into every bin of the tile histograms before thresholding. A tile holds a few
+/// thousand samples, and 64 bins make its search 16 times cheaper than 256 levels.
+const size_t TILE_BIN_LEVELS{ 4 };
+const size_t TILE_BINS{ LEVELS / TILE_BIN_LEVELS };
+
+/// cvtColor code of a colour space, -1 for the excess green. The full range hue uses the 256
+/// levels of its channel.
+int32_t
+conversion_code( const std::string& colourSpace )
+{
+	if( colourSpace == "lab" )
+	{
+		return CV_BGR2Lab;
+	}
+	if( colourSpace == "exg" )
+	{
+		return -1;
+	}
+	return CV_BGR2HSV_FULL;
+}
+
+ThresholdCriterion
+threshold_criterion( const std::string& criterion )
+{
+	return criterion == "otsu" ? ThresholdCriterion::Otsu : ThresholdCriterion::Kittler;
+}
+
+/// Lower of the two tiles a pixel is interpolated between along one dimension and the weight of
+/// the upper one, the pixels beyond the outer tile centres only get the outer tile.
+void
+interpolation_tile( const int32_t position, const int32_t length, const size_t tiles,
+                    size_t& tile, float& weight )
+{
+	const float coordinate{ (static_cast<float>( position ) + 0.5f) * static_cast<float>( tiles ) /
+	                        static_cast<float>( length ) - 0.5f };
+
+	if( coordinate <= 0.0f )
+	{
+		tile = 0;
+		weight = 0.0f;
+	}
+	else if( coordinate >= static_cast<float>( tiles - 1 ) )
+	{
+		tile = tiles - 1;
+		weight = 0.0f;
+	}
+	else
+	{
+		tile = static_cast<size_t>( coordinate );
+		weight = coordinate - static_cast<float>( tile );
+	}
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+ChannelClassifier::ChannelClassifier( const ClassMapParams& params )
+	: params_{ params }
+	, conversion_{ conversion_code( params.colourSpace ) }
+	, channels_{ conversion_ < 0 ? 1u : 3u }
+	, bands_{ std::max<uint32_t>( params.bands, 1 ) }
+	, tileColumns_{ params.tileRows ? params.tileColumns : 0 }
+	, tileRows_{ params.tileColumns ? params.tileRows : 0 }
+	, regions_{ tileColumns_ ? tileColumns_ * tileRows_ : bands_ }
+	, size_{ }
+	, converted_{ }
+	, histograms_( (regions_ + 1) * channels_ * LEVELS, 0 )
+	, extractions_( channels_, ClassExtraction{ std::min( params.classes, MAX_CHANNEL_CLASSES ),
+	                                            threshold_criterion( params.criterion ) } )
+	, thresholds_( channels_ )
+	, labels_( channels_ * LEVELS, 0 )
+	, tileEngines_( tileRows_ * channels_,
+	                MultiLevelThreshold{ threshold_criterion( params.criterion ) } )
+	, tileResults_( tileRows_ * channels_ )
+	, tileThresholds_( tileColumns_ * tileRows_ * channels_ * MAX_THRESHOLDS, 0.0f )
+	, columnTiles_{ }
+	, columnWeights_{ }
+	, rowThresholds_( bands_ * (tileColumns_ + 1) * channels_ * MAX_THRESHOLDS, 0.0f )
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ChannelClassifier::~ChannelClassifier()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ClassMapStage::ClassMapStage( const ClassMapParams& params, WorkerPool& pool,
+                              const uint32_t periodInUs, const std::string& folderPath )
+	: params_{ params }
+	, pool_( pool )
+	, periodInUs_{ static_cast<double>( periodInUs ) }
+	, folderPath_{ folderPath }
+	, classifier_{ params }
+	, classMap_{ }
+	, frames_{ }
+	, failed_{ }
+	, late_{ }
+	, timeInUs_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ClassMapStage::~ClassMapStage()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::process( const cv::Mat& image, cv::Mat& classMap, WorkerPool* pool )
+{
+	const int32_t rows{ image.rows };
+	const size_t setSize{ channels_ * LEVELS };
+
+	allocate( image.size() );
+	classMap.create( image.size(), CV_8UC1 );
+
+	std::fill( histograms_.begin(), histograms_.end(), 0 );
+
+	// A region is converted then sampled while its pixels are still in cache.
+	parallel_for( pool, regions_, [ & ]( const size_t region )
+	{
+		const cv::Rect rect{ get_region( region ) };
+		if( rect.area() > 0 )
+		{
+			convert( image, rect );
+			accumulate( rect, &histograms_[region * setSize] );
+		}
+	} );
+
+	uint32_t* const merged{ &histograms_[regions_ * setSize] };
+	for( size_t region = 0; region < regions_; ++region )
+	{
+		const uint32_t* const histograms{ &histograms_[region * setSize] };
+		for( size_t level = 0; level < setSize; ++level )
+		{
+			merged[level] += histograms[level];
+		}
+	}
+
+	parallel_for( pool, channels_, [ & ]( const size_t channel )
+	{
+		Histogram histogram( LEVELS );
+		std::copy( merged + channel * LEVELS, merged + (channel + 1) * LEVELS,
+		           histogram.begin() );
+
+		std::vector<uint32_t>& thresholds = thresholds_[channel];
+		extractions_[channel].histogram_thresholds( histogram, thresholds );
+		thresholds.resize( std::min( thresholds.size(), MAX_THRESHOLDS ) );
+
+		// The class of a level is the number of thresholds at or below it.
+		uint32_t weight{ 1 };
+		for( size_t i = 0; i < channel; ++i )
+		{
+			weight *= MAX_CHANNEL_CLASSES;
+		}
+
+		uint8_t* const labels{ &labels_[channel * LEVELS] };
+		for( size_t level = 0; level < LEVELS; ++level )
+		{
+			const auto above = std::upper_bound( thresholds.cbegin(), thresholds.cend(), level );
+			labels[level] = static_cast<uint8_t>( (above - thresholds.cbegin()) * weight );
+		}
+	} );
+
+	const auto band_rows = [ this, rows ]( const size_t band, int32_t& firstRow, int32_t& lastRow )
+	{
+		firstRow = static_cast<int32_t>( band * static_cast<size_t>( rows ) / bands_ );
+		lastRow = static_cast<int32_t>( (band + 1) * static_cast<size_t>( rows ) / bands_ );
+	};
+
+	if( tileColumns_ == 0 )
+	{
+		parallel_for( pool, bands_, [ & ]( const size_t band )
+		{
+			int32_t firstRow{ };
+			int32_t lastRow{ };
+			band_rows( band, firstRow, lastRow );
+			label( firstRow, lastRow, classMap );
+		} );
+		return;
+	}
+
+	// The tiles get as many thresholds as the whole image so that they can be interpolated.
+	parallel_for( pool, tileRows_ * channels_, [ & ]( const size_t item )
+	{
+		threshold_tiles( item / channels_, item % channels_ );
+	} );
+
+	parallel_for( pool, bands_, [ & ]( const size_t band )
+	{
+		int32_t firstRow{ };
+		int32_t lastRow{ };
+		band_rows( band, firstRow, lastRow );
+		label_tiles( band, firstRow, lastRow, classMap );
+	} );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+ChannelClassifier::get_channels() const
+{
+	return channels_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const std::vector<uint32_t>&
+ChannelClassifier::get_thresholds( const size_t channel ) const
+{
+	return thresholds_[channel];
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::allocate( const cv::Size& size )
+{
+	if( size == size_ )
+	{
+		return;
+	}
+
+	converted_.create( size, CV_8UC( static_cast<int32_t>( channels_ ) ) );
+
+	if( tileColumns_ > 0 )
+	{
+		const size_t width{ static_cast<size_t>( size.width ) };
+		columnTiles_.resize( width );
+		columnWeights_.resize( width );
+
+		for( size_t x = 0; x < width; ++x )
+		{
+			size_t tile{ };
+			interpolation_tile( static_cast<int32_t>( x ), size.width, tileColumns_, tile,
+			                    columnWeights_[x] );
+			columnTiles_[x] = static_cast<uint16_t>( tile );
+		}
+	}
+
+	size_ = size;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+cv::Rect
+ChannelClassifier::get_region( const size_t region ) const
+{
+	const size_t width{ static_cast<size_t>( size_.width ) };
+	const size_t height{ static_cast<size_t>( size_.height ) };
+
+	if( tileColumns_ == 0 )
+	{
+		const int32_t firstRow{ static_cast<int32_t>( region * height / bands_ ) };
+		const int32_t lastRow{ static_cast<int32_t>( (region + 1) * height / bands_ ) };
+		return cv::Rect( 0, firstRow, size_.width, lastRow - firstRow );
+	}
+
+	const size_t column{ region % tileColumns_ };
+	const size_t row{ region / tileColumns_ };
+	const int32_t left{ static_cast<int32_t>( column * width / tileColumns_ ) };
+	const int32_t right{ static_cast<int32_t>( (column + 1) * width / tileColumns_ ) };
+	const int32_t top{ static_cast<int32_t>( row * height / tileRows_ ) };
+	const int32_t bottom{ static_cast<int32_t>( (row + 1) * height / tileRows_ ) };
+
+	return cv::Rect( left, top, right - left, bottom - top );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::convert( const cv::Mat& image, const cv::Rect& region )
+{
+	if( conversion_ >= 0 )
+	{
+		// The destination already has the right size and type, cvtColor writes the region in
+		// place.
+		cv::Mat converted{ converted_( region ) };
+		cv::cvtColor( image( region ), converted, conversion_ );
+		return;
+	}
+
+	// The normalized excess green 2g - r - b is 3g - 1 with g = G / (B + G + R), it is stored as
+	// 255 g, the same classes on a scale using every level.
+	for( int32_t y = region.y; y < region.y + region.height; ++y )
+	{
+		const uint8_t* src = image.ptr<uint8_t>( y ) + 3 * region.x;
+		uint8_t* dst = converted_.ptr<uint8_t>( y ) + region.x;
+
+		for( int32_t x = 0; x < region.width; ++x, src += 3 )
+		{
+			const uint32_t sum{ static_cast<uint32_t>( src[0] ) + src[1] + src[2] };
+			dst[x] = static_cast<uint8_t>( sum ? 255u * src[1] / sum : 85u );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::accumulate( const cv::Rect& region, uint32_t* histograms ) const
+{
+	const int32_t step{ static_cast<int32_t>( std::max<uint32_t>( params_.sampleStep, 1 ) ) };
+	const size_t channels{ channels_ };
+
+	// The sampled pixels do not depend on the regions, every multiple of the step is sampled.
+	const int32_t firstRow{ (region.y + step - 1) / step * step };
+	const int32_t firstColumn{ (region.x + step - 1) / step * step };
+
+	for( int32_t y = firstRow; y < region.y + region.height; y += step )
+	{
+		const uint8_t* pixels = converted_.ptr<uint8_t>( y );
+
+		for( int32_t x = firstColumn; x < region.x + region.width; x += step )
+		{
+			const uint8_t* pixel = pixels + static_cast<size_t>( x ) * channels;
+			for( size_t channel = 0; channel < channels; ++channel )
+			{
+				++histograms[channel * LEVELS + pixel[channel]];
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::threshold_tiles( const size_t tileRow, const size_t channel )
+{
+	const size_t setSize{ channels_ * LEVELS };
+	const std::vector<uint32_t>& global = thresholds_[channel];
+	const size_t count{ global.size() };
+
+	MultiLevelThreshold& engine = tileEngines_[tileRow * channels_ + channel];
+	std::vector<uint32_t>& local = tileResults_[tileRow * channels_ + channel];
+
+	for( size_t column = 0; column < tileColumns_; ++column )
+	{
+		const size_t tile{ tileRow * tileColumns_ + column };
+		float* const thresholds{ &tileThresholds_[(tile * channels_ + channel) * MAX_THRESHOLDS] };
+
+		// A tile whose histogram can not hold as many classes, e.g. a flat sky, keeps the
+		// thresholds of the whole image.
+		bool found{ false };
+		if( count > 0 )
+		{
+			const uint32_t* const histogram{ &histograms_[tile * setSize + channel * LEVELS] };
+
+			uint32_t bins[TILE_BINS]{ };
+			for( size_t level = 0; level < LEVELS; ++level )
+			{
+				bins[level / TILE_BIN_LEVELS] += histogram[level];
+			}
+
+			engine.set_histogram( bins, TILE_BINS );
+			found = engine.compute( count + 1, local );
+		}
+
+		for( size_t k = 0; k < count; ++k )
+		{
+			thresholds[k] = static_cast<float>( found ? local[k] * TILE_BIN_LEVELS : global[k] );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::label( const int32_t firstRow, const int32_t lastRow, cv::Mat& classMap ) const
+{
+	const int32_t width{ converted_.cols };
+	const uint8_t* const labels{ labels_.data() };
+
+	for( int32_t y = firstRow; y < lastRow; ++y )
+	{
+		const uint8_t* src = converted_.ptr<uint8_t>( y );
+		uint8_t* dst = classMap.ptr<uint8_t>( y );
+
+		if( channels_ == 1 )
+		{
+			for( int32_t x = 0; x < width; ++x )
+			{
+				dst[x] = labels[src[x]];
+			}
+		}
+		else
+		{
+			for( int32_t x = 0; x < width; ++x, src += 3 )
+			{
+				dst[x] = static_cast<uint8_t>( labels[src[0]] + labels[LEVELS + src[1]] +
+				                               labels[2 * LEVELS + src[2]] );
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChannelClassifier::label_tiles( const size_t band, const int32_t firstRow, const int32_t lastRow,
+                                cv::Mat& classMap )
+{
+	const int32_t width{ converted_.cols };
+	const size_t tileSize{ channels_ * MAX_THRESHOLDS };
+
+	// The interpolated thresholds of the row have one more tile, a copy of the last one, so that
+	// every column reads its left and right tiles.
+	float* const row{ &rowThresholds_[band * (tileColumns_ + 1) * tileSize] };
+
+	size_t counts[3]{ };
+	uint32_t weights[3]{ 1, MAX_CHANNEL_CLASSES, MAX_CHANNEL_CLASSES * MAX_CHANNEL_CLASSES };
+	for( size_t channel = 0; channel < channels_; ++channel )
+	{
+		counts[channel] = thresholds_[channel].size();
+	}
+
+	for( int32_t y = firstRow; y < lastRow; ++y )
+	{
+		size_t top{ };
+		float weight{ };
+		interpolation_tile( y, size_.height, tileRows_, top, weight );
+		const size_t bottom{ std::min( top + 1, tileRows_ - 1 ) };
+
+		const float* const upper{ &tileThresholds_[top * tileColumns_ * tileSize] };
+		const float* const lower{ &tileThresholds_[bottom * tileColumns_ * tileSize] };
+		for( size_t i = 0; i < tileColumns_ * tileSize; ++i )
+		{
+			row[i] = upper[i] + weight * (lower[i] - upper[i]);
+		}
+		std::copy( row + (tileColumns_ - 1) * tileSize, row + tileColumns_ * tileSize,
+		           row + tileColumns_ * tileSize );
+
+		const uint8_t* src = converted_.ptr<uint8_t>( y );
+		uint8_t* dst = classMap.ptr<uint8_t>( y );
+
+		for( int32_t x = 0; x < width; ++x, src += channels_ )
+		{
+			const float* const left{ row + columnTiles_[static_cast<size_t>( x )] * tileSize };
+			const float* const right{ left + tileSize };
+			const float fraction{ columnWeights_[static_cast<size_t>( x )] };
+
+			uint32_t value{ };
+			for( size_t channel = 0; channel < channels_; ++channel )
+			{
+				const float level{ static_cast<float>( src[channel] ) };
+				const size_t offset{ channel * MAX_THRESHOLDS };
+
+				uint32_t index{ };
+				for( size_t k = 0; k < counts[channel]; ++k )
+				{
+					const float threshold{ left[offset + k] +
+					                       fraction * (right[offset + k] - left[offset + k]) };
+					index += level >= threshold ? 1u : 0u;
+				}
+				value += index * weights[channel];
+			}
+
+			dst[x] = static_cast<uint8_t>( value );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ClassMapStage::process( const StereoFrame& frame )
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	classifier_.process( frame.left, classMap_, &pool_ );
+
+	bool success{ true };
+
+	if( params_.write )
+	{
+		std::string filepath;
+		success = im::AsyncImporter::generate_filename( folderPath_, "", frame.index,
+		                                                frame.timestamp, "c", "png", filepath ) &&
+		          cv::imwrite( filepath, classMap_ );
+	}
+
+	const double elapsedInUs{ static_cast<double>(
+		std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start ).count() ) };
+
+	timeInUs_ += elapsedInUs;
+	++frames_;
+
+	if( elapsedInUs > periodInUs_ )
+	{
+		++late_;
+	}
+
+	if( !success )
+	{
+		++failed_;
+	}
+
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ClassMapStage::submit( const StereoFrame& frame )
+{
+	return process( frame );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const cv::Mat&
+ClassMapStage::get_class_map() const
+{
+	return classMap_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ClassMapStage::print_report() const
+{
+	cl::print_line( "Class map: ", frames_, " pairs, ", failed_, " not written, ",
+	                frames_ ? timeInUs_ / static_cast<double>( frames_ ) : 0.0, " us per pair, ",
+	                late_, " over the ", periodInUs_, " us frame period" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ClassMapStage::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) )
+	{
+		return false;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	if( !process( frame ) )
+	{
+		return false;
+	}
+
+	// Queued to the log thread, a synchronous write to the console may stall the pipeline.
+	if( params_.printBenchmark )
+	{
+		AsyncLog::print_line( "ClassMap: ", std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start ).count(), " us" );
+	}
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, inResult ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ClassMapStage::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ClassMapStage::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
@@ -0,0 +1,698 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "DisparityStage.hpp"
+#include "AsyncLog.hpp"
+#include "FrameAccess.hpp"
+#include "WorkerPool.hpp"
+
+#include "Importer/IMImporter.hpp"
+
+#include "HTLogger.h"
+#include "CLPrint.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Radius of the census window, 5x5 gives 24 bits per pixel.
+const int32_t CENSUS_RADIUS{ 2 };
+
+/// Largest aggregation window whose cost sums fit in 16 bits, 24 * 35 * 35 < 32768.
+const uint32_t MAX_WINDOW_SIZE{ 35 };
+
+/// Pixels processed by every step of the SIMD kernel.
+const size_t SIMD_BLOCK{ 16 };
+
+/// Writes the Hamming distances between 'count' census values of both images.
+inline void
+hamming_costs( const uint32_t* left, const uint32_t* right, uint8_t* costs, const size_t count )
+{
+	size_t i{ };
+
+#if defined( __SSE2__ )
+	const __m128i mask1 = _mm_set1_epi32( 0x55555555 );
+	const __m128i mask2 = _mm_set1_epi32( 0x33333333 );
+	const __m128i mask4 = _mm_set1_epi32( 0x0F0F0F0F );
+	const __m128i mask6 = _mm_set1_epi32( 0x3F );
+
+	for( ; i + SIMD_BLOCK <= count; i += SIMD_BLOCK )
+	{
+		__m128i counts[4];
+
+		// SSE2 has no popcount, the bits are summed by halving steps within every 32 bits lane.
+		for( size_t j = 0; j < 4; ++j )
+		{
+			__m128i bits = _mm_xor_si128(
+				_mm_loadu_si128( reinterpret_cast<const __m128i*>( left + i + 4 * j ) ),
+				_mm_loadu_si128( reinterpret_cast<const __m128i*>( right + i + 4 * j ) ) );
+
+			bits = _mm_sub_epi32( bits, _mm_and_si128( _mm_srli_epi32( bits, 1 ), mask1 ) );
+			bits = _mm_add_epi32( _mm_and_si128( bits, mask2 ),
+			                      _mm_and_si128( _mm_srli_epi32( bits, 2 ), mask2 ) );
+			bits = _mm_and_si128( _mm_add_epi32( bits, _mm_srli_epi32( bits, 4 ) ), mask4 );
+			bits = _mm_add_epi32( bits, _mm_srli_epi32( bits, 8 ) );
+			bits = _mm_add_epi32( bits, _mm_srli_epi32( bits, 16 ) );
+			counts[j] = _mm_and_si128( bits, mask6 );
+		}
+
+		const __m128i packed = _mm_packus_epi16( _mm_packs_epi32( counts[0], counts[1] ),
+		                                         _mm_packs_epi32( counts[2], counts[3] ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( costs + i ), packed );
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	for( ; i + SIMD_BLOCK <= count; i += SIMD_BLOCK )
+	{
+		uint16x4_t counts[4];
+
+		for( size_t j = 0; j < 4; ++j )
+		{
+			const uint8x16_t bits = vreinterpretq_u8_u32(
+				veorq_u32( vld1q_u32( left + i + 4 * j ), vld1q_u32( right + i + 4 * j ) ) );
+			counts[j] = vmovn_u32( vpaddlq_u16( vpaddlq_u8( vcntq_u8( bits ) ) ) );
+		}
+
+		vst1q_u8( costs + i, vcombine_u8( vmovn_u16( vcombine_u16( counts[0], counts[1] ) ),
+		                                  vmovn_u16( vcombine_u16( counts[2], counts[3] ) ) ) );
+	}
+#endif
+
+	for( ; i < count; ++i )
+	{
+		costs[i] = static_cast<uint8_t>( __builtin_popcount( left[i] ^ right[i] ) );
+	}
+}
+
+// The loops below work on contiguous pixels of one disparity, the compiler vectorizes them.
+
+inline void
+add_costs( int16_t* sums, const uint8_t* costs, const size_t count )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		sums[i] = static_cast<int16_t>( sums[i] + costs[i] );
+	}
+}
+
+inline void
+remove_costs( int16_t* sums, const uint8_t* costs, const size_t count )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		sums[i] = static_cast<int16_t>( sums[i] - costs[i] );
+	}
+}
+
+inline void
+add_sums( int16_t* sums, const int16_t* added, const size_t count )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		sums[i] = static_cast<int16_t>( sums[i] + added[i] );
+	}
+}
+
+/// Keeps the lowest cost of every pixel and the disparity it was found at.
+inline void
+keep_best( int16_t* bestCosts, int16_t* bestDisparities, const int16_t* costs,
+           const int16_t disparity, const size_t count )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		const int16_t cost{ costs[i] };
+		const int16_t bestCost{ bestCosts[i] };
+		const int16_t bestDisparity{ bestDisparities[i] };
+
+		bestDisparities[i] = cost < bestCost ? disparity : bestDisparity;
+		bestCosts[i] = cost < bestCost ? cost : bestCost;
+	}
+}
+
+/// Keeps the lowest cost of every pixel away from the best disparity and its neighbours.
+inline void
+keep_second( int16_t* secondCosts, const int16_t* bestDisparities, const int16_t* costs,
+             const int16_t disparity, const size_t count )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		const int16_t distance{ static_cast<int16_t>( disparity - bestDisparities[i] ) };
+		const int16_t cost{ costs[i] };
+		const int16_t secondCost{ secondCosts[i] };
+		secondCosts[i] = distance * distance > 1 && cost < secondCost ? cost : secondCost;
+	}
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+CensusMatcher::CensusMatcher( const DisparityParams& params )
+	: params_{ params }
+	, range_{ std::max<uint32_t>( params.numDisparities, 1 ) }
+	, radius_{ static_cast<int32_t>(
+		std::min( std::max<uint32_t>( params.windowSize, 3 ), MAX_WINDOW_SIZE ) / 2 ) }
+	, size_{ }
+	, census_{ }
+	, bands_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+CensusMatcher::~CensusMatcher()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+DisparityStage::DisparityStage( const DisparityParams& params, WorkerPool& pool,
+                                const std::string& folderPath )
+	: params_{ params }
+	, pool_( pool )
+	, folderPath_{ folderPath }
+	, rectifier_{ }
+	, matcher_{ params }
+	, grey_{ }
+	, rectified_{ }
+	, disparity_{ }
+	, frames_{ }
+	, failed_{ }
+	, timeInUs_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+DisparityStage::~DisparityStage()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CensusMatcher::compute( const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity,
+                        WorkerPool* pool )
+{
+	allocate( left.size() );
+	disparity.create( left.size(), CV_16UC1 );
+
+	const size_t bands{ bands_.size() };
+	const int32_t rows{ left.rows };
+	const cv::Mat* const images[]{ &left, &right };
+
+	const auto band_rows = [ bands, rows ]( const size_t band, int32_t& firstRow, int32_t& lastRow )
+	{
+		firstRow = static_cast<int32_t>( band * static_cast<size_t>( rows ) / bands );
+		lastRow = static_cast<int32_t>( (band + 1) * static_cast<size_t>( rows ) / bands );
+	};
+
+	// Both views are transformed before any band is matched, a band reads the census of the
+	// rows of its neighbours.
+	parallel_for( pool, 2 * bands, [ & ]( const size_t item )
+	{
+		int32_t firstRow{ };
+		int32_t lastRow{ };
+		band_rows( item % bands, firstRow, lastRow );
+		transform( *images[item / bands], firstRow, lastRow, census_[item / bands] );
+	} );
+
+	parallel_for( pool, bands, [ & ]( const size_t band )
+	{
+		int32_t firstRow{ };
+		int32_t lastRow{ };
+		band_rows( band, firstRow, lastRow );
+		match( bands_[band], firstRow, lastRow, disparity );
+	} );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+CensusMatcher::get_range() const
+{
+	return range_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CensusMatcher::allocate( const cv::Size& size )
+{
+	if( size == size_ )
+	{
+		return;
+	}
+
+	const size_t width{ static_cast<size_t>( size.width ) };
+	const size_t window{ static_cast<size_t>( 2 * radius_ + 1 ) };
+	const size_t bands{ std::min<size_t>( std::max<uint32_t>( params_.bands, 1 ),
+	                                      static_cast<size_t>( std::max( size.height, 1 ) ) ) };
+
+	census_[0].create( size, CV_32SC1 );
+	census_[1].create( size, CV_32SC1 );
+
+	bands_.resize( bands );
+	for( Band& band : bands_ )
+	{
+		band.costs.assign( window * range_ * width, 0 );
+		band.columns.assign( range_ * width, 0 );
+		band.aggregated.assign( range_ * width, 0 );
+		band.bestCosts.assign( width, 0 );
+		band.bestDisparities.assign( width, 0 );
+		band.secondCosts.assign( width, 0 );
+		band.rightCosts.assign( width, 0 );
+		band.rightDisparities.assign( width, 0 );
+	}
+
+	size_ = size;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CensusMatcher::transform( const cv::Mat& image, const int32_t firstRow, const int32_t lastRow,
+                          cv::Mat& census ) const
+{
+	const int32_t width{ image.cols };
+	const int32_t height{ image.rows };
+
+	for( int32_t y = firstRow; y < lastRow; ++y )
+	{
+		uint32_t* values = census.ptr<uint32_t>( y );
+		std::fill( values, values + width, 0 );
+
+		if( y < CENSUS_RADIUS || y >= height - CENSUS_RADIUS )
+		{
+			continue;
+		}
+
+		const uint8_t* centre = image.ptr<uint8_t>( y );
+
+		// One neighbour at a time over the whole row, so that the inner loop vectorizes.
+		for( int32_t dy = -CENSUS_RADIUS; dy <= CENSUS_RADIUS; ++dy )
+		{
+			const uint8_t* neighbours = image.ptr<uint8_t>( y + dy );
+
+			for( int32_t dx = -CENSUS_RADIUS; dx <= CENSUS_RADIUS; ++dx )
+			{
+				if( dx == 0 && dy == 0 )
+				{
+					continue;
+				}
+
+				for( int32_t x = CENSUS_RADIUS; x < width - CENSUS_RADIUS; ++x )
+				{
+					values[x] = (values[x] << 1) | (neighbours[x + dx] < centre[x] ? 1u : 0u);
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CensusMatcher::compute_costs( const int32_t row, const int32_t firstColumn,
+                              const int32_t lastColumn, uint8_t* costs ) const
+{
+	const size_t width{ static_cast<size_t>( size_.width ) };
+	const size_t count{ static_cast<size_t>( lastColumn - firstColumn ) };
+	const uint32_t* left = census_[0].ptr<uint32_t>( row ) + firstColumn;
+	const uint32_t* right = census_[1].ptr<uint32_t>( row ) + firstColumn -
+	                        static_cast<int32_t>( params_.minDisparity );
+
+	// The costs of one disparity are contiguous, pixel x of the left image is compared with
+	// pixel x - minDisparity - d of the right image.
+	for( size_t d = 0; d < range_; ++d )
+	{
+		hamming_costs( left, right - d, costs + d * width + static_cast<size_t>( firstColumn ),
+		               count );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CensusMatcher::match( Band& band, const int32_t firstRow, const int32_t lastRow,
+                      cv::Mat& disparity ) const
+{
+	const int32_t width{ size_.width };
+	const int32_t height{ size_.height };
+	const int32_t window{ 2 * radius_ + 1 };
+	const size_t rowSize{ range_ * static_cast<size_t>( width ) };
+
+	for( int32_t y = firstRow; y < lastRow; ++y )
+	{
+		uint16_t* values = disparity.ptr<uint16_t>( y );
+		std::fill( values, values + width, 0 );
+	}
+
+	// Only the pixels whose aggregation window and candidates all have a census are matched.
+	const int32_t startRow{ std::max( firstRow, CENSUS_RADIUS + radius_ ) };
+	const int32_t endRow{ std::min( lastRow, height - CENSUS_RADIUS - radius_ ) };
+	const int32_t firstColumn{ CENSUS_RADIUS + radius_ + static_cast<int32_t>(
+		params_.minDisparity + range_ - 1 ) };
+	const int32_t lastColumn{ width - CENSUS_RADIUS - radius_ };
+
+	if( startRow >= endRow || firstColumn >= lastColumn )
+	{
+		return;
+	}
+
+	const size_t costFirst{ static_cast<size_t>( firstColumn - radius_ ) };
+	const size_t costCount{ static_cast<size_t>( lastColumn - firstColumn + 2 * radius_ ) };
+	const size_t count{ static_cast<size_t>( lastColumn - firstColumn ) };
+
+	const auto slot = [ & ]( const int32_t row )
+	{
+		return &band.costs[static_cast<size_t>( row % window ) * rowSize];
+	};
+
+	const auto update_columns = [ & ]( const uint8_t* costs, const bool add )
+	{
+		for( size_t d = 0; d < range_; ++d )
+		{
+			const size_t offset{ d * static_cast<size_t>( width ) + costFirst };
+			if( add )
+			{
+				add_costs( &band.columns[offset], costs + offset, costCount );
+			}
+			else
+			{
+				remove_costs( &band.columns[offset], costs + offset, costCount );
+			}
+		}
+	};
+
+	std::fill( band.columns.begin(), band.columns.end(), 0 );
+
+	for( int32_t y = startRow - radius_; y < startRow + radius_; ++y )
+	{
+		compute_costs( y, firstColumn - radius_, lastColumn + radius_, slot( y ) );
+		update_columns( slot( y ), true );
+	}
+
+	for( int32_t y = startRow; y < endRow; ++y )
+	{
+		// The row entering the window takes the slot of the row leaving it.
+		uint8_t* costs = slot( y + radius_ );
+		if( y > startRow )
+		{
+			update_columns( costs, false );
+		}
+
+		compute_costs( y + radius_, firstColumn - radius_, lastColumn + radius_, costs );
+		update_columns( costs, true );
+
+		// Sums of the window columns, one shifted addition per column of the window.
+		for( size_t d = 0; d < range_; ++d )
+		{
+			const size_t offset{ d * static_cast<size_t>( width ) +
+			                     static_cast<size_t>( firstColumn ) };
+			int16_t* sums = &band.aggregated[offset];
+			const int16_t* columns = &band.columns[offset];
+
+			std::copy( columns - radius_, columns - radius_ + count, sums );
+			for( int32_t k = 1 - radius_; k <= radius_; ++k )
+			{
+				add_sums( sums, columns + k, count );
+			}
+		}
+
+		select( band, firstColumn, lastColumn, disparity.ptr<uint16_t>( y ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+CensusMatcher::select( Band& band, const int32_t firstColumn, const int32_t lastColumn,
+                       uint16_t* disparity ) const
+{
+	const size_t width{ static_cast<size_t>( size_.width ) };
+	const size_t first{ static_cast<size_t>( firstColumn ) };
+	const size_t count{ static_cast<size_t>( lastColumn - firstColumn ) };
+	const int32_t minDisparity{ static_cast<int32_t>( params_.minDisparity ) };
+	const int16_t* aggregated = band.aggregated.data();
+
+	std::fill_n( &band.bestCosts[first], count, INT16_MAX );
+	std::fill_n( &band.bestDisparities[first], count, 0 );
+	std::fill_n( &band.secondCosts[first], count, INT16_MAX );
+
+	for( size_t d = 0; d < range_; ++d )
+	{
+		keep_best( &band.bestCosts[first], &band.bestDisparities[first],
+		           aggregated + d * width + first, static_cast<int16_t>( d ), count );
+	}
+
+	for( size_t d = 0; d < range_; ++d )
+	{
+		keep_second( &band.secondCosts[first], &band.bestDisparities[first],
+		             aggregated + d * width + first, static_cast<int16_t>( d ), count );
+	}
+
+	// Pixel xr of the right image has its disparity d costs at pixel xr + minDisparity + d of the
+	// left image, those of one disparity are contiguous as well.
+	if( params_.lrTolerance >= 0 )
+	{
+		const size_t firstRight{ first - params_.minDisparity - range_ + 1 };
+		std::fill_n( &band.rightCosts[firstRight], count + range_ - 1, INT16_MAX );
+		std::fill_n( &band.rightDisparities[firstRight], count + range_ - 1, -1 );
+
+		for( size_t d = 0; d < range_; ++d )
+		{
+			const size_t right{ first - params_.minDisparity - d };
+			keep_best( &band.rightCosts[right], &band.rightDisparities[right],
+			           aggregated + d * width + first, static_cast<int16_t>( d ), count );
+		}
+	}
+
+	for( size_t x = first; x < first + count; ++x )
+	{
+		const int32_t bestCost{ band.bestCosts[x] };
+		const int32_t best{ band.bestDisparities[x] };
+
+		if( band.secondCosts[x] * 100 < bestCost * static_cast<int32_t>(
+			100 + params_.uniquenessRatio ) )
+		{
+			continue;
+		}
+
+		if( params_.lrTolerance >= 0 && std::abs( band.rightDisparities[
+			x - params_.minDisparity - static_cast<size_t>( best )] - best ) > params_.lrTolerance )
+		{
+			continue;
+		}
+
+		// Parabola through the costs around the best disparity.
+		double offset{ };
+		if( best > 0 && best < static_cast<int32_t>( range_ ) - 1 )
+		{
+			const double previous{ static_cast<double>(
+				aggregated[static_cast<size_t>( best - 1 ) * width + x] ) };
+			const double next{ static_cast<double>(
+				aggregated[static_cast<size_t>( best + 1 ) * width + x] ) };
+			const double curvature{ previous + next - 2.0 * bestCost };
+
+			if( curvature > 0.0 )
+			{
+				offset = (previous - next) / (2.0 * curvature);
+			}
+		}
+
+		const double value{ (minDisparity + best + offset) * DISPARITY_SCALE + 0.5 };
+		disparity[x] = static_cast<uint16_t>( std::min( std::max( value, 0.0 ), 65535.0 ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DisparityStage::open()
+{
+	if( !rectifier_.load( params_.calibration ) )
+	{
+		ht::log_warning( "no stereo calibration in " + params_.calibration +
+		                 ", the pairs are matched without rectification" );
+		return false;
+	}
+
+	// A session can then be rectified again without the configuration it was recorded with.
+	if( !folderPath_.empty() && !rectifier_.save( folderPath_ + "/" + STEREO_CALIB_FILE ) )
+	{
+		ht::log_warning( "unable to copy the stereo calibration to " + folderPath_ );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DisparityStage::process( const StereoFrame& frame )
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	const cv::Mat* const inputs[]{ &frame.left, &frame.right };
+	parallel_for( &pool_, 2, [ & ]( const size_t view )
+	{
+		to_grey( *inputs[view], grey_[view] );
+	} );
+
+	const cv::Mat* images{ grey_ };
+
+	if( rectifier_.is_calibrated() )
+	{
+		const size_t bands{ std::max<uint32_t>( params_.bands, 1 ) };
+		const int32_t rows{ grey_[0].rows };
+
+		rectifier_.prepare( grey_[0].size() );
+		rectified_[0].create( grey_[0].size(), CV_8UC1 );
+		rectified_[1].create( grey_[1].size(), CV_8UC1 );
+
+		parallel_for( &pool_, 2 * bands, [ & ]( const size_t item )
+		{
+			const size_t band{ item % bands };
+			rectifier_.rectify( item / bands, grey_[item / bands], rectified_[item / bands],
+			                    static_cast<int32_t>( band * static_cast<size_t>( rows ) / bands ),
+			                    static_cast<int32_t>( (band + 1) * static_cast<size_t>( rows ) /
+			                                          bands ) );
+		} );
+
+		images = rectified_;
+	}
+
+	matcher_.compute( images[0], images[1], disparity_, &pool_ );
+
+	bool success{ true };
+
+	if( params_.write )
+	{
+		std::string filepath;
+		success = im::AsyncImporter::generate_filename( folderPath_, "", frame.index,
+		                                                frame.timestamp, "d", "tif", filepath ) &&
+		          cv::imwrite( filepath, disparity_ );
+	}
+
+	timeInUs_ += static_cast<double>( std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start ).count() );
+	++frames_;
+
+	if( !success )
+	{
+		++failed_;
+	}
+
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const cv::Mat&
+DisparityStage::get_disparity() const
+{
+	return disparity_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+DisparityStage::print_report() const
+{
+	cl::print_line( "Disparity: ", frames_, " pairs, ", failed_, " not written, ",
+	                frames_ ? timeInUs_ / static_cast<double>( frames_ ) : 0.0, " us per pair" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DisparityStage::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) )
+	{
+		return false;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	if( !process( frame ) )
+	{
+		return false;
+	}
+
+	// Queued to the log thread, a synchronous write to the console may stall the pipeline.
+	if( params_.printBenchmark )
+	{
+		AsyncLog::print_line( "Disparity: ", std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start ).count(), " us" );
+	}
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, inResult ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DisparityStage::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DisparityStage::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
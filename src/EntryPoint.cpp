@@ -20,6 +20,26 @@
 
 #include "BuildVersion.hpp"
 #include "EntryPoint.hpp"
+#include "AsyncLog.hpp"
+#include "BatchReprocessor.hpp"
+#include "BenchmarkSuite.hpp"
+#include "BlackBoxOutput.hpp"
+#include "CaptureRig.hpp"
+#include "ClassMapStage.hpp"
+#include "DisparityStage.hpp"
+#include "FrameAccess.hpp"
+#include "LoadGovernor.hpp"
+#include "PreviewOutput.hpp"
+#include "RecordingGate.hpp"
+#include "RigScheduler.hpp"
+#include "RoiStage.hpp"
+#include "SessionReplay.hpp"
+#include "StereoCalibrator.hpp"
+#include "StereoRectifier.hpp"
+#include "StreamOutput.hpp"
+#include "ThreadPlacement.hpp"
+#include "ToneMapStage.hpp"
+#include "WorkerPool.hpp"
 
 #include "BaseFilters/BFDemosaicingFilter.hpp"
 #include "BaseFilters/BFExposureFilter.hpp"
@@ -27,7 +47,6 @@
 
 #include "IO/IOFileWriter.hpp"
 #include "IO/IOBlueFoxStereoCalib.hpp"
-#include <IO/IOJsonReader.hpp>
 #include "IO/IOTiffWriter.hpp"
 #include "IO/IOBufferWriter.hpp"
 
@@ -47,7 +66,12 @@
 //--------------------------------------------------------------------------------------------------
 //
 EntryPoint::EntryPoint()
-	: signaled_{ }
+	: mode_{ Mode::Capture }
+	, signaled_{ }
+	, forced_{ }
+	, shutdownMutex_{ }
+	, shutdown_{ }
+	, sessionPath_{ }
 {
 	signalHandler_.attach_handler( ht::SignalHandler::Signal::Interrupt,
 	                               std::bind( &EntryPoint::set_signal, this ) );
@@ -70,6 +94,15 @@ EntryPoint::EntryPoint()
 
 	handler_.AddParamHandler( "-c", f );
 	parser_.add_switch( "-c", "Calibrate stereo bench" );
+
+	handler_.AddParamHandler( "-b", f );
+	parser_.add_switch( "-b", "Run the benchmarks listed in the configuration" );
+
+	handler_.AddParamHandler( "-m", f );
+	parser_.add_switch( "-m", "Capture the stereo benches listed in the configuration" );
+
+	handler_.AddParamHandler( "-r", f );
+	parser_.add_switch( "-r", "Reprocess the sessions listed in the configuration" );
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -88,8 +121,37 @@ EntryPoint::~EntryPoint()
 void
 EntryPoint::set_signal()
 {
+	if( signaled_ )
+	{
+		forced_ = true;
+		ht::log_warning( "second signal received, skipping the drain" );
+		return;
+	}
+
 	signaled_ = true;
 	ht::log_warning( "signal received" );
+
+	// The deadlines start with the signal, so that they also bound a stage stuck in the pipeline.
+	std::lock_guard<std::mutex> lock( shutdownMutex_ );
+	if( shutdown_ != nullptr )
+	{
+		shutdown_->arm( sessionPath_ );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+EntryPoint::watch_shutdown( GracefulShutdown* shutdown, const std::string& sessionPath )
+{
+	std::lock_guard<std::mutex> lock( shutdownMutex_ );
+	shutdown_ = shutdown;
+	sessionPath_ = sessionPath;
+
+	if( shutdown_ != nullptr && signaled_ )
+	{
+		shutdown_->arm( sessionPath_ );
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -130,7 +192,32 @@ EntryPoint::print_header() const
 bool
 EntryPoint::handle_parameters( const std::string& paramName, const std::string& paramValue )
 {
-	cl::ignore( paramName, paramValue );
+	cl::ignore( paramValue );
+
+	if( paramName == "-c" )
+	{
+		mode_ = Mode::Calibration;
+		return true;
+	}
+
+	if( paramName == "-b" )
+	{
+		mode_ = Mode::Benchmark;
+		return true;
+	}
+
+	if( paramName == "-m" )
+	{
+		mode_ = Mode::MultiRig;
+		return true;
+	}
+
+	if( paramName == "-r" )
+	{
+		mode_ = Mode::Batch;
+		return true;
+	}
+
 	return false;
 }
 
@@ -145,86 +232,595 @@ EntryPoint::run( int32_t argc, const char** argv )
 	if( parser_.validate_cmd_line( argc, argv, &handler_ ) )
 	{
 		std::string resourceFolder{ "resources/" };
+		const std::string configPath{ resourceFolder + "config.json" };
 
-		io::JsonReader jsonReader;
-		jsonReader.load( resourceFolder.append( "config.json" ) );
-		const io::JsonElement benchConfig = jsonReader.get_root().get( "stereobench" );
-
-		io::BlueFox::Params blueFoxParams;
-		blueFoxParams.colorSpace = ht::ColorSpace::RAW;
-		blueFoxParams.width = 752;
-		blueFoxParams.height = 480;
-		blueFoxParams.exposure = 20000;
-		blueFoxParams.autoExposure = false;
-		blueFoxParams.exposureMax = 20000;
-		blueFoxParams.exposureMin = 12;
-		blueFoxParams.hdrEnabled = true;
-		blueFoxParams.periodInUs = 45000;
-
-		std::string dateStr{ };
-		cl::Date date;
-		date.get_date_and_time_mime( dateStr );
-		cl::filesystem::folder_create( dateStr );
+		CaptureConfig config;
+		if( !config.load( configPath ) )
+		{
+			ht::log_warning( "unable to parse the configuration, using default values" );
+		}
 
-		im::BlueFoxStereoImporterUPtr
-			importer = im::unique_bluefox_stereo_importer( blueFoxParams );
+		// Declared first so that it outlives the pipeline threads of every mode.
+		AsyncLog log{ config.logging, config.threads.role( "log" ) };
+
+		if( mode_ == Mode::Benchmark )
+		{
+			BenchmarkSuite benchmarks{ config };
+			res = benchmarks.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		else if( mode_ == Mode::MultiRig )
+		{
+			res = run_rigs( config );
+		}
+		else if( mode_ == Mode::Calibration )
+		{
+			res = run_calibration( config );
+		}
+		else if( mode_ == Mode::Batch )
+		{
+			res = run_batch( config );
+		}
+		else
+		{
+			res = run_capture( config );
+		}
+	}
+
+	return res;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+io::BlueFox::Params
+EntryPoint::bluefox_params()
+{
+	io::BlueFox::Params blueFoxParams;
+	blueFoxParams.colorSpace = ht::ColorSpace::RAW;
+	blueFoxParams.width = 752;
+	blueFoxParams.height = 480;
+	blueFoxParams.exposure = 20000;
+	blueFoxParams.autoExposure = false;
+	blueFoxParams.exposureMax = 20000;
+	blueFoxParams.exposureMin = 12;
+	blueFoxParams.hdrEnabled = true;
+	blueFoxParams.periodInUs = 45000;
+
+	return blueFoxParams;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+int32_t
+EntryPoint::run_capture( const CaptureConfig& config )
+{
+	const io::BlueFox::Params blueFoxParams = bluefox_params();
+
+	std::string dateStr{ };
+	cl::Date date;
+	date.get_date_and_time_mime( dateStr );
+	cl::filesystem::folder_create( dateStr );
+
+	if( config.threads.lockMemory && !ThreadPlacement::lock_memory() )
+	{
+		ht::log_warning( "unable to lock memory" );
+	}
+
+	if( !ThreadPlacement::apply_to_current_thread( config.threads.role( "capture" ) ) )
+	{
+		ht::log_warning( "unable to place the capture thread" );
+	}
+
+	im::BlueFoxStereoImporterUPtr
+		importer = im::unique_bluefox_stereo_importer( blueFoxParams );
+
+	io::BlueFoxStereoCalib calibrationParams;
+	calibrationParams.load_from_stereo_rig( *importer );
+	calibrationParams.save_to_file( dateStr, "capture" );
+
+	// The filters of the base library restrict their work to the region of the output metrics.
+	RoiStage roiStage( config.roi, static_cast<int32_t>( blueFoxParams.width ),
+	                   static_cast<int32_t>( blueFoxParams.height ) );
+	const cv::Rect& region = roiStage.get_region();
+
+	vm::Size size{ blueFoxParams.width, blueFoxParams.height };
+	cl::Rect2u32 roi{ static_cast<uint32_t>( region.x ), static_cast<uint32_t>( region.y ),
+	                  static_cast<uint32_t>( region.width ),
+	                  static_cast<uint32_t>( region.height ) };
+	co::OutputMetrics om{ size, roi };
+
+	WorkerPool pool{ config.threads.workers, config.threads.role( "pool" ) };
+
+	LoadGovernor governor( config.governor, blueFoxParams.periodInUs );
+	std::vector<std::unique_ptr<GovernedStage>> governedStages;
+
+	// With the governor every stage is reached through a GovernedStage of its name.
+	auto attach = [ & ]( co::ProcessUnit& parent, co::ProcessUnit& stage, const std::string& name )
+	{
+		if( !config.governor.enabled )
+		{
+			parent.add_output( stage );
+			return;
+		}
+
+		governedStages.emplace_back( new GovernedStage( governor, name ) );
+		governedStages.back()->add_output( stage );
+		parent.add_output( *governedStages.back() );
+	};
+
+	// The sinks of the tone map and of the RoiStages are governed the same way, through a
+	// GovernedSink.
+	std::vector<std::unique_ptr<GovernedSink>> governedSinks;
+	auto attach_sink = [ & ]( auto& parent, StereoSink& sink, const std::string& name )
+	{
+		if( !config.governor.enabled )
+		{
+			parent.add_sink( sink );
+			return;
+		}
+
+		governedSinks.emplace_back( new GovernedSink( governor, name, sink ) );
+		parent.add_sink( *governedSinks.back() );
+	};
+
+	// The raw consumers are handed the cropped and binned pairs by the RoiStage.
+	auto attach_raw = [ & ]( auto& stage, const std::string& name )
+	{
+		if( config.roi.enabled )
+		{
+			attach_sink( roiStage, stage, name );
+		}
+		else
+		{
+			attach( *this, stage, name );
+		}
+	};
+
+	if( config.roi.enabled )
+	{
+		this->add_output( roiStage );
+	}
+
+	// In black box mode nothing is written outside of the events, FileOutput is not created.
+	std::unique_ptr<FileOutput> output{ };
+	RecordingGate gate( config.gate );
+	BlackBoxOutput blackBox( config.blackBox, config.storage, config.threads.role( "writer" ),
+	                         dateStr, blueFoxParams.periodInUs );
+	DisparityStage disparity( config.disparity, pool, dateStr );
+
+	if( config.blackBox.enabled )
+	{
+		attach_raw( blackBox, "recording" );
+		blackBox.start();
+
+		if( config.disparity.enabled )
+		{
+			ht::log_warning( "no disparity is computed in black box mode" );
+		}
+	}
+	else
+	{
+		output.reset( new FileOutput( dateStr, config.storage, config.roi.enabled ) );
+
+		if( config.gate.enabled )
+		{
+			if( config.roi.enabled )
+			{
+				gate.add_sink( *output );
+			}
+			else
+			{
+				gate.add_output( *output );
+			}
+			attach_raw( gate, "recording" );
+		}
+		else
+		{
+			attach_raw( *output, "recording" );
+		}
+
+		// The disparity maps are written next to the pairs, after the same gating.
+		if( config.disparity.enabled && config.roi.enabled )
+		{
+			ht::log_warning( "no disparity is computed on windowed pairs, the stereo calibration "
+			                 "covers the whole frames" );
+		}
+		else if( config.disparity.enabled )
+		{
+			disparity.open();
+			if( config.gate.enabled )
+			{
+				attach( gate, disparity, "disparity" );
+			}
+			else
+			{
+				attach( *this, disparity, "disparity" );
+			}
+		}
+	}
+
+	bf::DemosaicingFilter demosaicingFilter;
+	demosaicingFilter.prepare_filter( om );
+	this->add_output( demosaicingFilter );
+
+	bf::ExposureFilter exposureFilter;
+	exposureFilter.prepare_filter( om );
+	attach( demosaicingFilter, exposureFilter, "exposure" );
+
+	// The colour consumers are handed the demosaiced pairs windowed and binned like the raw ones.
+	RoiStage colourRoi( config.roi, static_cast<int32_t>( blueFoxParams.width ),
+	                    static_cast<int32_t>( blueFoxParams.height ) );
+	if( config.roi.enabled )
+	{
+		demosaicingFilter.add_output( colourRoi );
+	}
+
+	auto attach_colour = [ & ]( auto& stage, const std::string& name )
+	{
+		if( config.roi.enabled )
+		{
+			attach_sink( colourRoi, stage, name );
+		}
+		else
+		{
+			attach( demosaicingFilter, stage, name );
+		}
+	};
+
+	// The tone map only feeds the class map, the preview and the stream, the recording keeps the
+	// sensor output. Its sinks are governed, not the tone map itself: shedding it would stop them
+	// all whatever their priorities.
+	ToneMapStage toneMap( config.toneMap, pool );
+	if( config.toneMap.enabled )
+	{
+		if( config.roi.enabled )
+		{
+			colourRoi.add_sink( toneMap );
+		}
+		else
+		{
+			demosaicingFilter.add_output( toneMap );
+		}
+	}
+
+	// The class maps of the left images are computed on every demosaiced pair, whatever the gating,
+	// after the tone map when there is one.
+	ClassMapStage classMap( config.classMap, pool, blueFoxParams.periodInUs, dateStr );
+	if( config.classMap.enabled )
+	{
+		if( config.toneMap.enabled )
+		{
+			attach_sink( toneMap, classMap, "class_map" );
+		}
+		else
+		{
+			attach_colour( classMap, "class_map" );
+		}
+	}
+
+	PreviewOutput preview( config.preview, config.threads.role( "preview" ), dateStr );
+	if( config.preview.enabled )
+	{
+		if( config.toneMap.enabled )
+		{
+			attach_sink( toneMap, preview, "preview" );
+		}
+		else
+		{
+			attach_colour( preview, "preview" );
+		}
+		preview.start();
+	}
+
+	StreamOutput stream( config.stream, config.threads.role( "stream" ) );
+	if( config.stream.enabled )
+	{
+		if( config.toneMap.enabled )
+		{
+			attach_sink( toneMap, stream, "stream" );
+		}
+		else
+		{
+			attach_colour( stream, "stream" );
+		}
+
+		if( stream.start() )
+		{
+			cl::print_line( "Streaming on port ", stream.get_port() );
+		}
+	}
+
+	// The importer threads inherit the placement of the thread that starts them.
+	cm::BitmapCache bitmapCache;
+	importer->open( "" );
+	importer->start_async_read( bitmapCache );
+
+	if( !ThreadPlacement::apply_to_current_thread( config.threads.role( "processing" ) ) )
+	{
+		ht::log_warning( "unable to place the processing thread" );
+	}
+
+	GracefulShutdown shutdown{ config.shutdown };
+	watch_shutdown( &shutdown, dateStr );
+
+	FrameTelemetry telemetry{ config.telemetry, blueFoxParams.periodInUs };
+	if( !telemetry.open( dateStr ) )
+	{
+		ht::log_warning( "unable to create the telemetry file" );
+	}
+
+	int8_t pressed{ };
+
+	while( !is_signaled() && pressed != 27 )
+	{
+		if( bitmapCache.wait_for_new_entry( 0 ) )
+		{
+			cm::BitmapPairEntrySPtr entry{ };
+			bool status = bitmapCache.pop_newest_entry( entry );
+			if( status )
+			{
+				// The writer queue of the black box, or the writes in flight of the store.
+				size_t limit{ };
+				const size_t depth{ config.blackBox.enabled ? blackBox.get_queue_depth( limit )
+				                                            : output->get_queue_depth( limit ) };
+				governor.observe_queue( depth, limit );
+
+				if( process_entry( bitmapCache, om, entry, shutdown, telemetry, governor ) )
+				{
+					importer->set_exposure_overshoot( exposureFilter.get_greylevel_diff() );
+				}
+			}
+		}
+	}
+
+	// Stop acquisition first, the cache then only holds frames that can still be saved. Already
+	// armed by the signal, unless the capture was ended from the keyboard.
+	shutdown.arm( dateStr );
+	importer->stop_async_read();
+	preview.stop();
+	stream.stop();
+
+	while( !forced_ && !shutdown.drain_expired() && bitmapCache.wait_for_new_entry( 0 ) )
+	{
+		cm::BitmapPairEntrySPtr entry{ };
+		if( bitmapCache.pop_newest_entry( entry ) )
+		{
+			process_entry( bitmapCache, om, entry, shutdown, telemetry, governor );
+		}
+	}
+
+	cm::BitmapPairEntrySPtr discarded{ };
+	while( bitmapCache.wait_for_new_entry( 0 ) && bitmapCache.pop_newest_entry( discarded ) )
+	{
+		shutdown.count_discarded();
+	}
+
+	blackBox.stop();
+
+	if( output && !output->flush() )
+	{
+		ht::log_warning( "unable to sync the session folder" );
+	}
+
+	importer->close();
+	telemetry.export_statistics();
+
+	watch_shutdown( nullptr, "" );
+	shutdown.disarm();
+	shutdown.print_report();
+
+	if( config.blackBox.enabled )
+	{
+		blackBox.print_report();
+	}
+	else if( config.gate.enabled )
+	{
+		gate.print_report();
+	}
+
+	if( config.toneMap.enabled )
+	{
+		toneMap.print_report();
+	}
+
+	if( config.disparity.enabled && !config.blackBox.enabled && !config.roi.enabled )
+	{
+		disparity.print_report();
+	}
 
-		io::BlueFoxStereoCalib calibrationParams;
-		calibrationParams.load_from_stereo_rig( *importer );
-		calibrationParams.save_to_file( dateStr, "capture" );
+	if( config.roi.enabled )
+	{
+		roiStage.print_report();
+	}
 
-		vm::Size size{ blueFoxParams.width, blueFoxParams.height };
-		cl::Rect2u32 roi{ 0, 0, size.width(), size.height() };
-		co::OutputMetrics om{ size, roi };
+	if( config.classMap.enabled )
+	{
+		classMap.print_report();
+	}
 
-		FileOutput output( dateStr );
-		this->add_output( output );
+	if( config.governor.enabled )
+	{
+		governor.print_report();
+	}
 
-		bf::DemosaicingFilter demosaicingFilter;
-		demosaicingFilter.prepare_filter( om );
-		this->add_output( demosaicingFilter );
+	return EXIT_SUCCESS;
+}
 
-		bf::ExposureFilter exposureFilter;
-		exposureFilter.prepare_filter( om );
-		demosaicingFilter.add_output( exposureFilter );
+//--------------------------------------------------------------------------------------------------
+//
+int32_t
+EntryPoint::run_rigs( const CaptureConfig& config )
+{
+	if( config.multiRig.rigs.empty() )
+	{
+		ht::log_warning( "no rig configured" );
+		return EXIT_FAILURE;
+	}
+
+	std::string dateStr{ };
+	cl::Date date;
+	date.get_date_and_time_mime( dateStr );
+	cl::filesystem::folder_create( dateStr );
+
+	if( config.threads.lockMemory && !ThreadPlacement::lock_memory() )
+	{
+		ht::log_warning( "unable to lock memory" );
+	}
+
+	// The scheduler polls the caches from this thread, the importer threads inherit its placement.
+	if( !ThreadPlacement::apply_to_current_thread( config.threads.role( "capture" ) ) )
+	{
+		ht::log_warning( "unable to place the capture thread" );
+	}
+
+	// Pinning every worker to the cpus of the processing thread would serialize the rigs.
+	WorkerPool pool{ config.multiRig.workers, config.threads.role( "pool" ) };
+	std::vector<std::unique_ptr<CaptureRig>> rigs;
+
+	for( const RigParams& params : config.multiRig.rigs )
+	{
+		const std::string folderPath{ dateStr + "/" + params.name };
+		cl::filesystem::folder_create( folderPath );
+
+		if( params.source == "bluefox" )
+		{
+			rigs.emplace_back( new BlueFoxRig( params, bluefox_params(), config.storage,
+			                                   folderPath ) );
+		}
+		else if( params.source == "replay" || params.source == "synthetic" )
+		{
+			rigs.emplace_back( new SimulatedRig( params, config.storage, pool, folderPath ) );
+		}
+		else
+		{
+			ht::log_warning( "unknown source of rig " + params.name + ": " + params.source );
+			return EXIT_FAILURE;
+		}
+	}
+
+	RigScheduler scheduler{ pool };
+	size_t running{ };
+
+	while( running < rigs.size() && rigs[running]->start() )
+	{
+		scheduler.add_rig( *rigs[running] );
+		++running;
+	}
+
+	const bool started{ running == rigs.size() };
+	if( !started )
+	{
+		ht::log_warning( "unable to start rig " + rigs[running]->get_params().name );
+	}
+
+	GracefulShutdown shutdown{ config.shutdown };
+	watch_shutdown( &shutdown, dateStr );
+
+	scheduler.run( [ & ]()
+	{
+		if( !started || is_signaled() )
+		{
+			// Bounds the wait for the pairs still in flight on the pool.
+			shutdown.arm( dateStr );
+			return true;
+		}
+		return false;
+	} );
+
+	// Stop acquisition first, the rigs then only hold pairs that can still be saved.
+	for( size_t i = 0; i < running; ++i )
+	{
+		rigs[i]->stop();
+	}
+
+	scheduler.drain( [ & ]()
+	{ return forced_ || shutdown.drain_expired(); } );
+
+	for( size_t i = 0; i < running; ++i )
+	{
+		rigs[i]->close();
+		if( !rigs[i]->flush() )
+		{
+			ht::log_warning( "unable to sync the folder of rig " + rigs[i]->get_params().name );
+		}
+	}
+
+	watch_shutdown( nullptr, "" );
+	shutdown.disarm();
+
+	cl::print_line( "Multi-rig capture stopped" );
+	scheduler.print_report();
+
+	return started ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+int32_t
+EntryPoint::run_calibration( const CaptureConfig& config )
+{
+	const CalibrationParams& params = config.calibration;
+
+	if( params.pattern != "chessboard" && params.pattern != "circles" &&
+	    params.pattern != "asymmetric_circles" )
+	{
+		ht::log_warning( "unknown calibration pattern: " + params.pattern );
+		return EXIT_FAILURE;
+	}
+
+	WorkerPool pool{ params.workers, config.threads.role( "pool" ) };
+	StereoCalibrator calibrator{ params, pool };
+	SessionReplay replay{ params.session, bluefox_params().periodInUs };
+
+	if( !params.session.empty() )
+	{
+		if( !replay.open() )
+		{
+			ht::log_warning( "unable to open session " + params.session );
+			return EXIT_FAILURE;
+		}
+
+		for( size_t position = 0; position < replay.size() && !is_signaled();
+		     position += std::max<uint32_t>( params.step, 1 ) )
+		{
+			calibrator.add_pair( replay, position );
+		}
+	}
+	else
+	{
+		im::BlueFoxStereoImporterUPtr
+			importer = im::unique_bluefox_stereo_importer( bluefox_params() );
 
 		cm::BitmapCache bitmapCache;
 		importer->open( "" );
 		importer->start_async_read( bitmapCache );
 
-		int8_t pressed{ };
+		cl::print_line( "Collecting ", params.frames, " pairs, move the pattern in front of the "
+		                "bench" );
+
+		const std::chrono::milliseconds period{ params.periodInMs };
+		auto last = std::chrono::steady_clock::now() - period;
+		uint32_t collected{ };
 
-		while( !is_signaled() && pressed != 27 )
+		// Pairs are only taken once per period, the newest one, and detected while the next
+		// ones are collected.
+		while( collected < params.frames && !is_signaled() )
 		{
-			if( bitmapCache.wait_for_new_entry( 0 ) )
+			cm::BitmapPairEntrySPtr entry{ };
+			if( bitmapCache.wait_for_new_entry( 0 ) && bitmapCache.pop_newest_entry( entry ) &&
+			    std::chrono::steady_clock::now() - last >= period )
 			{
-				cm::BitmapPairEntrySPtr entry{ };
-				bool status = bitmapCache.pop_newest_entry( entry );
-				if( status )
-				{
-					co::OutputResult result{ om };
-					co::ParamContext ctx( bitmapCache );
-
-					result.add_cache_entries( entry->get_cache_id(), entry );
-					result.start_benchmark();
-
-					if( compute_result( ctx, result ) )
-					{
-						result.stop_benchmark();
-						//cl::print_line_sp( "VisualCortex successfully updated" );
-						//result.print_benchmark( "" );
-						//cl::print_line();
-
-						importer->set_exposure_overshoot( exposureFilter.get_greylevel_diff() );
-					}
-					else
-					{
-						//result.stop_benchmark();
-						//cl::print_line_sp( "VisualCortex update failed" );
-						//result.print_benchmark( "" );
-						//cl::print_line();
-					}
-				}
+				const cm::BitmapPairEntry::ID* id = dynamic_cast<cm::BitmapPairEntry::ID*>(
+					&(*entry->get_cache_id()) );
+
+				StereoFrame frame;
+				frame.index = id ? id->get_index() : collected;
+				frame.timestamp = id ? id->get_timestamp() : 0;
+				frame.left = bitmap_view( entry->bitmap_left() );
+				frame.right = bitmap_view( entry->bitmap_right() );
+
+				calibrator.add_pair( frame );
+				last = std::chrono::steady_clock::now();
+				++collected;
 			}
 		}
 
@@ -232,7 +828,104 @@ EntryPoint::run( int32_t argc, const char** argv )
 		importer->close();
 	}
 
-	return res;
+	StereoRectifier rectifier;
+	const bool calibrated = calibrator.calibrate( rectifier );
+
+	cl::print_line( calibrated ? "Stereo calibration completed" : "Stereo calibration failed" );
+	calibrator.print_report();
+
+	if( !calibrated )
+	{
+		ht::log_warning( "too few pairs with the pattern in both views" );
+		return EXIT_FAILURE;
+	}
+
+	if( !rectifier.save( params.output ) )
+	{
+		ht::log_warning( "unable to write the calibration to " + params.output );
+		return EXIT_FAILURE;
+	}
+
+	// A recorded session is rectified by the batch mode with its own copy of the calibration.
+	if( !params.session.empty() && !rectifier.save( params.session + "/" + STEREO_CALIB_FILE ) )
+	{
+		ht::log_warning( "unable to write the calibration of session " + params.session );
+	}
+
+	cl::print_line( "  written to ", params.output );
+	return EXIT_SUCCESS;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+int32_t
+EntryPoint::run_batch( const CaptureConfig& config )
+{
+	if( config.batch.sessions.empty() )
+	{
+		ht::log_warning( "no session to reprocess" );
+		return EXIT_FAILURE;
+	}
+
+	WorkerPool pool{ config.batch.workers, config.threads.role( "pool" ) };
+	BatchReprocessor reprocessor{ config.batch, config.classMap, pool };
+
+	// A signal stops the submission, the frames in flight are committed before returning.
+	const bool opened = reprocessor.run( [ this ]()
+	{ return is_signaled(); } );
+
+	cl::print_line( is_signaled() ? "Reprocessing interrupted" : "Reprocessing completed" );
+	reprocessor.print_report();
+
+	return opened ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+EntryPoint::process_entry( cm::BitmapCache& cache, const co::OutputMetrics& om,
+                           const cm::BitmapPairEntrySPtr& entry, GracefulShutdown& shutdown,
+                           FrameTelemetry& telemetry, LoadGovernor& governor )
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	co::OutputResult result{ om };
+	co::ParamContext ctx( cache );
+
+	result.add_cache_entries( entry->get_cache_id(), entry );
+	result.start_benchmark();
+
+	const bool success = compute_result( ctx, result );
+	if( success )
+	{
+		result.stop_benchmark();
+		//cl::print_line_sp( "VisualCortex successfully updated" );
+		//result.print_benchmark( "" );
+		//cl::print_line();
+	}
+	else
+	{
+		//result.stop_benchmark();
+		//cl::print_line_sp( "VisualCortex update failed" );
+		//result.print_benchmark( "" );
+		//cl::print_line();
+	}
+
+	const cm::BitmapPairEntry::ID* id = dynamic_cast<cm::BitmapPairEntry::ID*>(
+		&(*entry->get_cache_id()) );
+
+	if( id )
+	{
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start );
+
+		shutdown.count_frame( id->get_index(), success );
+		telemetry.observe( id->get_index(), id->get_timestamp(),
+		                   static_cast<double>( elapsed.count() ) );
+		governor.observe_frame( id->get_index(), static_cast<double>( elapsed.count() ) );
+	}
+
+	return success;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -0,0 +1,189 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "EventTrigger.hpp"
+
+#include "HTLogger.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Longest time before the trigger file is checked again.
+const int32_t WATCH_PERIOD_IN_MS{ 50 };
+
+//--------------------------------------------------------------------------------------------------
+//
+std::string
+resolve_trigger_path( const std::string& triggerFile, const std::string& folderPath )
+{
+	if( triggerFile.empty() || triggerFile.front() == '/' || folderPath.empty() )
+	{
+		return triggerFile;
+	}
+
+	return folderPath + "/" + triggerFile;
+}
+
+}
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+EventTrigger::EventTrigger( const BlackBoxParams& params, const std::string& folderPath )
+	: params_{ params }
+	, triggerPath_{ resolve_trigger_path( params.triggerFile, folderPath ) }
+	, signalHandler_{ }
+	, socket_{ -1 }
+	, pending_{ }
+	, running_{ }
+	, thread_{ }
+{
+	// The handler runs on the watch thread of the signal handler, not in the signal context.
+	signalHandler_.attach_handler( ht::SignalHandler::Signal::User1, [this]{ ++pending_; } );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+EventTrigger::~EventTrigger()
+{
+	stop();
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+EventTrigger::start()
+{
+	if( running_ )
+	{
+		return true;
+	}
+
+	bool started{ true };
+	signalHandler_.start_watch();
+
+	if( !params_.socketPath.empty() )
+	{
+		sockaddr_un address{ };
+		address.sun_family = AF_UNIX;
+
+		if( params_.socketPath.size() >= sizeof( address.sun_path ) )
+		{
+			ht::log_warning( "trigger socket path too long: " + params_.socketPath );
+			started = false;
+		}
+		else
+		{
+			std::strncpy( address.sun_path, params_.socketPath.c_str(),
+			              sizeof( address.sun_path ) - 1 );
+
+			// A socket left by a previous run would make bind fail.
+			::unlink( params_.socketPath.c_str() );
+
+			socket_ = ::socket( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+			if( socket_ < 0 || ::bind( socket_, reinterpret_cast<sockaddr*>( &address ),
+			                           sizeof( address ) ) != 0 )
+			{
+				ht::log_warning( "unable to bind the trigger socket " + params_.socketPath );
+				started = false;
+			}
+		}
+	}
+
+	running_ = true;
+	thread_ = std::thread( &EventTrigger::watch, this );
+
+	return started;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+EventTrigger::stop()
+{
+	if( !running_.exchange( false ) )
+	{
+		return;
+	}
+
+	if( thread_.joinable() )
+	{
+		thread_.join();
+	}
+
+	if( socket_ >= 0 )
+	{
+		::close( socket_ );
+		::unlink( params_.socketPath.c_str() );
+		socket_ = -1;
+	}
+
+	signalHandler_.stop_watch();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+EventTrigger::consume()
+{
+	return pending_.exchange( 0 ) > 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+EventTrigger::watch()
+{
+	while( running_ )
+	{
+		pollfd descriptor{ socket_, POLLIN, 0 };
+
+		// poll ignores negative descriptors, it then only sleeps for the watch period.
+		if( ::poll( &descriptor, 1, WATCH_PERIOD_IN_MS ) > 0 && (descriptor.revents & POLLIN) )
+		{
+			char message[256];
+			while( ::recv( socket_, message, sizeof( message ), 0 ) >= 0 )
+			{
+				++pending_;
+			}
+		}
+
+		if( !triggerPath_.empty() && ::access( triggerPath_.c_str(), F_OK ) == 0 )
+		{
+			::unlink( triggerPath_.c_str() );
+			++pending_;
+		}
+	}
+}
@@ -0,0 +1,510 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "FrameStore.hpp"
+#include "AsyncLog.hpp"
+#include "GracefulShutdown.hpp"
+#include "RawContainer.hpp"
+#include "SessionReplay.hpp"
+
+#include "Importer/IMImporter.hpp"
+
+#include "HTLogger.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+const uint64_t BYTES_PER_MB{ 1024 * 1024 };
+
+/// Copies the rows of an image to a packed destination, views with a stride are supported.
+uint8_t*
+copy_rows( const cv::Mat& image, uint8_t* dst )
+{
+	const size_t rowSize{ static_cast<size_t>( image.cols ) * image.elemSize() };
+
+	for( int32_t y = 0; y < image.rows; ++y )
+	{
+		std::memcpy( dst, image.ptr( y ), rowSize );
+		dst += rowSize;
+	}
+	return dst;
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+TiffFrameStore::TiffFrameStore( const std::string& folderPath )
+	: folderPath_{ folderPath }
+	, manifest_{ folderPath + "/" + SESSION_MANIFEST }
+{
+	manifest_ << "index,timestamp,left,right" << std::endl;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+TiffFrameStore::~TiffFrameStore()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+DirectFrameStore::DirectFrameStore( const StorageParams& params, const std::string& folderPath )
+	: params_{ params }
+	, folderPath_{ folderPath }
+	, fd_{ -1 }
+	, uring_{ params.backend == "uring" }
+	, recordSize_{ }
+	, offset_{ }
+	, allocated_{ }
+	, buffers_{ }
+	, requests_{ }
+	, mutex_{ }
+	, condition_{ }
+	, free_{ }
+	, queue_{ }
+	, inFlight_{ }
+	, running_{ true }
+	, failed_{ false }
+	, writers_{ }
+{
+#ifndef WITH_IO_URING
+	if( uring_ )
+	{
+		ht::log_warning( "built without io_uring, using O_DIRECT writer threads" );
+		uring_ = false;
+	}
+#endif
+
+	const std::string filepath{ folderPath + "/" + RAW_CONTAINER };
+
+	fd_ = ::open( filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644 );
+	if( fd_ < 0 && errno == EINVAL )
+	{
+		ht::log_warning( "O_DIRECT not supported by the filesystem, writes go through the cache" );
+		fd_ = ::open( filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	}
+
+	if( fd_ < 0 )
+	{
+		ht::log_warning( "unable to create " + filepath );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+DirectFrameStore::~DirectFrameStore()
+{
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		running_ = false;
+	}
+	condition_.notify_all();
+
+	for( std::thread& writer : writers_ )
+	{
+		writer.join();
+	}
+
+#ifdef WITH_IO_URING
+	if( uring_ && !buffers_.empty() )
+	{
+		io_uring_queue_exit( &ring_ );
+	}
+#endif
+
+	if( fd_ >= 0 )
+	{
+		::close( fd_ );
+	}
+
+	for( uint8_t* buffer : buffers_ )
+	{
+		std::free( buffer );
+	}
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+TiffFrameStore::store( const StereoFrame& frame )
+{
+	std::string filepathL, filepathR;
+
+	if( !im::AsyncImporter::generate_filename( folderPath_, "", frame.index, frame.timestamp, "l",
+	                                           "tif", filepathL ) ||
+	    !im::AsyncImporter::generate_filename( folderPath_, "", frame.index, frame.timestamp, "r",
+	                                           "tif", filepathR ) )
+	{
+		return false;
+	}
+
+	if( !cv::imwrite( filepathL, frame.left ) || !cv::imwrite( filepathR, frame.right ) )
+	{
+		return false;
+	}
+
+	manifest_ << frame.index << "," << frame.timestamp << ","
+	          << filepathL.substr( filepathL.find_last_of( '/' ) + 1 ) << ","
+	          << filepathR.substr( filepathR.find_last_of( '/' ) + 1 ) << "\n";
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+TiffFrameStore::flush()
+{
+	manifest_.flush();
+	return GracefulShutdown::sync_folder( folderPath_ );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DirectFrameStore::store( const StereoFrame& frame )
+{
+	if( fd_ < 0 || failed_ || frame.left.type() != frame.right.type() ||
+	    frame.left.size() != frame.right.size() )
+	{
+		return false;
+	}
+
+	if( buffers_.empty() && !prepare( frame ) )
+	{
+		return false;
+	}
+
+	if( raw_record_size( frame, params_.packedBits ) != recordSize_ )
+	{
+		AsyncLog::warning( "pair size changed during the recording" );
+		return false;
+	}
+
+	const size_t buffer = acquire_buffer();
+	uint8_t* data = buffers_[buffer];
+
+	RawRecordHeader header{ };
+	header.magic = RAW_RECORD_MAGIC;
+	header.headerSize = static_cast<uint32_t>( RAW_HEADER_SIZE );
+	header.index = frame.index;
+	header.timestamp = frame.timestamp;
+	header.width = frame.left.cols;
+	header.height = frame.left.rows;
+	header.type = frame.left.type();
+	header.packedBits = record_packed_bits( frame, params_.packedBits );
+	header.imageSize = static_cast<uint32_t>( raw_image_size( frame.left, header.packedBits ) );
+	header.recordSize = recordSize_;
+
+	std::memcpy( data, &header, sizeof( header ) );
+
+	// Packed straight into the aligned buffer, the full width pixels are never copied.
+	if( header.packedBits )
+	{
+		pack_image( frame.right, header.packedBits,
+		            pack_image( frame.left, header.packedBits, data + RAW_HEADER_SIZE ) );
+	}
+	else
+	{
+		copy_rows( frame.right, copy_rows( frame.left, data + RAW_HEADER_SIZE ) );
+	}
+
+	reserve( offset_ + recordSize_ );
+	submit( Request{ buffer, offset_ } );
+	offset_ += recordSize_;
+
+	return !failed_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DirectFrameStore::flush()
+{
+	if( fd_ < 0 )
+	{
+		return false;
+	}
+
+	wait_in_flight( 0 );
+
+	// Written records end on an aligned offset, the rest of the preallocation is released.
+	bool synced = ::ftruncate( fd_, static_cast<off_t>( offset_ ) ) == 0;
+	allocated_ = offset_;
+
+	synced = ::fdatasync( fd_ ) == 0 && synced;
+	synced = GracefulShutdown::sync_folder( folderPath_ ) && synced;
+
+	return synced && !failed_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+DirectFrameStore::get_queue_depth( size_t& limit ) const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	limit = buffers_.size();
+	return inFlight_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+DirectFrameStore::prepare( const StereoFrame& frame )
+{
+	recordSize_ = raw_record_size( frame, params_.packedBits );
+
+	if( params_.packedBits && !record_packed_bits( frame, params_.packedBits ) )
+	{
+		ht::log_warning( "storage.packed_bits has no effect, the pairs are not 16 bits raw images "
+		                 "or the depth is neither 10 nor 12" );
+	}
+
+	const size_t count{ 2 * std::max<size_t>( params_.queueDepth, 1 ) };
+
+	for( size_t i = 0; i < count; ++i )
+	{
+		void* buffer{ nullptr };
+		if( ::posix_memalign( &buffer, DIRECT_ALIGNMENT, recordSize_ ) != 0 )
+		{
+			return false;
+		}
+
+		// The padding of the records is written as is, keep it deterministic.
+		std::memset( buffer, 0, recordSize_ );
+		buffers_.push_back( static_cast<uint8_t*>( buffer ) );
+		requests_.push_back( Request{ i, 0 } );
+		free_.push_back( i );
+	}
+
+#ifdef WITH_IO_URING
+	if( uring_ )
+	{
+		if( io_uring_queue_init( static_cast<unsigned>( count ), &ring_, 0 ) < 0 )
+		{
+			ht::log_warning( "unable to create the io_uring, using O_DIRECT writer threads" );
+			uring_ = false;
+		}
+		else
+		{
+			return true;
+		}
+	}
+#endif
+
+	for( uint32_t i = 0; i < std::max<uint32_t>( params_.queueDepth, 1 ); ++i )
+	{
+		writers_.emplace_back( &DirectFrameStore::write_loop, this );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+DirectFrameStore::reserve( const uint64_t end )
+{
+	if( end <= allocated_ )
+	{
+		return;
+	}
+
+	const uint64_t extension{ std::max<uint64_t>( params_.preallocateInMb * BYTES_PER_MB,
+	                                              recordSize_ ) };
+
+	// Without fallocate support the writes still extend the file, only the extents may scatter.
+	::fallocate( fd_, 0, static_cast<off_t>( allocated_ ), static_cast<off_t>( extension ) );
+	allocated_ += extension;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+DirectFrameStore::acquire_buffer()
+{
+	wait_in_flight( buffers_.size() - 1 );
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	const size_t buffer = free_.front();
+	free_.pop_front();
+	return buffer;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+DirectFrameStore::submit( const Request& request )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		requests_[request.buffer] = request;
+		++inFlight_;
+	}
+
+#ifdef WITH_IO_URING
+	if( uring_ )
+	{
+		io_uring_sqe* sqe = io_uring_get_sqe( &ring_ );
+		io_uring_prep_write( sqe, fd_, buffers_[request.buffer],
+		                     static_cast<unsigned>( recordSize_ ), request.offset );
+		io_uring_sqe_set_data( sqe, &requests_[request.buffer] );
+		io_uring_submit( &ring_ );
+		reap( buffers_.size() );
+		return;
+	}
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		queue_.push_back( request.buffer );
+	}
+	condition_.notify_all();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+DirectFrameStore::complete( const size_t buffer, const bool success )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		free_.push_back( buffer );
+		--inFlight_;
+	}
+	condition_.notify_all();
+
+	if( !success )
+	{
+		failed_ = true;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+DirectFrameStore::wait_in_flight( const size_t pending )
+{
+#ifdef WITH_IO_URING
+	if( uring_ )
+	{
+		reap( pending );
+		return;
+	}
+#endif
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+	condition_.wait( lock, [ this, pending ]()
+	{ return inFlight_ <= pending; } );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+DirectFrameStore::write_loop()
+{
+	std::unique_lock<std::mutex> lock( mutex_ );
+
+	while( true )
+	{
+		condition_.wait( lock, [ this ]()
+		{ return !queue_.empty() || !running_; } );
+
+		if( queue_.empty() )
+		{
+			return;
+		}
+
+		const Request request = requests_[queue_.front()];
+		queue_.pop_front();
+		lock.unlock();
+
+		const ssize_t written = ::pwrite( fd_, buffers_[request.buffer], recordSize_,
+		                                  static_cast<off_t>( request.offset ) );
+
+		complete( request.buffer, written == static_cast<ssize_t>( recordSize_ ) );
+		lock.lock();
+	}
+}
+
+#ifdef WITH_IO_URING
+//--------------------------------------------------------------------------------------------------
+//
+void
+DirectFrameStore::reap( const size_t pending )
+{
+	io_uring_cqe* cqe{ nullptr };
+
+	while( inFlight_ > pending && io_uring_wait_cqe( &ring_, &cqe ) == 0 )
+	{
+		const Request* request = static_cast<Request*>( io_uring_cqe_get_data( cqe ) );
+		complete( request->buffer, cqe->res == static_cast<int32_t>( recordSize_ ) );
+		io_uring_cqe_seen( &ring_, cqe );
+	}
+
+	while( io_uring_peek_cqe( &ring_, &cqe ) == 0 )
+	{
+		const Request* request = static_cast<Request*>( io_uring_cqe_get_data( cqe ) );
+		complete( request->buffer, cqe->res == static_cast<int32_t>( recordSize_ ) );
+		io_uring_cqe_seen( &ring_, cqe );
+	}
+}
+#endif
+
+//--------------------------------------------------------------------------------------------------
+//
+std::unique_ptr<FrameStore>
+make_frame_store( const StorageParams& params, const std::string& folderPath )
+{
+	if( params.backend == "direct" || params.backend == "uring" )
+	{
+		return std::unique_ptr<FrameStore>{ new DirectFrameStore( params, folderPath ) };
+	}
+
+	if( params.backend != "tiff" )
+	{
+		ht::log_warning( "unknown storage backend " + params.backend + ", using tiff" );
+	}
+	return std::unique_ptr<FrameStore>{ new TiffFrameStore( folderPath ) };
+}
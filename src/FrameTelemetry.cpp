@@ -0,0 +1,271 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "FrameTelemetry.hpp"
+#include "AsyncLog.hpp"
+
+#include <cmath>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// A camera interval this many periods longer than expected is counted as a camera stall.
+const double STALL_RATIO{ 1.5 };
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+FrameTelemetry::FrameTelemetry( const TelemetryParams& params, const uint32_t periodInUs )
+	: params_{ params }
+	, periodInUs_{ static_cast<double>( periodInUs ) }
+	, csv_{ }
+	, lastHostTime_{ }
+	, lastExport_{ Clock::now() }
+	, lastIndex_{ }
+	, lastTimestamp_{ }
+	, hasLast_{ }
+	, frames_{ }
+	, hostDrops_{ }
+	, cameraStalls_{ }
+	, discontinuities_{ }
+	, cameraJitter_{ std::max<size_t>( params.window, 1 ) }
+	, hostJitter_{ std::max<size_t>( params.window, 1 ) }
+	, processing_{ std::max<size_t>( params.window, 1 ) }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+FrameTelemetry::~FrameTelemetry()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+RollingStatistics::mean() const
+{
+	if( count_ == 0 )
+	{
+		return 0.0;
+	}
+
+	double sum{ };
+	for( size_t i = 0; i < count_; ++i )
+	{
+		sum += samples_[i];
+	}
+	return sum / static_cast<double>( count_ );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+RollingStatistics::stddev() const
+{
+	if( count_ < 2 )
+	{
+		return 0.0;
+	}
+
+	const double average = mean();
+	double sum{ };
+	for( size_t i = 0; i < count_; ++i )
+	{
+		sum += (samples_[i] - average) * (samples_[i] - average);
+	}
+	return std::sqrt( sum / static_cast<double>( count_ - 1 ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+RollingStatistics::minimum() const
+{
+	if( count_ == 0 )
+	{
+		return 0.0;
+	}
+	return *std::min_element( samples_.data(), samples_.data() + count_ );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+RollingStatistics::maximum() const
+{
+	if( count_ == 0 )
+	{
+		return 0.0;
+	}
+	return *std::max_element( samples_.data(), samples_.data() + count_ );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+RollingStatistics::percentile( const double ratio )
+{
+	if( count_ == 0 )
+	{
+		return 0.0;
+	}
+
+	std::copy( samples_.data(), samples_.data() + count_, sorted_.begin() );
+
+	const size_t rank = std::min( count_ - 1, static_cast<size_t>(
+		std::floor( ratio * static_cast<double>( count_ - 1 ) + 0.5 ) ) );
+
+	std::nth_element( sorted_.data(), sorted_.data() + rank, sorted_.data() + count_ );
+	return sorted_[rank];
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+FrameTelemetry::open( const std::string& folderPath )
+{
+	if( !params_.enabled )
+	{
+		return true;
+	}
+
+	csv_.open( folderPath + "/telemetry.csv", std::ios::out | std::ios::trunc );
+	if( !csv_.is_open() )
+	{
+		return false;
+	}
+
+	csv_ << "frames,host_drops,camera_stalls,discontinuities,"
+	     << "camera_jitter_mean_us,camera_jitter_std_us,camera_jitter_max_us,"
+	     << "host_jitter_std_us,host_jitter_p99_us,"
+	     << "processing_mean_us,processing_p99_us" << std::endl;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+FrameTelemetry::observe( const uint64_t index, const uint64_t timestampInUs,
+                         const double processingInUs )
+{
+	if( !params_.enabled )
+	{
+		return;
+	}
+
+	const Clock::time_point now = Clock::now();
+
+	++frames_;
+	processing_.add( processingInUs );
+
+	if( hasLast_ )
+	{
+		if( index <= lastIndex_ || timestampInUs <= lastTimestamp_ )
+		{
+			// Camera restarted or entries delivered out of order, the intervals are meaningless.
+			++discontinuities_;
+		}
+		else
+		{
+			const uint64_t indexDelta = index - lastIndex_;
+			hostDrops_ += indexDelta - 1;
+
+			const double cameraInterval = static_cast<double>( timestampInUs - lastTimestamp_ );
+			const double expected = static_cast<double>( indexDelta ) * periodInUs_;
+
+			if( indexDelta == 1 && cameraInterval > STALL_RATIO * periodInUs_ )
+			{
+				++cameraStalls_;
+			}
+
+			const double hostInterval = static_cast<double>(
+				std::chrono::duration_cast<std::chrono::microseconds>(
+					now - lastHostTime_ ).count() );
+
+			cameraJitter_.add( cameraInterval - expected );
+			hostJitter_.add( hostInterval - cameraInterval );
+		}
+	}
+
+	lastIndex_ = index;
+	lastTimestamp_ = timestampInUs;
+	lastHostTime_ = now;
+	hasLast_ = true;
+
+	update();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+FrameTelemetry::update()
+{
+	if( Clock::now() - lastExport_ >= std::chrono::milliseconds( params_.exportPeriodInMs ) )
+	{
+		export_statistics();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+FrameTelemetry::export_statistics()
+{
+	if( !params_.enabled )
+	{
+		return;
+	}
+
+	lastExport_ = Clock::now();
+
+	const double cameraJitterMax = std::max( std::fabs( cameraJitter_.minimum() ),
+	                                         std::fabs( cameraJitter_.maximum() ) );
+	const double hostJitterP99 = hostJitter_.percentile( 0.99 );
+	const double processingP99 = processing_.percentile( 0.99 );
+
+	if( csv_.is_open() )
+	{
+		csv_ << frames_ << "," << hostDrops_ << "," << cameraStalls_ << "," << discontinuities_
+		     << "," << cameraJitter_.mean() << "," << cameraJitter_.stddev() << ","
+		     << cameraJitterMax << "," << hostJitter_.stddev() << "," << hostJitterP99 << ","
+		     << processing_.mean() << "," << processingP99 << std::endl;
+	}
+
+	if( params_.print )
+	{
+		AsyncLog::print_line( "frames: ", frames_, " host drops: ", hostDrops_, " camera stalls: ",
+		                      cameraStalls_, " camera jitter: ", cameraJitter_.stddev(),
+		                      " us host jitter p99: ", hostJitterP99, " us processing p99: ",
+		                      processingP99, " us" );
+	}
+}
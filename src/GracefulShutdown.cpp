@@ -0,0 +1,212 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "GracefulShutdown.hpp"
+
+#include "HTLogger.h"
+#include "CLPrint.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+GracefulShutdown::GracefulShutdown( const ShutdownParams& params )
+	: params_{ params }
+	, sessionPath_{ }
+	, armed_{ false }
+	, armedAt_{ }
+	, counters_{ }
+	, mutex_{ }
+	, condition_{ }
+	, watchdog_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+GracefulShutdown::~GracefulShutdown()
+{
+	disarm();
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+GracefulShutdown::arm( const std::string& sessionPath )
+{
+	// Called from the signal thread as well as from the processing thread.
+	std::lock_guard<std::mutex> lock( mutex_ );
+	if( armed_ )
+	{
+		return;
+	}
+
+	sessionPath_ = sessionPath;
+	armedAt_ = Clock::now();
+	armed_ = true;
+
+	watchdog_ = std::thread( &GracefulShutdown::watch, this );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+GracefulShutdown::disarm()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		armed_ = false;
+	}
+	condition_.notify_all();
+
+	if( watchdog_.joinable() )
+	{
+		watchdog_.join();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+GracefulShutdown::drain_expired() const
+{
+	return armed_ && Clock::now() - armedAt_ >
+	                 std::chrono::milliseconds( params_.drainDeadlineInMs );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+GracefulShutdown::count_frame( const uint64_t index, const bool success )
+{
+	if( !counters_.hasIndex )
+	{
+		counters_.firstIndex = index;
+		counters_.lastIndex = index;
+		counters_.hasIndex = true;
+	}
+
+	counters_.firstIndex = std::min( counters_.firstIndex, index );
+	counters_.lastIndex = std::max( counters_.lastIndex, index );
+
+	if( !success )
+	{
+		++counters_.failed;
+	}
+	else if( armed_ )
+	{
+		++counters_.drained;
+	}
+	else
+	{
+		++counters_.processed;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+GracefulShutdown::count_discarded()
+{
+	++counters_.discarded;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const CaptureCounters&
+GracefulShutdown::get_counters() const
+{
+	return counters_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+GracefulShutdown::print_report() const
+{
+	const uint64_t processed{ counters_.processed + counters_.drained };
+	const uint64_t expected{ counters_.hasIndex ? counters_.lastIndex - counters_.firstIndex + 1
+	                                            : 0 };
+	const uint64_t lost{ expected > processed ? expected - processed : 0 };
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		Clock::now() - armedAt_ );
+
+	cl::print_line( "Shutdown completed in ", elapsed.count(), " ms" );
+	cl::print_line( "  frames processed: ", processed, " (", counters_.drained, " drained)" );
+	cl::print_line( "  frames failed:    ", counters_.failed );
+	cl::print_line( "  frames discarded: ", counters_.discarded );
+	cl::print_line( "  frames lost:      ", lost, " of ", expected, " (index ",
+	                counters_.firstIndex, " to ", counters_.lastIndex, ")" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+GracefulShutdown::sync_folder( const std::string& folderPath )
+{
+	int32_t fd = ::open( folderPath.c_str(), O_RDONLY | O_DIRECTORY );
+	if( fd < 0 )
+	{
+		return false;
+	}
+
+	// syncfs flushes every file written in the session, fsync persists the folder entries.
+	bool synced = ::syncfs( fd ) == 0;
+	synced = ::fsync( fd ) == 0 && synced;
+
+	::close( fd );
+	return synced;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+GracefulShutdown::watch()
+{
+	std::unique_lock<std::mutex> lock( mutex_ );
+
+	const bool completed = condition_.wait_until(
+		lock, armedAt_ + std::chrono::milliseconds( params_.hardDeadlineInMs ),
+		[ this ]()
+		{ return !armed_; } );
+
+	if( !completed )
+	{
+		ht::log_warning( "shutdown deadline exceeded, forcing exit" );
+		sync_folder( sessionPath_ );
+		std::_Exit( EXIT_FAILURE );
+	}
+}
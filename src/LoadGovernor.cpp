@@ -0,0 +1,378 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "LoadGovernor.hpp"
+#include "AsyncLog.hpp"
+
+#include "CLPrint.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Restoring a stage waits this many times longer than shedding one, so that a load close to the
+/// budget does not make the stages flicker.
+const uint32_t RESTORE_HOLD_FACTOR{ 4 };
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+LoadGovernor::LoadGovernor( const GovernorParams& params, const uint32_t periodInUs )
+	: params_{ params }
+	, budgetInUs_{ static_cast<double>( params.budgetInUs ? params.budgetInUs : periodInUs ) }
+	, stages_{ }
+	, steps_{ }
+	, level_{ }
+	, cost_{ }
+	, hasCost_{ }
+	, lastIndex_{ }
+	, hasIndex_{ }
+	, queueOverloaded_{ }
+	, sinceChange_{ }
+	, sinceOverload_{ }
+	, frames_{ }
+	, lostFrames_{ }
+	, shedFrames_{ }
+	, changes_{ }
+	, maxLevel_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+LoadGovernor::~LoadGovernor()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+GovernedStage::GovernedStage( LoadGovernor& governor, const std::string& name )
+	: governor_( governor )
+	, slot_{ governor.add_stage( name ) }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+GovernedStage::~GovernedStage()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+GovernedSink::GovernedSink( LoadGovernor& governor, const std::string& name, StereoSink& sink )
+	: governor_( governor )
+	, slot_{ governor.add_stage( name ) }
+	, sink_( sink )
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+GovernedSink::~GovernedSink()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+LoadGovernor::add_stage( const std::string& name )
+{
+	stages_.push_back( Stage{ name, params_.stage( name ), 0.0, 0, 0, 0, 1 } );
+
+	build_steps();
+	apply_level();
+
+	return stages_.size() - 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+LoadGovernor::admit( const size_t slot )
+{
+	Stage& stage = stages_[slot];
+
+	const bool admitted{ stage.decimation != 0 && stage.counter++ % stage.decimation == 0 };
+	if( !admitted )
+	{
+		++stage.skipped;
+	}
+
+	return admitted;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+LoadGovernor::observe_stage( const size_t slot, const double costInUs )
+{
+	Stage& stage = stages_[slot];
+
+	stage.cost = stage.runs ? params_.smoothing * stage.cost + (1.0 - params_.smoothing) * costInUs
+	                        : costInUs;
+	++stage.runs;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+LoadGovernor::observe_queue( const size_t depth, const size_t limit )
+{
+	queueOverloaded_ = limit > 0 && 2 * depth >= limit;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+LoadGovernor::observe_frame( const uint64_t index, const double costInUs )
+{
+	cost_ = hasCost_ ? params_.smoothing * cost_ + (1.0 - params_.smoothing) * costInUs
+	                 : costInUs;
+	hasCost_ = true;
+
+	// Frames the camera delivered while this pair was processed, dropped by pop_newest_entry.
+	const uint64_t lost{ hasIndex_ && index > lastIndex_ + 1 ? index - lastIndex_ - 1 : 0 };
+	lastIndex_ = index;
+	hasIndex_ = true;
+
+	++frames_;
+	lostFrames_ += lost;
+	shedFrames_ += level_ > 0 ? 1 : 0;
+	++sinceChange_;
+
+	const bool overloaded{ cost_ > params_.highRatio * budgetInUs_ || lost > 0 ||
+	                       queueOverloaded_ };
+	const bool underloaded{ cost_ < params_.lowRatio * budgetInUs_ };
+
+	// A single overloaded pair, e.g. the one a decimated stage runs on, delays every restoration.
+	sinceOverload_ = overloaded ? 0 : sinceOverload_ + 1;
+
+	bool changed{ false };
+
+	if( overloaded && level_ < steps_.size() && sinceChange_ >= params_.holdFrames )
+	{
+		const Step& step = steps_[level_++];
+		changed = true;
+
+		if( params_.print && step.decimation )
+		{
+			AsyncLog::print_line( "governor: level ", level_, ", ", stages_[step.stage].name,
+			                      " decimated by ", step.decimation );
+		}
+		else if( params_.print )
+		{
+			AsyncLog::print_line( "governor: level ", level_, ", ", stages_[step.stage].name,
+			                      " skipped" );
+		}
+	}
+	else if( underloaded && level_ > 0 && sinceChange_ >= params_.holdFrames &&
+	         sinceOverload_ >= RESTORE_HOLD_FACTOR * params_.holdFrames )
+	{
+		const Step& step = steps_[--level_];
+		changed = true;
+
+		if( params_.print )
+		{
+			AsyncLog::print_line( "governor: level ", level_, ", ", stages_[step.stage].name,
+			                      " restored by one step" );
+		}
+	}
+
+	if( changed )
+	{
+		sinceChange_ = 0;
+		++changes_;
+		maxLevel_ = std::max( maxLevel_, level_ );
+	}
+
+	apply_level();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+LoadGovernor::get_level() const
+{
+	return level_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+LoadGovernor::print_report() const
+{
+	cl::print_line( "Load governor: ", frames_, " pairs, ", lostFrames_, " camera frames lost, ",
+	                shedFrames_, " pairs with shed stages, ", changes_, " level changes, level ",
+	                maxLevel_, " of ", steps_.size(), " reached" );
+
+	for( const Stage& stage : stages_ )
+	{
+		cl::print_line( "  ", stage.name, ": ", stage.runs, " runs, ", stage.skipped,
+		                " skipped, ", stage.cost, " us per run",
+		                stage.params.sheddable ? "" : ", never shed" );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+LoadGovernor::build_steps()
+{
+	std::vector<size_t> order;
+	for( size_t i = 0; i < stages_.size(); ++i )
+	{
+		if( stages_[i].params.sheddable )
+		{
+			order.push_back( i );
+		}
+	}
+
+	std::stable_sort( order.begin(), order.end(), [ this ]( const size_t a, const size_t b )
+	{ return stages_[a].params.priority < stages_[b].params.priority; } );
+
+	steps_.clear();
+	for( const size_t slot : order )
+	{
+		const uint32_t maxDecimation{ stages_[slot].params.maxDecimation };
+		if( maxDecimation == 0 )
+		{
+			steps_.push_back( Step{ slot, 0 } );
+		}
+
+		for( uint32_t decimation = 2; decimation <= maxDecimation; decimation *= 2 )
+		{
+			steps_.push_back( Step{ slot, decimation } );
+		}
+	}
+
+	level_ = std::min( level_, steps_.size() );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+LoadGovernor::apply_level()
+{
+	for( Stage& stage : stages_ )
+	{
+		stage.decimation = 1;
+	}
+
+	// Later steps of a stage decimate it further, they override the earlier ones.
+	for( size_t i = 0; i < level_; ++i )
+	{
+		stages_[steps_[i].stage].decimation = steps_[i].decimation;
+	}
+
+	// A stage over its own budget is decimated until its mean cost per pair fits.
+	for( Stage& stage : stages_ )
+	{
+		const double budgetInUs{ static_cast<double>( stage.params.budgetInUs ) };
+		if( !stage.params.sheddable || budgetInUs <= 0.0 || stage.decimation == 0 )
+		{
+			continue;
+		}
+
+		uint32_t decimation{ 1 };
+		while( 2 * decimation <= stage.params.maxDecimation &&
+		       stage.cost / decimation > budgetInUs )
+		{
+			decimation *= 2;
+		}
+		stage.decimation = std::max( stage.decimation, decimation );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+GovernedStage::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	if( !governor_.admit( slot_ ) )
+	{
+		return true;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	bool success{ true };
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter && !iter->compute_result( context, inResult ) )
+		{
+			success = false;
+			break;
+		}
+	}
+
+	governor_.observe_stage( slot_, static_cast<double>(
+		std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start ).count() ) );
+
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+GovernedStage::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+GovernedStage::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+GovernedSink::submit( const StereoFrame& frame )
+{
+	if( !governor_.admit( slot_ ) )
+	{
+		return true;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const bool success{ sink_.submit( frame ) };
+
+	governor_.observe_stage( slot_, static_cast<double>(
+		std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start ).count() ) );
+
+	return success;
+}
@@ -0,0 +1,251 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "MultiLevelThreshold.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Variance of a uniform distribution over one bin, added to the class variances of the Kittler
+/// criterion so that a class of a single bin does not have an infinitely small cost.
+const double BIN_VARIANCE{ 1.0 / 12.0 };
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+MultiLevelThreshold::MultiLevelThreshold( const ThresholdCriterion criterion )
+	: criterion_{ criterion }
+	, weights_{ }
+	, sums_{ }
+	, squares_{ }
+	, classCosts_{ }
+	, costs_{ }
+	, splits_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+MultiLevelThreshold::~MultiLevelThreshold()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+MultiLevelThreshold::set_histogram( const std::vector<uint32_t>& histogram )
+{
+	set_histogram( histogram.data(), histogram.size() );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+MultiLevelThreshold::set_histogram( const uint32_t* histogram, const size_t bins )
+{
+	weights_.assign( bins + 1, 0.0 );
+	sums_.assign( bins + 1, 0.0 );
+	squares_.assign( bins + 1, 0.0 );
+
+	for( size_t i = 0; i < bins; ++i )
+	{
+		const double count{ static_cast<double>( histogram[i] ) };
+		const double value{ static_cast<double>( i ) };
+
+		weights_[i + 1] = weights_[i] + count;
+		sums_[i + 1] = sums_[i] + value * count;
+		squares_[i + 1] = squares_[i] + value * value * count;
+	}
+
+	const double total{ weights_[bins] };
+	if( total > 0.0 )
+	{
+		for( size_t i = 1; i <= bins; ++i )
+		{
+			weights_[i] /= total;
+			sums_[i] /= total;
+			squares_[i] /= total;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+MultiLevelThreshold::compute( const size_t classes, std::vector<uint32_t>& thresholds )
+{
+	thresholds.clear();
+
+	const size_t bins{ weights_.empty() ? 0 : weights_.size() - 1 };
+
+	// Every class holds a non-empty bin, so the thresholds lie between the first and last
+	// non-empty bins [first, last) and the empty bins outside are left out of the search.
+	size_t first{ };
+	while( first < bins && weights_[first + 1] <= weights_[first] )
+	{
+		++first;
+	}
+
+	size_t last{ bins };
+	while( last > first && weights_[last] <= weights_[last - 1] )
+	{
+		--last;
+	}
+
+	const size_t span{ last - first };
+	if( classes == 0 || span < classes )
+	{
+		return false;
+	}
+
+	const size_t stride{ span + 1 };
+	costs_.assign( classes * stride, std::numeric_limits<double>::infinity() );
+	splits_.assign( classes * stride, 0 );
+
+	// Every class cost is used by every row, they are computed once, by end bin so that the
+	// innermost loop reads them contiguously. An empty class would cost nothing and let the
+	// Kittler criterion spend classes on empty bins, it is forbidden.
+	classCosts_.resize( stride * stride );
+	for( size_t end = 1; end <= span; ++end )
+	{
+		for( size_t begin = 0; begin < end; ++begin )
+		{
+			classCosts_[end * stride + begin] =
+				weights_[first + end] > weights_[first + begin]
+				? class_cost( first + begin, first + end )
+				: std::numeric_limits<double>::infinity();
+		}
+		costs_[end] = classCosts_[end * stride];
+	}
+
+	// Row k holds the partitions into k + 1 classes, every class holding at least one bin.
+	for( size_t k = 1; k < classes; ++k )
+	{
+		const double* previous{ costs_.data() + (k - 1) * stride };
+		double* current{ costs_.data() + k * stride };
+		uint32_t* splits{ splits_.data() + k * stride };
+
+		// Only the whole histogram is needed from the last row.
+		const size_t firstEnd{ k + 1 == classes ? span : k + 1 };
+
+		for( size_t end = firstEnd; end <= span; ++end )
+		{
+			const double* endCosts{ classCosts_.data() + end * stride };
+			double best{ std::numeric_limits<double>::infinity() };
+			size_t split{ k };
+
+			for( size_t begin = k; begin < end; ++begin )
+			{
+				const double cost{ previous[begin] + endCosts[begin] };
+				if( cost < best )
+				{
+					best = cost;
+					split = begin;
+				}
+			}
+
+			current[end] = best;
+			splits[end] = static_cast<uint32_t>( split );
+		}
+	}
+
+	// Fewer non-empty bins than classes.
+	if( std::isinf( costs_[(classes - 1) * stride + span] ) )
+	{
+		return false;
+	}
+
+	thresholds.resize( classes - 1 );
+
+	size_t end{ span };
+	for( size_t k = classes - 1; k > 0; --k )
+	{
+		end = splits_[k * stride + end];
+		thresholds[k - 1] = static_cast<uint32_t>( first + end );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+MultiLevelThreshold::evaluate( const std::vector<uint32_t>& thresholds ) const
+{
+	const size_t bins{ weights_.empty() ? 0 : weights_.size() - 1 };
+
+	double criterion{ criterion_ == ThresholdCriterion::Kittler ? 1.0 : 0.0 };
+	size_t begin{ };
+
+	for( const uint32_t threshold : thresholds )
+	{
+		const size_t end{ std::min<size_t>( std::max<size_t>( threshold, begin ), bins ) };
+		criterion += class_cost( begin, end );
+		begin = end;
+	}
+
+	return criterion + class_cost( begin, bins );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+ThresholdCriterion
+MultiLevelThreshold::get_criterion() const
+{
+	return criterion_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+MultiLevelThreshold::class_cost( const size_t begin, const size_t end ) const
+{
+	const double weight{ weights_[end] - weights_[begin] };
+	if( weight <= 0.0 )
+	{
+		return 0.0;
+	}
+
+	const double mean{ (sums_[end] - sums_[begin]) / weight };
+	const double variance{ std::max( (squares_[end] - squares_[begin]) / weight - mean * mean,
+	                                 0.0 ) };
+
+	if( criterion_ == ThresholdCriterion::Otsu )
+	{
+		return weight * variance;
+	}
+
+	return weight * (std::log( variance + BIN_VARIANCE ) - 2.0 * std::log( weight ));
+}
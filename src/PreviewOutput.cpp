@@ -0,0 +1,333 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "PreviewOutput.hpp"
+#include "FrameAccess.hpp"
+#include "ThreadPlacement.hpp"
+
+#include "CLPrint.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <time.h>
+
+#include <cstdio>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+const char* const WINDOW_NAME{ "camCapture preview" };
+
+double
+thread_cpu_time_us()
+{
+	timespec now{ };
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+	return static_cast<double>( now.tv_sec ) * 1e6 + static_cast<double>( now.tv_nsec ) * 1e-3;
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+PreviewOutput::PreviewOutput( const PreviewParams& params, const ThreadRoleParams& placement,
+                              const std::string& folderPath )
+	: params_{ params }
+	, placement_{ placement }
+	, filepath_{ params.file.empty() ? "" : folderPath + "/" + params.file }
+	, mutex_{ }
+	, condition_{ }
+	, thread_{ }
+	, running_{ }
+	, pending_{ }
+	, slot_{ }
+	, left_{ }
+	, right_{ }
+	, sideBySide_{ }
+	, lastSubmit_{ }
+	, lastReport_{ }
+	, submitted_{ }
+	, skipped_{ }
+	, submitTimeInUs_{ }
+	, cpuLoad_{ }
+	, rendered_{ }
+	, cpuTimeInUs_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+PreviewOutput::~PreviewOutput()
+{
+	stop();
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+PreviewOutput::start()
+{
+	if( running_ )
+	{
+		return;
+	}
+
+	running_ = true;
+	thread_ = std::thread( &PreviewOutput::process, this );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+PreviewOutput::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		running_ = false;
+	}
+	condition_.notify_all();
+
+	if( thread_.joinable() )
+	{
+		thread_.join();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+PreviewOutput::submit( const StereoFrame& frame )
+{
+	const Clock::time_point now = Clock::now();
+
+	// Skipping a pair is how the output keeps up, it is not a failure.
+	if( now - lastSubmit_ < std::chrono::milliseconds( params_.periodInMs ) )
+	{
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock( mutex_, std::try_to_lock );
+	if( !lock.owns_lock() || pending_ || !running_ )
+	{
+		++skipped_;
+		return true;
+	}
+
+	// The slot keeps its buffers from one preview to the next, copying does not allocate.
+	slot_.index = frame.index;
+	slot_.timestamp = frame.timestamp;
+	frame.left.copyTo( slot_.left );
+	frame.right.copyTo( slot_.right );
+	pending_ = true;
+
+	lock.unlock();
+	condition_.notify_one();
+
+	lastSubmit_ = now;
+	++submitted_;
+	submitTimeInUs_ += static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::microseconds>( Clock::now() - now ).count() );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+PreviewOutput::get_cpu_load() const
+{
+	return cpuLoad_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+PreviewOutput::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	co::OutputResult result;
+	result.start_benchmark();
+
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) )
+	{
+		return false;
+	}
+
+	submit( frame );
+
+	result.stop_benchmark();
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, result ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+PreviewOutput::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+PreviewOutput::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+PreviewOutput::process()
+{
+	ThreadPlacement::apply_to_current_thread( placement_ );
+
+	lastReport_ = Clock::now();
+	std::unique_lock<std::mutex> lock( mutex_ );
+
+	while( running_ )
+	{
+		condition_.wait( lock, [ this ]()
+		{ return pending_ || !running_; } );
+
+		if( !pending_ )
+		{
+			continue;
+		}
+
+		// The processing thread does not touch the slot while pending_ is set.
+		lock.unlock();
+
+		const double cpuStart = thread_cpu_time_us();
+		render();
+		const double cpuTime = thread_cpu_time_us() - cpuStart;
+
+		report( Clock::now(), cpuTime );
+
+		lock.lock();
+		pending_ = false;
+	}
+
+	if( params_.display )
+	{
+		cv::destroyWindow( WINDOW_NAME );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+PreviewOutput::render()
+{
+	const double scale{ 1.0 / static_cast<double>( std::max<uint32_t>( params_.decimation, 1 ) ) };
+
+	cv::Mat colourLeft{ slot_.left };
+	cv::Mat colourRight{ slot_.right };
+
+	if( slot_.left.channels() == 1 )
+	{
+		demosaic( slot_.left, colourLeft );
+		demosaic( slot_.right, colourRight );
+	}
+
+	cv::resize( colourLeft, left_, cv::Size(), scale, scale, cv::INTER_AREA );
+	cv::resize( colourRight, right_, cv::Size(), scale, scale, cv::INTER_AREA );
+	cv::hconcat( left_, right_, sideBySide_ );
+
+	++rendered_;
+
+	if( params_.display )
+	{
+		cv::imshow( WINDOW_NAME, sideBySide_ );
+		cv::waitKey( 1 );
+	}
+
+	if( !filepath_.empty() )
+	{
+		// Readers of the preview file never see a partially written image.
+		const std::string tmpFilepath{ filepath_ + ".tmp.jpg" };
+		const std::vector<int32_t> options{ CV_IMWRITE_JPEG_QUALITY,
+		                                    static_cast<int32_t>( params_.jpegQuality ) };
+
+		if( cv::imwrite( tmpFilepath, sideBySide_, options ) )
+		{
+			std::rename( tmpFilepath.c_str(), filepath_.c_str() );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+PreviewOutput::report( const Clock::time_point& now, const double cpuTimeInUs )
+{
+	cpuTimeInUs_ += cpuTimeInUs;
+
+	const double elapsed = static_cast<double>(
+		std::chrono::duration_cast<std::chrono::microseconds>( now - lastReport_ ).count() );
+
+	if( params_.reportPeriodInMs == 0 || elapsed < params_.reportPeriodInMs * 1000.0 )
+	{
+		return;
+	}
+
+	cpuLoad_ = 100.0 * cpuTimeInUs_ / elapsed;
+
+	const uint64_t submitted = submitted_;
+	cl::print_line( "preview: ", rendered_, " rendered, ", skipped_, " skipped, cpu ",
+	                cpuLoad_.load(), " %, ",
+	                rendered_ ? cpuTimeInUs_ / static_cast<double>( rendered_ ) : 0.0,
+	                " us per preview, processing thread ",
+	                submitted ? static_cast<double>( submitTimeInUs_ ) /
+	                            static_cast<double>( submitted ) : 0.0,
+	                " us per submit" );
+
+	lastReport_ = now;
+	rendered_ = 0;
+	cpuTimeInUs_ = 0.0;
+	submitted_ = 0;
+	skipped_ = 0;
+	submitTimeInUs_ = 0;
+}
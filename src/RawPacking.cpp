@@ -0,0 +1,333 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "RawPacking.hpp"
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Pixels processed by every step of the SIMD kernels.
+const size_t SIMD_BLOCK{ 16 };
+
+/// Geometry of a packed row.
+struct PackLayout
+{
+	/// Bits of the low plane per pixel, and pixels sharing a byte of it.
+	uint32_t lowBits;
+	size_t slots;
+
+	/// Bytes of the low plane.
+	size_t lowSize;
+
+	uint16_t maximum;
+	uint8_t mask;
+};
+
+PackLayout
+make_layout( const size_t width, const uint32_t bits )
+{
+	PackLayout layout;
+	layout.lowBits = bits - 8;
+	layout.slots = 8 / layout.lowBits;
+	layout.lowSize = (width + layout.slots - 1) / layout.slots;
+	layout.maximum = static_cast<uint16_t>( (1u << bits) - 1 );
+	layout.mask = static_cast<uint8_t>( (1u << layout.lowBits) - 1 );
+	return layout;
+}
+
+/// Writes the high plane of the pixels [begin, width).
+inline void
+pack_high( const uint16_t* src, const size_t begin, const size_t width, const PackLayout& layout,
+           uint8_t* high )
+{
+	for( size_t x = begin; x < width; ++x )
+	{
+		high[x] = static_cast<uint8_t>( std::min( src[x], layout.maximum ) >> layout.lowBits );
+	}
+}
+
+/// Writes the bytes [begin, lowSize) of the low plane.
+inline void
+pack_low( const uint16_t* src, const size_t begin, const size_t width, const PackLayout& layout,
+          uint8_t* low )
+{
+	for( size_t j = begin; j < layout.lowSize; ++j )
+	{
+		uint32_t byte{ 0 };
+		for( size_t slot = 0, x = j; slot < layout.slots && x < width;
+		     ++slot, x += layout.lowSize )
+		{
+			byte |= static_cast<uint32_t>( std::min( src[x], layout.maximum ) & layout.mask ) <<
+			        (slot * layout.lowBits);
+		}
+		low[j] = static_cast<uint8_t>( byte );
+	}
+}
+
+/// Unpacks the pixels [begin, end) of one slot of the low plane.
+inline void
+unpack_pixels( const uint8_t* high, const uint8_t* low, const size_t begin, const size_t end,
+               const size_t slot, const PackLayout& layout, uint16_t* dst )
+{
+	const uint32_t shift{ static_cast<uint32_t>( slot ) * layout.lowBits };
+	const size_t first{ slot * layout.lowSize };
+
+	for( size_t x = begin; x < end; ++x )
+	{
+		dst[x] = static_cast<uint16_t>( (static_cast<uint32_t>( high[x] ) << layout.lowBits) |
+		                                ((low[x - first] >> shift) & layout.mask) );
+	}
+}
+
+#if defined( __SSE2__ )
+
+/// Clamps 8 pixels to the maximum, SSE2 has no unsigned 16 bits minimum.
+inline __m128i
+saturate( const __m128i pixels, const __m128i maximum )
+{
+	return _mm_sub_epi16( pixels, _mm_subs_epu16( pixels, maximum ) );
+}
+
+inline __m128i
+load_pixels( const uint16_t* src )
+{
+	return _mm_loadu_si128( reinterpret_cast<const __m128i*>( src ) );
+}
+
+#endif
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+pack_row( const uint16_t* src, const size_t width, const uint32_t bits, uint8_t* dst )
+{
+	const PackLayout layout = make_layout( width, bits );
+	uint8_t* high = dst;
+	uint8_t* low = dst + width;
+
+	// The SIMD steps of the low plane read one block of every slot, the last slot is the shortest.
+	const size_t lastSlot{ (layout.slots - 1) * layout.lowSize };
+	const size_t lowBlocks{ width >= lastSlot ? std::min( layout.lowSize, width - lastSlot ) : 0 };
+
+	size_t x{ };
+	size_t j{ };
+
+#if defined( __SSE2__ )
+	const __m128i maximum = _mm_set1_epi16( static_cast<int16_t>( layout.maximum ) );
+	const __m128i mask = _mm_set1_epi16( layout.mask );
+	const __m128i lowShift = _mm_cvtsi32_si128( static_cast<int32_t>( layout.lowBits ) );
+
+	for( ; x + SIMD_BLOCK <= width; x += SIMD_BLOCK )
+	{
+		const __m128i first = _mm_srl_epi16( saturate( load_pixels( src + x ), maximum ),
+		                                     lowShift );
+		const __m128i second = _mm_srl_epi16( saturate( load_pixels( src + x + 8 ), maximum ),
+		                                      lowShift );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( high + x ),
+		                  _mm_packus_epi16( first, second ) );
+	}
+
+	for( ; j + SIMD_BLOCK <= lowBlocks; j += SIMD_BLOCK )
+	{
+		__m128i bytes = _mm_setzero_si128();
+
+		// The low bits of a slot stay within their byte once shifted, the 16 bits shift is exact.
+		for( size_t slot = 0; slot < layout.slots; ++slot )
+		{
+			const uint16_t* pixels = src + j + slot * layout.lowSize;
+			const __m128i slotBytes = _mm_packus_epi16(
+				_mm_and_si128( saturate( load_pixels( pixels ), maximum ), mask ),
+				_mm_and_si128( saturate( load_pixels( pixels + 8 ), maximum ), mask ) );
+
+			bytes = _mm_or_si128( bytes, _mm_sll_epi16( slotBytes, _mm_cvtsi32_si128(
+				static_cast<int32_t>( slot * layout.lowBits ) ) ) );
+		}
+
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( low + j ), bytes );
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	const uint16x8_t maximum = vdupq_n_u16( layout.maximum );
+	const uint16x8_t mask = vdupq_n_u16( layout.mask );
+	const int16x8_t lowShift = vdupq_n_s16( static_cast<int16_t>(
+		-static_cast<int32_t>( layout.lowBits ) ) );
+
+	for( ; x + SIMD_BLOCK <= width; x += SIMD_BLOCK )
+	{
+		const uint16x8_t first = vshlq_u16( vminq_u16( vld1q_u16( src + x ), maximum ), lowShift );
+		const uint16x8_t second = vshlq_u16( vminq_u16( vld1q_u16( src + x + 8 ), maximum ),
+		                                     lowShift );
+		vst1q_u8( high + x, vcombine_u8( vmovn_u16( first ), vmovn_u16( second ) ) );
+	}
+
+	for( ; j + SIMD_BLOCK <= lowBlocks; j += SIMD_BLOCK )
+	{
+		uint8x16_t bytes = vdupq_n_u8( 0 );
+
+		for( size_t slot = 0; slot < layout.slots; ++slot )
+		{
+			const uint16_t* pixels = src + j + slot * layout.lowSize;
+			const uint8x16_t slotBytes = vcombine_u8(
+				vmovn_u16( vandq_u16( vminq_u16( vld1q_u16( pixels ), maximum ), mask ) ),
+				vmovn_u16( vandq_u16( vminq_u16( vld1q_u16( pixels + 8 ), maximum ), mask ) ) );
+
+			bytes = vorrq_u8( bytes, vshlq_u8( slotBytes, vdupq_n_s8(
+				static_cast<int8_t>( slot * layout.lowBits ) ) ) );
+		}
+
+		vst1q_u8( low + j, bytes );
+	}
+#endif
+
+	pack_high( src, x, width, layout, high );
+	pack_low( src, j, width, layout, low );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+unpack_row( const uint8_t* src, const size_t width, const uint32_t bits, uint16_t* dst )
+{
+	const PackLayout layout = make_layout( width, bits );
+	const uint8_t* high = src;
+	const uint8_t* low = src + width;
+
+	// Every slot covers lowSize consecutive pixels, the last one may be shorter.
+	for( size_t slot = 0; slot < layout.slots; ++slot )
+	{
+		const size_t first{ std::min( slot * layout.lowSize, width ) };
+		const size_t end{ std::min( first + layout.lowSize, width ) };
+		size_t x{ first };
+
+#if defined( __SSE2__ )
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i mask = _mm_set1_epi8( static_cast<char>( layout.mask ) );
+		const __m128i lowShift = _mm_cvtsi32_si128( static_cast<int32_t>( layout.lowBits ) );
+		const __m128i slotShift = _mm_cvtsi32_si128(
+			static_cast<int32_t>( slot * layout.lowBits ) );
+
+		for( ; x + SIMD_BLOCK <= end; x += SIMD_BLOCK )
+		{
+			// The bits shifted in from the upper byte of every 16 bits lane are above the mask.
+			const __m128i highBytes = _mm_loadu_si128(
+				reinterpret_cast<const __m128i*>( high + x ) );
+			const __m128i lowBytes = _mm_and_si128( _mm_srl_epi16( _mm_loadu_si128(
+				reinterpret_cast<const __m128i*>( low + x - first ) ), slotShift ), mask );
+
+			const __m128i first8 = _mm_or_si128(
+				_mm_sll_epi16( _mm_unpacklo_epi8( highBytes, zero ), lowShift ),
+				_mm_unpacklo_epi8( lowBytes, zero ) );
+			const __m128i second8 = _mm_or_si128(
+				_mm_sll_epi16( _mm_unpackhi_epi8( highBytes, zero ), lowShift ),
+				_mm_unpackhi_epi8( lowBytes, zero ) );
+
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + x ), first8 );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + x + 8 ), second8 );
+		}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+		const uint8x16_t mask = vdupq_n_u8( layout.mask );
+		const int16x8_t lowShift = vdupq_n_s16( static_cast<int16_t>( layout.lowBits ) );
+		const int8x16_t slotShift = vdupq_n_s8( static_cast<int8_t>(
+			-static_cast<int32_t>( slot * layout.lowBits ) ) );
+
+		for( ; x + SIMD_BLOCK <= end; x += SIMD_BLOCK )
+		{
+			const uint8x16_t highBytes = vld1q_u8( high + x );
+			const uint8x16_t lowBytes = vandq_u8( vshlq_u8( vld1q_u8( low + x - first ),
+			                                                slotShift ), mask );
+
+			vst1q_u16( dst + x, vorrq_u16( vshlq_u16( vmovl_u8( vget_low_u8( highBytes ) ),
+			                                          lowShift ),
+			                               vmovl_u8( vget_low_u8( lowBytes ) ) ) );
+			vst1q_u16( dst + x + 8, vorrq_u16( vshlq_u16( vmovl_u8( vget_high_u8( highBytes ) ),
+			                                              lowShift ),
+			                                   vmovl_u8( vget_high_u8( lowBytes ) ) ) );
+		}
+#endif
+
+		unpack_pixels( high, low, x, end, slot, layout, dst );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+uint8_t*
+pack_image( const cv::Mat& image, const uint32_t bits, uint8_t* dst )
+{
+	const size_t width{ static_cast<size_t>( image.cols ) };
+	const size_t rowSize{ packed_row_size( width, bits ) };
+
+	for( int32_t y = 0; y < image.rows; ++y )
+	{
+		pack_row( image.ptr<uint16_t>( y ), width, bits, dst );
+		dst += rowSize;
+	}
+
+	return dst;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+pack_image( const cv::Mat& image, const uint32_t bits, cv::Mat& packed )
+{
+	packed.create( image.rows, static_cast<int32_t>(
+		packed_row_size( static_cast<size_t>( image.cols ), bits ) ), CV_8UC1 );
+
+	for( int32_t y = 0; y < image.rows; ++y )
+	{
+		pack_row( image.ptr<uint16_t>( y ), static_cast<size_t>( image.cols ), bits,
+		          packed.ptr<uint8_t>( y ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+unpack_image( const uint8_t* src, const int32_t width, const int32_t height, const uint32_t bits,
+              cv::Mat& image )
+{
+	const size_t rowSize{ packed_row_size( static_cast<size_t>( width ), bits ) };
+	image.create( height, width, CV_16UC1 );
+
+	for( int32_t y = 0; y < height; ++y )
+	{
+		unpack_row( src, static_cast<size_t>( width ), bits, image.ptr<uint16_t>( y ) );
+		src += rowSize;
+	}
+}
@@ -0,0 +1,277 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "RecordingGate.hpp"
+#include "FrameAccess.hpp"
+
+#include "CLPrint.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+ChangeDetector::ChangeDetector( const GateParams& params )
+	: params_{ params }
+	, reference_( std::max<uint32_t>( params.gridWidth, 1 ) *
+	              std::max<uint32_t>( params.gridHeight, 1 ), 0.f )
+	, current_( reference_.size(), 0.f )
+	, hasReference_{ }
+	, referenceTimestamp_{ }
+	, meanDifference_{ }
+	, maxDifference_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ChangeDetector::~ChangeDetector()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+RecordingGate::RecordingGate( const GateParams& params )
+	: detector_{ params }
+	, sinks_{ }
+	, stored_{ }
+	, skipped_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+RecordingGate::~RecordingGate()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ChangeDetector::compute_signature( const cv::Mat& image, std::vector<float>& signature ) const
+{
+	const int32_t blocksX{ static_cast<int32_t>( std::max<uint32_t>( params_.gridWidth, 1 ) ) };
+	const int32_t blocksY{ static_cast<int32_t>( std::max<uint32_t>( params_.gridHeight, 1 ) ) };
+	const int32_t step{ static_cast<int32_t>( std::max<uint32_t>( params_.step & ~1u, 2 ) ) };
+	const int32_t channels{ image.channels() };
+
+	signature.resize( static_cast<size_t>( blocksX * blocksY ) );
+
+	for( int32_t by = 0; by < blocksY; ++by )
+	{
+		// Even block origins keep the samples on the same Bayer colour for raw frames.
+		int32_t y0 = by * image.rows / blocksY;
+		y0 -= y0 % 2;
+		const int32_t y1 = (by + 1) * image.rows / blocksY;
+
+		for( int32_t bx = 0; bx < blocksX; ++bx )
+		{
+			int32_t x0 = bx * image.cols / blocksX;
+			x0 -= x0 % 2;
+			const int32_t x1 = (bx + 1) * image.cols / blocksX;
+
+			uint32_t sum{ };
+			uint32_t count{ };
+
+			for( int32_t y = y0; y < y1; y += step )
+			{
+				const uint8_t* row = image.ptr<uint8_t>( y );
+				for( int32_t x = x0; x < x1; x += step )
+				{
+					sum += row[x * channels];
+					++count;
+				}
+			}
+
+			signature[static_cast<size_t>( by * blocksX + bx )] =
+				count ? static_cast<float>( sum ) / static_cast<float>( count ) : 0.f;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ChangeDetector::is_keyframe( const StereoFrame& frame )
+{
+	compute_signature( frame.left, current_ );
+
+	meanDifference_ = 0.0;
+	maxDifference_ = 0.0;
+
+	bool keyframe{ !hasReference_ || frame.timestamp < referenceTimestamp_ ||
+	               frame.timestamp - referenceTimestamp_ >= params_.maxIntervalInMs * 1000ull };
+
+	if( hasReference_ )
+	{
+		for( size_t i = 0; i < current_.size(); ++i )
+		{
+			const double difference{ std::fabs( current_[i] - reference_[i] ) };
+			meanDifference_ += difference;
+			maxDifference_ = std::max( maxDifference_, difference );
+		}
+		meanDifference_ /= static_cast<double>( current_.size() );
+
+		keyframe = keyframe || meanDifference_ > params_.meanThreshold ||
+		           maxDifference_ > params_.blockThreshold;
+	}
+
+	if( keyframe )
+	{
+		std::swap( reference_, current_ );
+		referenceTimestamp_ = frame.timestamp;
+		hasReference_ = true;
+	}
+
+	return keyframe;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+ChangeDetector::get_mean_difference() const
+{
+	return meanDifference_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+double
+ChangeDetector::get_max_difference() const
+{
+	return maxDifference_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RecordingGate::add_sink( StereoSink& sink )
+{
+	sinks_.push_back( &sink );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RecordingGate::submit( const StereoFrame& frame )
+{
+	return !admit( frame ) || forward( frame );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RecordingGate::print_report() const
+{
+	const uint64_t total{ stored_ + skipped_ };
+	cl::print_line( "Recording gate: ", stored_, " frames stored, ", skipped_, " skipped (",
+	                total ? 100.0 * static_cast<double>( skipped_ ) / static_cast<double>( total )
+	                      : 0.0, " % saved)" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RecordingGate::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) )
+	{
+		return false;
+	}
+
+	if( !admit( frame ) )
+	{
+		return true;
+	}
+
+	if( !forward( frame ) )
+	{
+		return false;
+	}
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, inResult ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RecordingGate::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RecordingGate::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RecordingGate::admit( const StereoFrame& frame )
+{
+	if( !detector_.is_keyframe( frame ) )
+	{
+		++skipped_;
+		return false;
+	}
+
+	++stored_;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RecordingGate::forward( const StereoFrame& frame )
+{
+	bool success{ true };
+	for( StereoSink* sink : sinks_ )
+	{
+		success = sink->submit( frame ) && success;
+	}
+
+	return success;
+}
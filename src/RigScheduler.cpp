@@ -0,0 +1,195 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "RigScheduler.hpp"
+
+#include "CLPrint.hpp"
+
+#include <algorithm>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Longest wait for a completion before the caches of the rigs are polled again. The caches can
+/// not be waited on together, so this bounds the latency added to a newly acquired pair.
+const auto POLL_PERIOD = std::chrono::microseconds( 500 );
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+RigScheduler::RigScheduler( WorkerPool& pool )
+	: pool_( pool )
+	, slots_{ }
+	, mutex_{ }
+	, condition_{ }
+	, elapsed_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+RigScheduler::~RigScheduler()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RigScheduler::add_rig( CaptureRig& rig )
+{
+	std::unique_ptr<Slot> slot{ new Slot };
+	slot->rig = &rig;
+	slot->busy = false;
+	slots_.push_back( std::move( slot ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RigScheduler::run( const std::function<bool()>& stopped )
+{
+	const Clock::time_point start = Clock::now();
+
+	while( !stopped() )
+	{
+		if( !dispatch() )
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			condition_.wait_for( lock, POLL_PERIOD );
+		}
+	}
+
+	pool_.wait_idle();
+	elapsed_ = Clock::now() - start;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RigScheduler::drain( const std::function<bool()>& expired )
+{
+	while( !expired() )
+	{
+		if( dispatch() )
+		{
+			continue;
+		}
+
+		// Nothing was acquired, the drain is over once no rig has a pair in flight either.
+		std::unique_lock<std::mutex> lock( mutex_ );
+		const bool idle = std::none_of( slots_.begin(), slots_.end(),
+		                                []( const std::unique_ptr<Slot>& slot )
+		                                { return slot->busy.load(); } );
+		if( idle )
+		{
+			break;
+		}
+		condition_.wait_for( lock, POLL_PERIOD );
+	}
+
+	pool_.wait_idle();
+
+	for( std::unique_ptr<Slot>& slot : slots_ )
+	{
+		while( slot->rig->acquire() )
+		{
+			slot->rig->count_discarded();
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RigScheduler::dispatch()
+{
+	bool dispatched{ false };
+
+	for( std::unique_ptr<Slot>& slot : slots_ )
+	{
+		if( !slot->busy && slot->rig->acquire() )
+		{
+			slot->busy = true;
+			dispatched = true;
+
+			Slot* target = slot.get();
+			pool_.submit( [ this, target ]()
+			{
+				target->rig->process();
+				complete( *target );
+			} );
+		}
+	}
+
+	return dispatched;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RigScheduler::complete( Slot& slot )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		slot.busy = false;
+	}
+	condition_.notify_one();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RigScheduler::print_report() const
+{
+	const double seconds{ std::chrono::duration<double>( elapsed_ ).count() };
+	uint64_t total{ };
+
+	for( const std::unique_ptr<Slot>& slot : slots_ )
+	{
+		const CaptureCounters& counters = slot->rig->get_counters();
+		const uint64_t expected{ counters.hasIndex ? counters.lastIndex - counters.firstIndex + 1
+		                                           : 0 };
+		const uint64_t seen{ counters.processed + counters.failed + counters.discarded };
+		const uint64_t lost{ expected > seen ? expected - seen : 0 };
+
+		cl::print_line( "  ", slot->rig->get_params().name, ": ", counters.processed,
+		                " frames processed, ", counters.failed, " failed, ", counters.discarded,
+		                " discarded, ", lost, " lost, ",
+		                seconds > 0.0 ? static_cast<double>( counters.processed ) / seconds : 0.0,
+		                " fps" );
+
+		total += counters.processed;
+	}
+
+	cl::print_line( "  total: ", total, " frames in ", seconds, " s, ",
+	                seconds > 0.0 ? static_cast<double>( total ) / seconds : 0.0, " fps on ",
+	                pool_.size(), " workers" );
+}
@@ -0,0 +1,379 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "RoiStage.hpp"
+#include "FrameAccess.hpp"
+
+#include "HTLogger.h"
+#include "CLPrint.hpp"
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Output pixels produced by every step of the SIMD kernels.
+const size_t SIMD_BLOCK{ 16 };
+
+/// Bins the output pixels [begin, width) of a row from the two input rows of its colour.
+template< typename T >
+inline void
+bin_row( const T* row0, const T* row1, const size_t begin, const size_t width, T* dst )
+{
+	for( size_t x = begin; x < width; ++x )
+	{
+		const size_t column{ 2 * x - (x & 1) };
+		const uint32_t sum{ static_cast<uint32_t>( row0[column] ) + row0[column + 2] +
+		                    row1[column] + row1[column + 2] };
+		dst[x] = static_cast<T>( (sum + 2) >> 2 );
+	}
+}
+
+#if defined( __SSE2__ )
+
+/// Sums the 16 bits lanes of two rows, then the columns 4k and 4k + 2, 4k + 1 and 4k + 3 of the
+/// 16 pixels of two consecutive vectors.
+inline __m128i
+bin_sse2( const __m128i& top0, const __m128i& top1, const __m128i& bottom0,
+          const __m128i& bottom1 )
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	const __m128i sum0 = _mm_add_epi16( _mm_unpacklo_epi8( top0, zero ),
+	                                    _mm_unpacklo_epi8( bottom0, zero ) );
+	const __m128i sum1 = _mm_add_epi16( _mm_unpackhi_epi8( top0, zero ),
+	                                    _mm_unpackhi_epi8( bottom0, zero ) );
+	const __m128i sum2 = _mm_add_epi16( _mm_unpacklo_epi8( top1, zero ),
+	                                    _mm_unpacklo_epi8( bottom1, zero ) );
+	const __m128i sum3 = _mm_add_epi16( _mm_unpackhi_epi8( top1, zero ),
+	                                    _mm_unpackhi_epi8( bottom1, zero ) );
+
+	// A 32 bits lane holds a pixel pair, the even lanes the columns 4k, 4k + 1 and the odd lanes
+	// the columns 4k + 2, 4k + 3 of the same colours.
+	const __m128i lanes0 = _mm_shuffle_epi32( sum0, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+	const __m128i lanes1 = _mm_shuffle_epi32( sum1, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+	const __m128i lanes2 = _mm_shuffle_epi32( sum2, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+	const __m128i lanes3 = _mm_shuffle_epi32( sum3, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+
+	const __m128i rounding = _mm_set1_epi16( 2 );
+	const __m128i low = _mm_srli_epi16( _mm_add_epi16(
+		_mm_add_epi16( _mm_unpacklo_epi64( lanes0, lanes1 ), _mm_unpackhi_epi64( lanes0, lanes1 ) ),
+		rounding ), 2 );
+	const __m128i high = _mm_srli_epi16( _mm_add_epi16(
+		_mm_add_epi16( _mm_unpacklo_epi64( lanes2, lanes3 ), _mm_unpackhi_epi64( lanes2, lanes3 ) ),
+		rounding ), 2 );
+
+	return _mm_packus_epi16( low, high );
+}
+
+#endif
+
+/// Bins an 8 bits row, SIMD_BLOCK output pixels at a time then one by one.
+inline void
+bin_row_u8( const uint8_t* row0, const uint8_t* row1, const size_t width, uint8_t* dst )
+{
+	size_t x{ };
+
+#if defined( __SSE2__ )
+	for( ; x + SIMD_BLOCK <= width; x += SIMD_BLOCK )
+	{
+		const __m128i* top = reinterpret_cast<const __m128i*>( row0 + 2 * x );
+		const __m128i* bottom = reinterpret_cast<const __m128i*>( row1 + 2 * x );
+
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + x ),
+		                  bin_sse2( _mm_loadu_si128( top ), _mm_loadu_si128( top + 1 ),
+		                            _mm_loadu_si128( bottom ), _mm_loadu_si128( bottom + 1 ) ) );
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	for( ; x + SIMD_BLOCK <= width; x += SIMD_BLOCK )
+	{
+		const uint8x16_t top0 = vld1q_u8( row0 + 2 * x );
+		const uint8x16_t top1 = vld1q_u8( row0 + 2 * x + SIMD_BLOCK );
+		const uint8x16_t bottom0 = vld1q_u8( row1 + 2 * x );
+		const uint8x16_t bottom1 = vld1q_u8( row1 + 2 * x + SIMD_BLOCK );
+
+		const uint16x8_t sum0 = vaddl_u8( vget_low_u8( top0 ), vget_low_u8( bottom0 ) );
+		const uint16x8_t sum1 = vaddl_u8( vget_high_u8( top0 ), vget_high_u8( bottom0 ) );
+		const uint16x8_t sum2 = vaddl_u8( vget_low_u8( top1 ), vget_low_u8( bottom1 ) );
+		const uint16x8_t sum3 = vaddl_u8( vget_high_u8( top1 ), vget_high_u8( bottom1 ) );
+
+		// Even 32 bits lanes hold the columns 4k, 4k + 1, odd lanes the columns 4k + 2, 4k + 3.
+		const uint32x4x2_t lanes01 = vuzpq_u32( vreinterpretq_u32_u16( sum0 ),
+		                                        vreinterpretq_u32_u16( sum1 ) );
+		const uint32x4x2_t lanes23 = vuzpq_u32( vreinterpretq_u32_u16( sum2 ),
+		                                        vreinterpretq_u32_u16( sum3 ) );
+
+		const uint16x8_t low = vaddq_u16( vreinterpretq_u16_u32( lanes01.val[0] ),
+		                                  vreinterpretq_u16_u32( lanes01.val[1] ) );
+		const uint16x8_t high = vaddq_u16( vreinterpretq_u16_u32( lanes23.val[0] ),
+		                                   vreinterpretq_u16_u32( lanes23.val[1] ) );
+
+		vst1q_u8( dst + x, vcombine_u8( vrshrn_n_u16( low, 2 ), vrshrn_n_u16( high, 2 ) ) );
+	}
+#endif
+
+	bin_row( row0, row1, x, width, dst );
+}
+
+/// Bins every row of an image whose pixels are of type T.
+template< typename T >
+void
+bin_image( const cv::Mat& src, cv::Mat& dst )
+{
+	const size_t width{ static_cast<size_t>( dst.cols ) };
+
+	for( int32_t y = 0; y < dst.rows; ++y )
+	{
+		const int32_t row{ 2 * y - (y & 1) };
+		bin_row( src.ptr<T>( row ), src.ptr<T>( row + 2 ), 0, width, dst.ptr<T>( y ) );
+	}
+}
+
+}
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+RoiStage::RoiStage( const RoiParams& params, const int32_t width, const int32_t height )
+	: params_{ params }
+	, region_{ align_region( params, width, height ) }
+	, windowed_{ }
+	, sinks_{ }
+	, frames_{ }
+	, timeInUs_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+RoiStage::~RoiStage()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+cv::Rect
+align_region( const RoiParams& params, const int32_t width, const int32_t height )
+{
+	const cv::Rect frame{ 0, 0, width, height };
+	if( !params.enabled || width <= 0 || height <= 0 )
+	{
+		return frame;
+	}
+
+	const uint32_t frameWidth{ static_cast<uint32_t>( width ) };
+	const uint32_t frameHeight{ static_cast<uint32_t>( height ) };
+	const uint32_t alignment{ params.binning ? 4u : 2u };
+
+	const uint32_t x{ std::min( params.x, frameWidth ) & ~1u };
+	const uint32_t y{ std::min( params.y, frameHeight ) & ~1u };
+
+	uint32_t regionWidth{ frameWidth - x };
+	uint32_t regionHeight{ frameHeight - y };
+	if( params.width != 0 )
+	{
+		regionWidth = std::min( params.width, regionWidth );
+	}
+	if( params.height != 0 )
+	{
+		regionHeight = std::min( params.height, regionHeight );
+	}
+
+	regionWidth -= regionWidth % alignment;
+	regionHeight -= regionHeight % alignment;
+
+	if( regionWidth == 0 || regionHeight == 0 )
+	{
+		ht::log_warning( "empty region of interest, the whole frame is kept" );
+		return frame;
+	}
+
+	return cv::Rect{ static_cast<int32_t>( x ), static_cast<int32_t>( y ),
+	                 static_cast<int32_t>( regionWidth ), static_cast<int32_t>( regionHeight ) };
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+bin_bayer( const cv::Mat& src, cv::Mat& dst )
+{
+	dst.create( src.rows / 2, src.cols / 2, src.type() );
+
+	if( src.type() == CV_8UC1 )
+	{
+		const size_t width{ static_cast<size_t>( dst.cols ) };
+
+		for( int32_t y = 0; y < dst.rows; ++y )
+		{
+			const int32_t row{ 2 * y - (y & 1) };
+			bin_row_u8( src.ptr<uint8_t>( row ), src.ptr<uint8_t>( row + 2 ), width,
+			            dst.ptr<uint8_t>( y ) );
+		}
+	}
+	else if( src.type() == CV_16UC1 )
+	{
+		bin_image<uint16_t>( src, dst );
+	}
+	else
+	{
+		// Demosaiced images have no Bayer layout left, their neighbour pixels are averaged.
+		cv::resize( src, dst, dst.size(), 0.0, 0.0, cv::INTER_AREA );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const cv::Rect&
+RoiStage::get_region() const
+{
+	return region_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+cv::Size
+RoiStage::get_output_size() const
+{
+	return params_.binning ? cv::Size{ region_.width / 2, region_.height / 2 } : region_.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RoiStage::process( const StereoFrame& frame, StereoFrame& windowed )
+{
+	const bool cropped{ frame.left.size() == region_.size() };
+	if( (!cropped && (region_.x + region_.width > frame.left.cols ||
+	                  region_.y + region_.height > frame.left.rows)) ||
+	    frame.left.size() != frame.right.size() )
+	{
+		return false;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const cv::Rect area{ cropped ? cv::Rect{ 0, 0, region_.width, region_.height } : region_ };
+
+	windowed.index = frame.index;
+	windowed.timestamp = frame.timestamp;
+
+	if( params_.binning )
+	{
+		bin_bayer( frame.left( area ), windowed_.left );
+		bin_bayer( frame.right( area ), windowed_.right );
+		windowed.left = windowed_.left;
+		windowed.right = windowed_.right;
+	}
+	else
+	{
+		windowed.left = frame.left( area );
+		windowed.right = frame.right( area );
+	}
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start );
+	timeInUs_ += static_cast<double>( elapsed.count() );
+	++frames_;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RoiStage::print_report() const
+{
+	cl::print_line( "Roi: ", frames_, " pairs of ", get_output_size().width, "x",
+	                get_output_size().height, ", ",
+	                frames_ ? timeInUs_ / static_cast<double>( frames_ ) : 0.0, " us per pair" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+RoiStage::add_sink( StereoSink& sink )
+{
+	sinks_.push_back( &sink );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RoiStage::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	StereoFrame frame;
+	StereoFrame windowed;
+	if( !extract_stereo_frame( inResult, frame ) || !process( frame, windowed ) )
+	{
+		return false;
+	}
+
+	// Every sink gets the pair, a failed one does not starve the others.
+	bool success{ true };
+	for( StereoSink* sink : sinks_ )
+	{
+		success = sink->submit( windowed ) && success;
+	}
+
+	if( !success )
+	{
+		return false;
+	}
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter && !iter->compute_result( context, inResult ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RoiStage::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+RoiStage::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
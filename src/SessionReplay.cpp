@@ -0,0 +1,309 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "SessionReplay.hpp"
+#include "RawContainer.hpp"
+
+#include "HTLogger.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+const std::string LEFT_SUFFIX{ "l.tif" };
+const std::string RIGHT_SUFFIX{ "r.tif" };
+
+bool
+ends_with( const std::string& str, const std::string& suffix )
+{
+	return str.size() >= suffix.size() &&
+	       str.compare( str.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+/// Parses a whole field as an unsigned decimal number, false if it is empty or holds anything else.
+bool
+parse_unsigned( const std::string& field, uint64_t& value )
+{
+	if( field.empty() || field.front() == '-' )
+	{
+		return false;
+	}
+
+	char* end{ nullptr };
+	errno = 0;
+	const unsigned long long parsed{ std::strtoull( field.c_str(), &end, 10 ) };
+	if( errno != 0 || end != field.c_str() + field.size() )
+	{
+		return false;
+	}
+
+	value = static_cast<uint64_t>( parsed );
+	return true;
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+SessionReplay::SessionReplay( const std::string& folderPath, const uint32_t periodInUs )
+	: folderPath_{ folderPath }
+	, periodInUs_{ periodInUs }
+	, records_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+SessionReplay::~SessionReplay()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SessionReplay::open()
+{
+	records_.clear();
+
+	if( !load_container() && !load_manifest() )
+	{
+		scan_folder();
+	}
+
+	return !records_.empty();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+SessionReplay::size() const
+{
+	return records_.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SessionReplay::read( const size_t position, StereoFrame& frame ) const
+{
+	if( position >= records_.size() )
+	{
+		return false;
+	}
+
+	const Record& record = records_[position];
+
+	if( record.left.empty() )
+	{
+		return read_container( record, frame );
+	}
+
+	frame.index = record.index;
+	frame.timestamp = record.timestamp;
+	frame.left = cv::imread( folderPath_ + "/" + record.left, CV_LOAD_IMAGE_UNCHANGED );
+	frame.right = cv::imread( folderPath_ + "/" + record.right, CV_LOAD_IMAGE_UNCHANGED );
+
+	return !frame.left.empty() && !frame.right.empty();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const std::string&
+SessionReplay::get_folder_path() const
+{
+	return folderPath_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SessionReplay::load_container()
+{
+	std::ifstream container{ folderPath_ + "/" + RAW_CONTAINER, std::ios::binary };
+	if( !container.is_open() )
+	{
+		return false;
+	}
+
+	uint64_t offset{ };
+	RawRecordHeader header{ };
+
+	while( container.seekg( static_cast<std::streamoff>( offset ) ) &&
+	       container.read( reinterpret_cast<char*>( &header ), sizeof( header ) ) )
+	{
+		if( header.magic != RAW_RECORD_MAGIC || header.recordSize == 0 )
+		{
+			// End of the written records, e.g. zeroed preallocation after a forced exit.
+			break;
+		}
+
+		records_.push_back( Record{ header.index, header.timestamp, "", "", offset } );
+		offset += header.recordSize;
+	}
+
+	return !records_.empty();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SessionReplay::read_container( const Record& record, StereoFrame& frame ) const
+{
+	std::ifstream container{ folderPath_ + "/" + RAW_CONTAINER, std::ios::binary };
+	RawRecordHeader header{ };
+
+	if( !container.seekg( static_cast<std::streamoff>( record.offset ) ) ||
+	    !container.read( reinterpret_cast<char*>( &header ), sizeof( header ) ) ||
+	    header.magic != RAW_RECORD_MAGIC )
+	{
+		return false;
+	}
+
+	frame.index = header.index;
+	frame.timestamp = header.timestamp;
+	frame.left.create( header.height, header.width, header.type );
+	frame.right.create( header.height, header.width, header.type );
+
+	if( (header.packedBits && !is_packed_depth( header.packedBits )) ||
+	    raw_image_size( frame.left, header.packedBits ) != header.imageSize )
+	{
+		return false;
+	}
+
+	const std::streamsize imageSize{ static_cast<std::streamsize>( header.imageSize ) };
+
+	container.seekg( static_cast<std::streamoff>( record.offset + header.headerSize ) );
+
+	if( !header.packedBits )
+	{
+		container.read( reinterpret_cast<char*>( frame.left.data ), imageSize );
+		container.read( reinterpret_cast<char*>( frame.right.data ), imageSize );
+
+		return static_cast<bool>( container );
+	}
+
+	// Packed pairs are read at their packed size and unpacked to the 16 bits images.
+	std::vector<uint8_t> packed( 2 * header.imageSize );
+	container.read( reinterpret_cast<char*>( packed.data() ), 2 * imageSize );
+
+	unpack_image( packed.data(), header.width, header.height, header.packedBits, frame.left );
+	unpack_image( packed.data() + header.imageSize, header.width, header.height, header.packedBits,
+	              frame.right );
+
+	return static_cast<bool>( container );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SessionReplay::load_manifest()
+{
+	std::ifstream manifest{ folderPath_ + "/" + SESSION_MANIFEST };
+	if( !manifest.is_open() )
+	{
+		return false;
+	}
+
+	std::string line;
+	std::getline( manifest, line ); // header
+
+	while( std::getline( manifest, line ) )
+	{
+		std::istringstream fields{ line };
+		std::string index, timestamp;
+		Record record{ };
+
+		if( std::getline( fields, index, ',' ) && std::getline( fields, timestamp, ',' ) &&
+		    std::getline( fields, record.left, ',' ) && std::getline( fields, record.right ) )
+		{
+			if( !parse_unsigned( index, record.index ) ||
+			    !parse_unsigned( timestamp, record.timestamp ) )
+			{
+				ht::log_warning( "skipping malformed manifest line: " + line );
+				continue;
+			}
+			records_.push_back( record );
+		}
+	}
+
+	return !records_.empty();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+SessionReplay::scan_folder()
+{
+	DIR* folder = opendir( folderPath_.c_str() );
+	if( folder == nullptr )
+	{
+		return false;
+	}
+
+	std::vector<std::string> lefts;
+	std::vector<std::string> names;
+
+	while( dirent* entry = readdir( folder ) )
+	{
+		const std::string name{ entry->d_name };
+		names.push_back( name );
+
+		if( ends_with( name, LEFT_SUFFIX ) )
+		{
+			lefts.push_back( name );
+		}
+	}
+	closedir( folder );
+
+	std::sort( lefts.begin(), lefts.end() );
+	std::sort( names.begin(), names.end() );
+
+	for( const std::string& left : lefts )
+	{
+		std::string right{ left.substr( 0, left.size() - LEFT_SUFFIX.size() ) + RIGHT_SUFFIX };
+
+		if( std::binary_search( names.cbegin(), names.cend(), right ) )
+		{
+			const uint64_t index{ records_.size() };
+			records_.push_back( Record{ index, index * periodInUs_, left, right, 0 } );
+		}
+	}
+
+	return !records_.empty();
+}
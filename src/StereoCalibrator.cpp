@@ -0,0 +1,269 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "StereoCalibrator.hpp"
+#include "SessionReplay.hpp"
+#include "StereoRectifier.hpp"
+#include "WorkerPool.hpp"
+
+#include "CLPrint.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Fewest views with the pattern in both images the solver accepts.
+const size_t MIN_VIEWS{ 5 };
+
+/// Half side of the search window of the sub-pixel chessboard corners.
+const int32_t SUBPIX_WINDOW{ 5 };
+
+const cv::TermCriteria SUBPIX_CRITERIA{ cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30,
+                                        0.01 };
+const cv::TermCriteria SOLVER_CRITERIA{ cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100,
+                                        1e-5 };
+
+double
+milliseconds( const std::chrono::steady_clock::duration& duration )
+{
+	return std::chrono::duration<double, std::milli>( duration ).count();
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+StereoCalibrator::StereoCalibrator( const CalibrationParams& params, WorkerPool& pool )
+	: params_{ params }
+	, patternSize_{ static_cast<int32_t>( params.columns ), static_cast<int32_t>( params.rows ) }
+	, pool_{ pool }
+	, mutex_{ }
+	, views_{ }
+	, imageSize_{ }
+	, pairs_{ }
+	, used_{ }
+	, errors_{ }
+	, start_{ Clock::now() }
+	, detection_{ }
+	, solving_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+StereoCalibrator::~StereoCalibrator()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoCalibrator::add_pair( const StereoFrame& frame )
+{
+	StereoFrame copy;
+	copy.index = frame.index;
+	copy.timestamp = frame.timestamp;
+	copy.left = frame.left.clone();
+	copy.right = frame.right.clone();
+
+	if( pairs_++ == 0 )
+	{
+		start_ = Clock::now();
+	}
+	pool_.submit( [ this, copy ]()
+	{ detect( copy ); } );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoCalibrator::add_pair( const SessionReplay& replay, const size_t position )
+{
+	const SessionReplay* source = &replay;
+
+	if( pairs_++ == 0 )
+	{
+		start_ = Clock::now();
+	}
+	pool_.submit( [ this, source, position ]()
+	{
+		StereoFrame frame;
+		if( source->read( position, frame ) )
+		{
+			detect( frame );
+		}
+	} );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StereoCalibrator::calibrate( StereoRectifier& rectifier )
+{
+	pool_.wait_idle();
+
+	const Clock::time_point solveStart = Clock::now();
+	detection_ = solveStart - start_;
+
+	if( views_.size() < MIN_VIEWS )
+	{
+		return false;
+	}
+
+	// Detections complete in any order, sorting keeps the selection reproducible.
+	std::sort( views_.begin(), views_.end(), []( const View& a, const View& b )
+	{ return a.index < b.index; } );
+
+	used_ = std::min( views_.size(), std::max<size_t>( params_.maxViews, MIN_VIEWS ) );
+
+	std::vector<std::vector<cv::Point3f>> objectPoints( used_, pattern_points() );
+	std::vector<std::vector<cv::Point2f>> imagePoints[2];
+
+	for( size_t i = 0; i < used_; ++i )
+	{
+		const View& view = views_[i * views_.size() / used_];
+		imagePoints[0].push_back( view.points[0] );
+		imagePoints[1].push_back( view.points[1] );
+	}
+
+	cv::Mat cameras[2];
+	cv::Mat distortions[2];
+
+	parallel_for( &pool_, 2, [ & ]( size_t camera )
+	{
+		std::vector<cv::Mat> rotations, translations;
+		errors_[camera] = cv::calibrateCamera( objectPoints, imagePoints[camera], imageSize_,
+		                                       cameras[camera], distortions[camera], rotations,
+		                                       translations, 0, SOLVER_CRITERIA );
+	} );
+
+	cv::Mat rotation, translation, essential, fundamental;
+	errors_[2] = cv::stereoCalibrate( objectPoints, imagePoints[0], imagePoints[1], cameras[0],
+	                                  distortions[0], cameras[1], distortions[1], imageSize_,
+	                                  rotation, translation, essential, fundamental,
+	                                  SOLVER_CRITERIA, cv::CALIB_FIX_INTRINSIC );
+
+	rectifier.set_calibration( cameras[0], distortions[0], cameras[1], distortions[1], rotation,
+	                           translation );
+
+	solving_ = Clock::now() - solveStart;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoCalibrator::print_report() const
+{
+	const double detectionInMs{ milliseconds( detection_ ) };
+
+	cl::print_line( "  pattern found in ", views_.size(), " of ", pairs_, " pairs, ", used_,
+	                " used" );
+	cl::print_line( "  rms reprojection error: left ", errors_[0], " px, right ", errors_[1],
+	                " px, stereo ", errors_[2], " px" );
+	cl::print_line( "  detection: ", detectionInMs, " ms, ",
+	                detectionInMs > 0.0 ? 1000.0 * static_cast<double>( pairs_ ) / detectionInMs
+	                                    : 0.0, " pairs/s on ", pool_.size(), " workers" );
+	cl::print_line( "  solving: ", milliseconds( solving_ ), " ms" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoCalibrator::detect( const StereoFrame& frame )
+{
+	cv::Mat grey;
+	View view{ frame.index, { } };
+
+	// The right image is only searched once the pattern is in the left one.
+	if( !find_pattern( frame.left, grey, view.points[0] ) ||
+	    !find_pattern( frame.right, grey, view.points[1] ) )
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	imageSize_ = frame.left.size();
+	views_.push_back( std::move( view ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StereoCalibrator::find_pattern( const cv::Mat& image, cv::Mat& grey,
+                                std::vector<cv::Point2f>& points ) const
+{
+	cv::cvtColor( image, grey, image.channels() == 1 ? BAYER_TO_GREY : CV_BGR2GRAY );
+
+	if( params_.pattern == "circles" || params_.pattern == "asymmetric_circles" )
+	{
+		return cv::findCirclesGrid( grey, patternSize_, points,
+		                            params_.pattern == "circles" ? cv::CALIB_CB_SYMMETRIC_GRID
+		                                                         : cv::CALIB_CB_ASYMMETRIC_GRID );
+	}
+
+	// The fast check rejects the images without chessboard before the costly quad search.
+	if( !cv::findChessboardCorners( grey, patternSize_, points, cv::CALIB_CB_ADAPTIVE_THRESH |
+	                                cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK ) )
+	{
+		return false;
+	}
+
+	cv::cornerSubPix( grey, points, cv::Size{ SUBPIX_WINDOW, SUBPIX_WINDOW }, cv::Size{ -1, -1 },
+	                  SUBPIX_CRITERIA );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+std::vector<cv::Point3f>
+StereoCalibrator::pattern_points() const
+{
+	const float size{ static_cast<float>( params_.squareSize ) };
+	const bool asymmetric{ params_.pattern == "asymmetric_circles" };
+	std::vector<cv::Point3f> points;
+
+	for( uint32_t row = 0; row < params_.rows; ++row )
+	{
+		for( uint32_t column = 0; column < params_.columns; ++column )
+		{
+			// Every other row of an asymmetric grid is shifted by half a period.
+			const uint32_t x{ asymmetric ? 2 * column + row % 2 : column };
+			points.emplace_back( static_cast<float>( x ) * size, static_cast<float>( row ) * size,
+			                     0.0f );
+		}
+	}
+
+	return points;
+}
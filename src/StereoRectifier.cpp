@@ -0,0 +1,177 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "StereoRectifier.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+StereoRectifier::StereoRectifier()
+	: cameraLeft_{ }
+	, distortionLeft_{ }
+	, cameraRight_{ }
+	, distortionRight_{ }
+	, rotation_{ }
+	, translation_{ }
+	, calibrated_{ }
+	, size_{ }
+	, mapsX_{ }
+	, mapsY_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+StereoRectifier::~StereoRectifier()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StereoRectifier::load( const std::string& filepath )
+{
+	cv::FileStorage file( filepath, cv::FileStorage::READ );
+	if( !file.isOpened() )
+	{
+		return false;
+	}
+
+	file["M1"] >> cameraLeft_;
+	file["D1"] >> distortionLeft_;
+	file["M2"] >> cameraRight_;
+	file["D2"] >> distortionRight_;
+	file["R"] >> rotation_;
+	file["T"] >> translation_;
+
+	calibrated_ = !cameraLeft_.empty() && !distortionLeft_.empty() && !cameraRight_.empty() &&
+	              !distortionRight_.empty() && !rotation_.empty() && !translation_.empty();
+
+	// A new calibration invalidates the remap tables.
+	size_ = cv::Size{ };
+
+	return calibrated_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StereoRectifier::save( const std::string& filepath ) const
+{
+	if( !calibrated_ )
+	{
+		return false;
+	}
+
+	cv::FileStorage file( filepath, cv::FileStorage::WRITE );
+	if( !file.isOpened() )
+	{
+		return false;
+	}
+
+	file << "M1" << cameraLeft_ << "D1" << distortionLeft_;
+	file << "M2" << cameraRight_ << "D2" << distortionRight_;
+	file << "R" << rotation_ << "T" << translation_;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoRectifier::set_calibration( const cv::Mat& cameraLeft, const cv::Mat& distortionLeft,
+                                  const cv::Mat& cameraRight, const cv::Mat& distortionRight,
+                                  const cv::Mat& rotation, const cv::Mat& translation )
+{
+	cameraLeft_ = cameraLeft.clone();
+	distortionLeft_ = distortionLeft.clone();
+	cameraRight_ = cameraRight.clone();
+	distortionRight_ = distortionRight.clone();
+	rotation_ = rotation.clone();
+	translation_ = translation.clone();
+
+	calibrated_ = true;
+	size_ = cv::Size{ };
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StereoRectifier::is_calibrated() const
+{
+	return calibrated_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoRectifier::prepare( const cv::Size& size )
+{
+	if( !calibrated_ || size == size_ )
+	{
+		return;
+	}
+
+	cv::Mat rectificationLeft, rectificationRight;
+	cv::Mat projectionLeft, projectionRight, disparityToDepth;
+
+	cv::stereoRectify( cameraLeft_, distortionLeft_, cameraRight_, distortionRight_, size,
+	                   rotation_, translation_, rectificationLeft, rectificationRight,
+	                   projectionLeft, projectionRight, disparityToDepth,
+	                   cv::CALIB_ZERO_DISPARITY, 0.0, size );
+
+	// Fixed-point tables, the fastest remap path.
+	cv::initUndistortRectifyMap( cameraLeft_, distortionLeft_, rectificationLeft, projectionLeft,
+	                             size, CV_16SC2, mapsX_[0], mapsY_[0] );
+	cv::initUndistortRectifyMap( cameraRight_, distortionRight_, rectificationRight,
+	                             projectionRight, size, CV_16SC2, mapsX_[1], mapsY_[1] );
+
+	size_ = size;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StereoRectifier::rectify( const size_t view, const cv::Mat& src, cv::Mat& dst,
+                          const int32_t firstRow, const int32_t lastRow ) const
+{
+	cv::Mat band{ dst.rowRange( firstRow, lastRow ) };
+
+	if( !calibrated_ || src.size() != size_ )
+	{
+		src.rowRange( firstRow, lastRow ).copyTo( band );
+		return;
+	}
+
+	cv::remap( src, band, mapsX_[view].rowRange( firstRow, lastRow ),
+	           mapsY_[view].rowRange( firstRow, lastRow ), cv::INTER_LINEAR );
+}
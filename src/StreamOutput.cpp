@@ -0,0 +1,634 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "StreamOutput.hpp"
+#include "FrameAccess.hpp"
+#include "ThreadPlacement.hpp"
+
+#include "HTLogger.h"
+#include "CLPrint.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+
+#include <jpeglib.h>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Longest wait of the stream thread, the report period is checked at least this often.
+const int32_t POLL_PERIOD_IN_MS{ 100 };
+
+/// Connections waiting to be accepted.
+const int32_t LISTEN_BACKLOG{ 8 };
+
+struct JpegError
+{
+	jpeg_error_mgr manager;
+	std::jmp_buf jump;
+};
+
+void
+on_jpeg_error( j_common_ptr info )
+{
+	std::longjmp( reinterpret_cast<JpegError*>( info->err )->jump, 1 );
+}
+
+/// Compresses an RGB image with libjpeg, returns false on error. The default libjpeg error handler
+/// exits the process, this one jumps back here, where no C++ object has been constructed yet.
+bool
+encode_jpeg( const cv::Mat& rgb, const int32_t quality, std::vector<uint8_t>& jpeg )
+{
+	jpeg_compress_struct info;
+	JpegError error;
+	unsigned char* buffer{ nullptr };
+	unsigned long size{ 0 };
+
+	info.err = jpeg_std_error( &error.manager );
+	error.manager.error_exit = &on_jpeg_error;
+
+	if( setjmp( error.jump ) != 0 )
+	{
+		jpeg_destroy_compress( &info );
+		std::free( buffer );
+		return false;
+	}
+
+	jpeg_create_compress( &info );
+	jpeg_mem_dest( &info, &buffer, &size );
+
+	info.image_width = static_cast<JDIMENSION>( rgb.cols );
+	info.image_height = static_cast<JDIMENSION>( rgb.rows );
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+
+	jpeg_set_defaults( &info );
+	jpeg_set_quality( &info, quality, TRUE );
+	jpeg_start_compress( &info, TRUE );
+
+	while( info.next_scanline < info.image_height )
+	{
+		JSAMPROW row{ const_cast<JSAMPROW>(
+			rgb.ptr<uint8_t>( static_cast<int32_t>( info.next_scanline ) ) ) };
+		jpeg_write_scanlines( &info, &row, 1 );
+	}
+
+	jpeg_finish_compress( &info );
+	jpeg_destroy_compress( &info );
+
+	jpeg.assign( buffer, buffer + size );
+	std::free( buffer );
+	return true;
+}
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+StreamOutput::StreamOutput( const StreamParams& params, const ThreadRoleParams& placement )
+	: params_{ params }
+	, placement_{ placement }
+	, listener_{ -1 }
+	, wakeup_{ -1 }
+	, port_{ }
+	, mutex_{ }
+	, thread_{ }
+	, running_{ }
+	, pending_{ }
+	, slot_{ }
+	, left_{ }
+	, right_{ }
+	, sideBySide_{ }
+	, rgb_{ }
+	, jpeg_{ }
+	, header_{ std::make_shared<const std::string>(
+		std::string{ "HTTP/1.0 200 OK\r\nConnection: close\r\nCache-Control: no-cache\r\n" } +
+		"Content-Type: multipart/x-mixed-replace; boundary=" + STREAM_BOUNDARY + "\r\n\r\n" ) }
+	, clients_{ }
+	, lastSubmit_{ }
+	, lastReport_{ }
+	, submitted_{ }
+	, skipped_{ }
+	, encoded_{ }
+	, sent_{ }
+	, dropped_{ }
+	, clientCount_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+StreamOutput::~StreamOutput()
+{
+	stop();
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::start()
+{
+	if( running_ )
+	{
+		return true;
+	}
+
+	if( params_.layout != "side_by_side" && params_.layout != "separate" )
+	{
+		ht::log_warning( "unknown stream layout " + params_.layout + ", streaming side by side" );
+	}
+
+	sockaddr_in address{ };
+	address.sin_family = AF_INET;
+	address.sin_port = htons( static_cast<uint16_t>( params_.port ) );
+
+	if( ::inet_pton( AF_INET, params_.address.c_str(), &address.sin_addr ) != 1 )
+	{
+		ht::log_warning( "invalid stream address " + params_.address );
+		return false;
+	}
+
+	// A previous run leaves the port in TIME_WAIT for a while, it must not prevent a restart.
+	const int32_t reuse{ 1 };
+	socklen_t length{ sizeof( address ) };
+
+	listener_ = ::socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	wakeup_ = ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+	if( listener_ < 0 || wakeup_ < 0 ||
+	    ::setsockopt( listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) ) != 0 ||
+	    ::bind( listener_, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) ) != 0 ||
+	    ::listen( listener_, LISTEN_BACKLOG ) != 0 ||
+	    ::getsockname( listener_, reinterpret_cast<sockaddr*>( &address ), &length ) != 0 )
+	{
+		ht::log_warning( "unable to listen to " + params_.address + ":" +
+		                 std::to_string( params_.port ) );
+		stop();
+		return false;
+	}
+
+	port_ = ntohs( address.sin_port );
+	lastReport_ = Clock::now();
+	running_ = true;
+	thread_ = std::thread( &StreamOutput::process, this );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StreamOutput::stop()
+{
+	running_ = false;
+
+	if( thread_.joinable() )
+	{
+		const uint64_t wakeup{ 1 };
+		const ssize_t written{ ::write( wakeup_, &wakeup, sizeof( wakeup ) ) };
+		cl::ignore( written );
+
+		thread_.join();
+	}
+
+	for( Client& client : clients_ )
+	{
+		::close( client.socket );
+	}
+	clients_.clear();
+
+	if( listener_ >= 0 )
+	{
+		::close( listener_ );
+		listener_ = -1;
+	}
+
+	if( wakeup_ >= 0 )
+	{
+		::close( wakeup_ );
+		wakeup_ = -1;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+uint16_t
+StreamOutput::get_port() const
+{
+	return port_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+StreamCounters
+StreamOutput::get_counters() const
+{
+	return StreamCounters{ submitted_, skipped_, encoded_, sent_, dropped_, clientCount_ };
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::submit( const StereoFrame& frame )
+{
+	const Clock::time_point now = Clock::now();
+
+	// Skipping a pair is how the output keeps up, it is not a failure.
+	if( now - lastSubmit_ < std::chrono::milliseconds( params_.periodInMs ) )
+	{
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock( mutex_, std::try_to_lock );
+	if( !lock.owns_lock() || pending_ || !running_ )
+	{
+		++skipped_;
+		return true;
+	}
+
+	// The slot keeps its buffers from one pair to the next, copying does not allocate.
+	slot_.index = frame.index;
+	slot_.timestamp = frame.timestamp;
+	frame.left.copyTo( slot_.left );
+	frame.right.copyTo( slot_.right );
+	pending_ = true;
+
+	lock.unlock();
+
+	const uint64_t wakeup{ 1 };
+	const ssize_t written{ ::write( wakeup_, &wakeup, sizeof( wakeup ) ) };
+	cl::ignore( written );
+
+	lastSubmit_ = now;
+	++submitted_;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	co::OutputResult result;
+	result.start_benchmark();
+
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) )
+	{
+		return false;
+	}
+
+	submit( frame );
+
+	result.stop_benchmark();
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, result ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StreamOutput::process()
+{
+	ThreadPlacement::apply_to_current_thread( placement_ );
+
+	std::vector<pollfd> descriptors;
+
+	while( running_ )
+	{
+		descriptors.clear();
+		descriptors.push_back( pollfd{ wakeup_, POLLIN, 0 } );
+		descriptors.push_back( pollfd{ listener_, POLLIN, 0 } );
+		for( const Client& client : clients_ )
+		{
+			// Only the clients with something to send wait for room in their socket.
+			const int16_t events{ static_cast<int16_t>( client.sending ? POLLIN | POLLOUT
+			                                                           : POLLIN ) };
+			descriptors.push_back( pollfd{ client.socket, events, 0 } );
+		}
+
+		if( ::poll( descriptors.data(), descriptors.size(), POLL_PERIOD_IN_MS ) < 0 )
+		{
+			continue;
+		}
+
+		for( size_t i = 0; i < clients_.size(); ++i )
+		{
+			Client& client = clients_[i];
+			const int16_t events{ descriptors[i + 2].revents };
+
+			bool connected{ (events & (POLLERR | POLLHUP | POLLNVAL)) == 0 };
+			if( connected && (events & POLLIN) )
+			{
+				connected = receive_from( client );
+			}
+			if( connected && (events & POLLOUT) )
+			{
+				connected = send_to( client );
+			}
+
+			if( !connected )
+			{
+				::close( client.socket );
+				client.socket = -1;
+			}
+		}
+
+		clients_.erase( std::remove_if( clients_.begin(), clients_.end(), []( const Client& client )
+		{ return client.socket < 0; } ), clients_.end() );
+
+		if( descriptors[1].revents & POLLIN )
+		{
+			accept_clients();
+		}
+
+		if( descriptors[0].revents & POLLIN )
+		{
+			uint64_t wakeups{ };
+			const ssize_t received{ ::read( wakeup_, &wakeups, sizeof( wakeups ) ) };
+			cl::ignore( received );
+
+			bool pending{ };
+			{
+				std::lock_guard<std::mutex> lock( mutex_ );
+				pending = pending_;
+			}
+
+			if( pending )
+			{
+				// The processing thread does not touch the slot while pending_ is set.
+				const Chunk chunk = encode();
+				{
+					std::lock_guard<std::mutex> lock( mutex_ );
+					pending_ = false;
+				}
+
+				if( chunk )
+				{
+					broadcast( chunk );
+				}
+			}
+		}
+
+		report( Clock::now() );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StreamOutput::accept_clients()
+{
+	for( ;; )
+	{
+		const int32_t connection{ ::accept4( listener_, nullptr, nullptr,
+		                                     SOCK_NONBLOCK | SOCK_CLOEXEC ) };
+		if( connection < 0 )
+		{
+			return;
+		}
+
+		if( clients_.size() >= params_.maxClients )
+		{
+			::close( connection );
+			continue;
+		}
+
+		if( params_.sendBufferInKb > 0 )
+		{
+			const int32_t size{ static_cast<int32_t>( params_.sendBufferInKb * 1024 ) };
+			::setsockopt( connection, SOL_SOCKET, SO_SNDBUF, &size, sizeof( size ) );
+		}
+
+		clients_.push_back( Client{ connection, header_, 0, nullptr } );
+		++clientCount_;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+StreamOutput::Chunk
+StreamOutput::encode()
+{
+	const double scale{ 1.0 / static_cast<double>( std::max<uint32_t>( params_.decimation, 1 ) ) };
+
+	cv::Mat colourLeft{ slot_.left };
+	cv::Mat colourRight{ slot_.right };
+
+	if( slot_.left.channels() == 1 )
+	{
+		demosaic( slot_.left, colourLeft );
+		demosaic( slot_.right, colourRight );
+	}
+
+	cv::resize( colourLeft, left_, cv::Size(), scale, scale, cv::INTER_AREA );
+	cv::resize( colourRight, right_, cv::Size(), scale, scale, cv::INTER_AREA );
+
+	std::string chunk;
+	bool encoded{ };
+
+	if( params_.layout == "separate" )
+	{
+		encoded = append_image( left_, "left", chunk ) && append_image( right_, "right", chunk );
+	}
+	else
+	{
+		cv::hconcat( left_, right_, sideBySide_ );
+		encoded = append_image( sideBySide_, "pair", chunk );
+	}
+
+	if( !encoded )
+	{
+		ht::log_warning( "unable to encode the stream pair " + std::to_string( slot_.index ) );
+		return nullptr;
+	}
+
+	++encoded_;
+	return std::make_shared<const std::string>( std::move( chunk ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::append_image( const cv::Mat& image, const char* view, std::string& chunk )
+{
+	cv::cvtColor( image, rgb_, CV_BGR2RGB );
+
+	if( !encode_jpeg( rgb_, static_cast<int32_t>( params_.jpegQuality ), jpeg_ ) )
+	{
+		return false;
+	}
+
+	chunk += std::string{ "--" } + STREAM_BOUNDARY + "\r\nContent-Type: image/jpeg\r\n" +
+	         "Content-Length: " + std::to_string( jpeg_.size() ) + "\r\n" +
+	         "X-Frame-Index: " + std::to_string( slot_.index ) + "\r\n" +
+	         "X-Timestamp-Us: " + std::to_string( slot_.timestamp ) + "\r\n" +
+	         "X-View: " + view + "\r\n\r\n";
+	chunk.append( jpeg_.begin(), jpeg_.end() );
+	chunk += "\r\n";
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StreamOutput::broadcast( const Chunk& chunk )
+{
+	for( Client& client : clients_ )
+	{
+		if( !client.sending )
+		{
+			client.sending = chunk;
+			client.offset = 0;
+		}
+		else
+		{
+			if( client.next )
+			{
+				++dropped_;
+			}
+			client.next = chunk;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::send_to( Client& client )
+{
+	while( client.sending )
+	{
+		const std::string& data = *client.sending;
+		const ssize_t written{ ::send( client.socket, data.data() + client.offset,
+		                               data.size() - client.offset, MSG_NOSIGNAL | MSG_DONTWAIT ) };
+		if( written < 0 )
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+
+		client.offset += static_cast<size_t>( written );
+		if( client.offset < data.size() )
+		{
+			continue;
+		}
+
+		if( client.sending != header_ )
+		{
+			++sent_;
+		}
+		client.sending = std::move( client.next );
+		client.next = nullptr;
+		client.offset = 0;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+StreamOutput::receive_from( Client& client )
+{
+	char buffer[1024];
+
+	for( ;; )
+	{
+		const ssize_t received{ ::recv( client.socket, buffer, sizeof( buffer ), MSG_DONTWAIT ) };
+		if( received == 0 )
+		{
+			return false;
+		}
+		if( received < 0 )
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+StreamOutput::report( const Clock::time_point& now )
+{
+	if( params_.reportPeriodInMs == 0 ||
+	    now - lastReport_ < std::chrono::milliseconds( params_.reportPeriodInMs ) )
+	{
+		return;
+	}
+
+	cl::print_line( "stream: ", clients_.size(), " clients, ", encoded_, " encoded, ", sent_,
+	                " sent, ", dropped_, " dropped by slow clients, ", skipped_,
+	                " skipped by the processing thread" );
+
+	lastReport_ = now;
+}
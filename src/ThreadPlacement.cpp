@@ -0,0 +1,130 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "ThreadPlacement.hpp"
+
+#include "HTLogger.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ThreadPlacement::apply( const pthread_t thread, const ThreadRoleParams& role )
+{
+	bool applied{ true };
+
+	if( !role.cpus.empty() )
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO( &cpuSet );
+
+		for( uint32_t cpu : role.cpus )
+		{
+			// CPU_SET does not check its index, a cpu out of the set would write past it.
+			if( cpu >= CPU_SETSIZE )
+			{
+				ht::log_warning( "cpu " + std::to_string( cpu ) + " out of range, ignored" );
+				applied = false;
+				continue;
+			}
+			CPU_SET( cpu, &cpuSet );
+		}
+
+		if( CPU_COUNT( &cpuSet ) > 0 )
+		{
+			applied = pthread_setaffinity_np( thread, sizeof( cpuSet ), &cpuSet ) == 0 && applied;
+		}
+	}
+
+	if( role.priority > 0 )
+	{
+		sched_param param{ };
+		param.sched_priority = std::min( std::max( role.priority,
+		                                           sched_get_priority_min( SCHED_FIFO ) ),
+		                                 sched_get_priority_max( SCHED_FIFO ) );
+
+		applied = pthread_setschedparam( thread, SCHED_FIFO, &param ) == 0 && applied;
+	}
+
+	return applied;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ThreadPlacement::apply_to_current_thread( const ThreadRoleParams& role )
+{
+	return apply( pthread_self(), role );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ThreadPlacement::reset_current_thread()
+{
+	cpu_set_t cpuSet;
+	CPU_ZERO( &cpuSet );
+
+	const long cpuCount = sysconf( _SC_NPROCESSORS_CONF );
+	for( long cpu = 0; cpu < cpuCount; ++cpu )
+	{
+		CPU_SET( static_cast<size_t>( cpu ), &cpuSet );
+	}
+
+	sched_param param{ };
+	param.sched_priority = 0;
+
+	bool reset = pthread_setaffinity_np( pthread_self(), sizeof( cpuSet ), &cpuSet ) == 0;
+	reset = pthread_setschedparam( pthread_self(), SCHED_OTHER, &param ) == 0 && reset;
+	return reset;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ThreadPlacement::lock_memory()
+{
+	return mlockall( MCL_CURRENT | MCL_FUTURE ) == 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ThreadPlacement::unlock_memory()
+{
+	return munlockall() == 0;
+}
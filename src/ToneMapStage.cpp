@@ -0,0 +1,320 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "ToneMapStage.hpp"
+#include "AsyncLog.hpp"
+#include "FrameAccess.hpp"
+#include "WorkerPool.hpp"
+
+#include "CLPrint.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+const size_t LEVELS{ 256 };
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+ToneMapper::ToneMapper( const ToneMapParams& params )
+	: params_{ params }
+	, histograms_( (2 * std::max<uint32_t>( params.bands, 1 ) + 1) * LEVELS, 0 )
+	, curve_( LEVELS, 0.0 )
+	, lut_( 1, static_cast<int32_t>( LEVELS ), CV_8UC1 )
+	, hasCurve_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ToneMapper::~ToneMapper()
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ToneMapStage::ToneMapStage( const ToneMapParams& params, WorkerPool& pool )
+	: params_{ params }
+	, pool_( pool )
+	, mapper_{ params }
+	, mapped_{ }
+	, sinks_{ }
+	, frames_{ }
+	, timeInUs_{ }
+{ }
+
+//--------------------------------------------------------------------------------------------------
+//
+ToneMapStage::~ToneMapStage()
+{ }
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ToneMapper::process( const StereoFrame& src, StereoFrame& dst, WorkerPool* pool )
+{
+	const size_t bands{ std::max<uint32_t>( params_.bands, 1 ) };
+	const int32_t rows{ src.left.rows };
+	const cv::Mat* const inputs[]{ &src.left, &src.right };
+
+	dst.index = src.index;
+	dst.timestamp = src.timestamp;
+	dst.left.create( src.left.size(), src.left.type() );
+	dst.right.create( src.right.size(), src.right.type() );
+	cv::Mat* const outputs[]{ &dst.left, &dst.right };
+
+	const auto band_rows = [ bands, rows ]( const size_t band, int32_t& firstRow, int32_t& lastRow )
+	{
+		firstRow = static_cast<int32_t>( band * static_cast<size_t>( rows ) / bands );
+		lastRow = static_cast<int32_t>( (band + 1) * static_cast<size_t>( rows ) / bands );
+	};
+
+	std::fill( histograms_.begin(), histograms_.end(), 0 );
+
+	parallel_for( pool, 2 * bands, [ & ]( const size_t item )
+	{
+		int32_t firstRow{ };
+		int32_t lastRow{ };
+		band_rows( item % bands, firstRow, lastRow );
+		accumulate( *inputs[item / bands], firstRow, lastRow, &histograms_[item * LEVELS] );
+	} );
+
+	uint32_t* const merged{ &histograms_[2 * bands * LEVELS] };
+	for( size_t item = 0; item < 2 * bands; ++item )
+	{
+		const uint32_t* const histogram{ &histograms_[item * LEVELS] };
+		for( size_t level = 0; level < LEVELS; ++level )
+		{
+			merged[level] += histogram[level];
+		}
+	}
+
+	update_curve();
+
+	// cv::LUT is vectorized, every band writes its own rows of the preallocated outputs.
+	parallel_for( pool, 2 * bands, [ & ]( const size_t item )
+	{
+		int32_t firstRow{ };
+		int32_t lastRow{ };
+		band_rows( item % bands, firstRow, lastRow );
+
+		cv::Mat band{ outputs[item / bands]->rowRange( firstRow, lastRow ) };
+		cv::LUT( inputs[item / bands]->rowRange( firstRow, lastRow ), lut_, band );
+	} );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+const cv::Mat&
+ToneMapper::get_lut() const
+{
+	return lut_;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ToneMapper::accumulate( const cv::Mat& image, const int32_t firstRow, const int32_t lastRow,
+                        uint32_t* histogram ) const
+{
+	const int32_t step{ static_cast<int32_t>( std::max<uint32_t>( params_.sampleStep, 1 ) ) };
+	const int32_t channels{ image.channels() };
+	const int32_t stride{ step * channels };
+	const int32_t width{ image.cols * channels };
+
+	// Rows are sampled on a grid shared by every band, whatever the band boundaries.
+	const int32_t startRow{ (firstRow + step - 1) / step * step };
+
+	for( int32_t y = startRow; y < lastRow; y += step )
+	{
+		const uint8_t* row{ image.ptr<uint8_t>( y ) };
+
+		if( channels >= 3 )
+		{
+			for( int32_t x = 0; x < width; x += stride )
+			{
+				// Integer approximation of the luminance, (B + 2G + R) / 4.
+				++histogram[(row[x] + 2 * row[x + 1] + row[x + 2]) >> 2];
+			}
+		}
+		else
+		{
+			for( int32_t x = 0; x < width; x += stride )
+			{
+				++histogram[row[x]];
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ToneMapper::update_curve()
+{
+	const size_t bands{ std::max<uint32_t>( params_.bands, 1 ) };
+	const uint32_t* const merged{ &histograms_[2 * bands * LEVELS] };
+
+	double total{ };
+	for( size_t level = 0; level < LEVELS; ++level )
+	{
+		total += merged[level];
+	}
+
+	if( total <= 0.0 )
+	{
+		return;
+	}
+
+	// Clipping the histogram bounds the slope of the curve, so the noise of flat dark areas is not
+	// amplified. The clipped counts are spread evenly over every level.
+	const double clip{ std::max( params_.clipLimit, 1.0 ) * total / static_cast<double>( LEVELS ) };
+
+	double excess{ };
+	for( size_t level = 0; level < LEVELS; ++level )
+	{
+		excess += std::max( static_cast<double>( merged[level] ) - clip, 0.0 );
+	}
+
+	const double spread{ excess / static_cast<double>( LEVELS ) };
+	const double strength{ std::min( std::max( params_.strength, 0.0 ), 1.0 ) };
+	const double smoothing{ hasCurve_ ? std::min( std::max( params_.smoothing, 0.0 ), 1.0 )
+	                                  : 0.0 };
+
+	double cumulated{ };
+	for( size_t level = 0; level < LEVELS; ++level )
+	{
+		cumulated += std::min( static_cast<double>( merged[level] ), clip ) + spread;
+
+		const double equalized{ 255.0 * cumulated / total };
+		const double target{ strength * equalized +
+		                     (1.0 - strength) * static_cast<double>( level ) };
+
+		curve_[level] = smoothing * curve_[level] + (1.0 - smoothing) * target;
+		lut_.at<uint8_t>( static_cast<int32_t>( level ) ) = cv::saturate_cast<uint8_t>(
+			curve_[level] );
+	}
+
+	hasCurve_ = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ToneMapStage::add_sink( StereoSink& sink )
+{
+	sinks_.push_back( &sink );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ToneMapStage::submit( const StereoFrame& frame )
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	mapper_.process( frame, mapped_, &pool_ );
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start );
+	timeInUs_ += static_cast<double>( elapsed.count() );
+	++frames_;
+
+	// Queued to the log thread, a synchronous write to the console may stall the pipeline.
+	if( params_.printBenchmark )
+	{
+		AsyncLog::print_line( "ToneMap: ", elapsed.count(), " us" );
+	}
+
+	// Every sink gets the pair, a failed one does not starve the others.
+	bool success{ true };
+	for( StereoSink* sink : sinks_ )
+	{
+		success = sink->submit( mapped_ ) && success;
+	}
+
+	return success;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+ToneMapStage::print_report() const
+{
+	cl::print_line( "Tone map: ", frames_, " pairs, ",
+	                frames_ ? timeInUs_ / static_cast<double>( frames_ ) : 0.0, " us per pair" );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ToneMapStage::compute_result( co::ParamContext& context, const co::OutputResult& inResult )
+{
+	StereoFrame frame;
+	if( !extract_stereo_frame( inResult, frame ) || !submit( frame ) )
+	{
+		return false;
+	}
+
+	for( auto& iter : get_output_list() )
+	{
+		if( iter )
+		{
+			if( !iter->compute_result( context, inResult ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ToneMapStage::query_output_metrics( co::OutputMetrics& outputMetrics )
+{
+	cl::ignore( outputMetrics );
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+ToneMapStage::query_output_format( co::OutputFormat& outputFormat )
+{
+	cl::ignore( outputFormat );
+	return false;
+}
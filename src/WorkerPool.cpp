@@ -0,0 +1,272 @@
+//==================================================================================================
+//
+//  Copyright(c)  2013 - 2015  Naïo Technologies
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the
+//  GNU General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along with This program.
+//  If not, see <http://www.gnu.org/licenses/>.
+//
+//==================================================================================================
+
+//==================================================================================================
+// I N C L U D E   F I L E S
+
+#include "WorkerPool.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <memory>
+
+//==================================================================================================
+// C O N S T A N T S   &   L O C A L   V A R I A B L E S
+
+namespace
+{
+
+/// Pool and queue index of the calling thread, null outside of the workers.
+thread_local const WorkerPool* currentPool{ nullptr };
+thread_local size_t currentIndex{ };
+
+/// Items of a parallel_for, shared with the tasks that may still be queued once it has returned.
+struct ParallelLoop
+{
+	ParallelLoop( const size_t count, const std::function<void( size_t )>& body )
+		: body_( body )
+		, count_{ count }
+		, next_{ 0 }
+		, completed_{ 0 }
+		, mutex_{ }
+		, condition_{ }
+	{ }
+
+	/// Runs items until none is left.
+	void run()
+	{
+		size_t done{ };
+		for( size_t i = next_++; i < count_; i = next_++ )
+		{
+			body_( i );
+			++done;
+		}
+
+		if( done > 0 && (completed_ += done) == count_ )
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			condition_.notify_all();
+		}
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		condition_.wait( lock, [ this ]()
+		{ return completed_ == count_; } );
+	}
+
+	/// Only called while the loop is running, the caller of parallel_for then keeps it alive.
+	const std::function<void( size_t )>& body_;
+	const size_t count_;
+	std::atomic<size_t> next_;
+	std::atomic<size_t> completed_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+};
+
+}
+
+//==================================================================================================
+// G L O B A L S
+
+//==================================================================================================
+// C O N S T R U C T O R (S) / D E S T R U C T O R   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+WorkerPool::WorkerPool( const uint32_t workers, const ThreadRoleParams& placement )
+	: placement_{ placement }
+	, queues_{ }
+	, queued_{ 0 }
+	, pending_{ 0 }
+	, nextQueue_{ 0 }
+	, mutex_{ }
+	, taskCondition_{ }
+	, idleCondition_{ }
+	, running_{ true }
+	, threads_{ }
+{
+	const uint32_t count{ workers ? workers
+	                              : std::max<uint32_t>( std::thread::hardware_concurrency(), 1 ) };
+
+	for( uint32_t i = 0; i < count; ++i )
+	{
+		queues_.emplace_back( new Queue{ } );
+	}
+
+	for( uint32_t i = 0; i < count; ++i )
+	{
+		threads_.emplace_back( &WorkerPool::work, this, static_cast<size_t>( i ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		running_ = false;
+	}
+	taskCondition_.notify_all();
+
+	for( std::thread& thread : threads_ )
+	{
+		thread.join();
+	}
+}
+
+//==================================================================================================
+// M E T H O D S   C O D E   S E C T I O N
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+WorkerPool::size() const
+{
+	return threads_.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+size_t
+WorkerPool::get_worker_index() const
+{
+	return currentPool == this ? currentIndex : threads_.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+WorkerPool::submit( Task task )
+{
+	const size_t index{ currentPool == this ? currentIndex : nextQueue_++ % queues_.size() };
+
+	// Counted before it can be taken, so that a task completing at once never finds pending_ at 0.
+	++pending_;
+	{
+		Queue& queue = *queues_[index];
+		std::lock_guard<std::mutex> lock( queue.mutex );
+		queue.tasks.push_back( std::move( task ) );
+		++queued_;
+	}
+
+	// Taking the lock orders the push before the check of a worker about to sleep.
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+	}
+	taskCondition_.notify_one();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+WorkerPool::wait_idle()
+{
+	std::unique_lock<std::mutex> lock( mutex_ );
+	idleCondition_.wait( lock, [ this ]()
+	{ return pending_ == 0; } );
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool
+WorkerPool::pop( const size_t index, Task& task )
+{
+	for( size_t i = 0; i < queues_.size(); ++i )
+	{
+		Queue& queue = *queues_[(index + i) % queues_.size()];
+		std::lock_guard<std::mutex> lock( queue.mutex );
+
+		if( !queue.tasks.empty() )
+		{
+			task = std::move( queue.tasks.front() );
+			queue.tasks.pop_front();
+			--queued_;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+WorkerPool::work( const size_t index )
+{
+	// A new thread inherits the placement of its creator, often the pinned capture thread, which
+	// would serialize unplaced workers on its cpu.
+	if( placement_.cpus.empty() )
+	{
+		ThreadPlacement::reset_current_thread();
+	}
+	ThreadPlacement::apply_to_current_thread( placement_ );
+
+	currentPool = this;
+	currentIndex = index;
+
+	while( true )
+	{
+		Task task;
+		if( pop( index, task ) )
+		{
+			task();
+
+			if( --pending_ == 0 )
+			{
+				std::lock_guard<std::mutex> lock( mutex_ );
+				idleCondition_.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock( mutex_ );
+		taskCondition_.wait( lock, [ this ]()
+		{ return queued_ > 0 || !running_; } );
+
+		if( queued_ == 0 )
+		{
+			// Only reached once the pool is stopping, pending tasks are run first.
+			return;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void
+WorkerPool::parallel_for( const size_t count, const std::function<void( size_t )>& body )
+{
+	if( count == 0 )
+	{
+		return;
+	}
+
+	std::shared_ptr<ParallelLoop> loop = std::make_shared<ParallelLoop>( count, body );
+
+	const size_t helpers{ std::min( count - 1, threads_.size() ) };
+	for( size_t i = 0; i < helpers; ++i )
+	{
+		// A helper that starts after the last item was taken returns without touching the body.
+		submit( [ loop ]()
+		{ loop->run(); } );
+	}
+
+	loop->run();
+	loop->wait();
+}